@@ -0,0 +1,244 @@
+#include "Roms.h"
+
+// Number of opcodes in the body of every generated loop.
+const unsigned long BODY_OPCODES = 256;
+
+// Random source for the generators, fixed so the programs never change.
+class RomRandom {
+    public:
+        RomRandom() : state(0x9E3779B9) {}
+
+        unsigned int next(unsigned int bound) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return state % bound;
+        }
+    private:
+        uint32_t state;
+};
+
+unsigned short RomBuilder::here() const {
+    return static_cast<unsigned short>(0x200 + program.size());
+}
+
+void RomBuilder::op(unsigned short opcode) {
+    program.push_back(static_cast<unsigned char>(opcode >> 8));
+    program.push_back(static_cast<unsigned char>(opcode & 0xFF));
+}
+
+void RomBuilder::op(const std::vector<unsigned short>& opcodes) {
+    for (unsigned short opcode : opcodes) {
+        op(opcode);
+    }
+}
+
+void RomBuilder::repeat(const std::vector<unsigned short>& opcodes, unsigned long count) {
+    for (unsigned long i = 0; i < count; i++) {
+        op(opcodes);
+    }
+}
+
+const std::vector<unsigned char>& RomBuilder::bytes() const {
+    return program;
+}
+
+// Opcode with an address operand, such as 1NNN or ANNN.
+static unsigned short with_address(unsigned short opcode, unsigned int addr) {
+    return static_cast<unsigned short>(opcode | (addr & 0xFFF));
+}
+
+// Opcode with X and NN operands, such as 6XNN.
+static unsigned short with_x_nn(unsigned short opcode, unsigned int x, unsigned int nn) {
+    return static_cast<unsigned short>(opcode | (x << 8) | nn);
+}
+
+// Opcode with X and Y operands, such as 8XY4.
+static unsigned short with_x_y(unsigned short opcode, unsigned int x, unsigned int y) {
+    return static_cast<unsigned short>(opcode | (x << 8) | (y << 4));
+}
+
+std::vector<unsigned char> loop_rom(const std::vector<unsigned short>& setup,
+                                    const std::vector<unsigned short>& body) {
+    RomBuilder rom;
+    rom.op(setup);
+
+    unsigned short start = rom.here();
+    rom.repeat(body, BODY_OPCODES / body.size());
+    rom.op(with_address(0x1000, start));
+
+    return rom.bytes();
+}
+
+std::vector<unsigned char> synthetic_alu_rom() {
+    RomRandom random;
+    RomBuilder rom;
+
+    for (unsigned int x = 0; x < 15; x++) {
+        rom.op(with_x_nn(0x6000, x, random.next(256)));
+    }
+
+    // 8XY0 to 8XY7 and 8XYE
+    const unsigned short alu_ops[] = {0x8000, 0x8001, 0x8002, 0x8003, 0x8004,
+                                      0x8005, 0x8006, 0x8007, 0x800E};
+    unsigned short start = rom.here();
+    for (unsigned long i = 0; i < BODY_OPCODES; i++) {
+        unsigned int x = random.next(15);
+        unsigned int kind = random.next(11);
+        if (kind == 0) {
+            rom.op(with_x_nn(0x6000, x, random.next(256)));
+        } else if (kind == 1) {
+            rom.op(with_x_nn(0x7000, x, random.next(256)));
+        } else {
+            rom.op(with_x_y(alu_ops[kind - 2], x, random.next(15)));
+        }
+    }
+    rom.op(with_address(0x1000, start));
+
+    return rom.bytes();
+}
+
+std::vector<unsigned char> synthetic_branch_rom() {
+    RomRandom random;
+    RomBuilder rom;
+
+    unsigned short start = rom.here();
+    for (unsigned long i = 0; i < BODY_OPCODES / 4; i++) {
+        unsigned int x = random.next(8);
+        unsigned int y = random.next(8);
+
+        // A skip whose outcome depends on the registers, over an increment
+        // that changes them for the next iteration
+        switch (random.next(5)) {
+            case 0:
+                rom.op(with_x_nn(0x3000, x, random.next(4)));
+                break;
+            case 1:
+                rom.op(with_x_nn(0x4000, x, random.next(4)));
+                break;
+            case 2:
+                rom.op(with_x_y(0x5000, x, y));
+                break;
+            case 3:
+                rom.op(with_x_y(0x9000, x, y));
+                break;
+            case 4:
+                // A short forward jump over the increment
+                rom.op(with_address(0x1000, rom.here() + 4u));
+                break;
+        }
+        rom.op(with_x_nn(0x7000, x, 1));
+        rom.op(with_x_nn(0x7000, y, 3));
+        rom.op(with_x_nn(0x6000, random.next(8) + 8, random.next(256)));
+    }
+    rom.op(with_address(0x1000, start));
+
+    return rom.bytes();
+}
+
+std::vector<unsigned char> synthetic_draw_rom() {
+    RomRandom random;
+    RomBuilder rom;
+
+    unsigned short start = rom.here();
+    for (unsigned long i = 0; i < BODY_OPCODES / 4; i++) {
+        // Sprite data is taken from the program itself
+        rom.op(with_address(0xA000, 0x200 + random.next(256)));
+        rom.op(with_x_nn(0x6000, 0, random.next(64)));
+        rom.op(with_x_nn(0x6000, 1, random.next(32)));
+        rom.op(static_cast<unsigned short>(0xD010 | (random.next(15) + 1)));
+    }
+    rom.op(with_address(0x1000, start));
+
+    return rom.bytes();
+}
+
+std::vector<unsigned char> synthetic_memory_rom() {
+    RomRandom random;
+    RomBuilder rom;
+
+    for (unsigned int x = 0; x < 15; x++) {
+        rom.op(with_x_nn(0x6000, x, random.next(256)));
+    }
+
+    unsigned short start = rom.here();
+    for (unsigned long i = 0; i < BODY_OPCODES / 4; i++) {
+        // Everything is written well above the program
+        rom.op(with_address(0xA000, 0x800 + random.next(256)));
+        switch (random.next(3)) {
+            case 0:
+                rom.op(with_x_nn(0xF033, random.next(15), 0));
+                break;
+            case 1:
+                rom.op(with_x_nn(0xF055, random.next(16), 0));
+                break;
+            case 2:
+                rom.op(with_x_nn(0xF065, random.next(15), 0));
+                break;
+        }
+        rom.op(with_x_nn(0xF01E, random.next(15), 0));
+        rom.op(with_x_nn(0x7000, random.next(15), 1));
+    }
+    rom.op(with_address(0x1000, start));
+
+    return rom.bytes();
+}
+
+std::vector<unsigned char> synthetic_random_rom() {
+    RomRandom random;
+    RomBuilder rom;
+
+    for (unsigned int x = 0; x < 15; x++) {
+        rom.op(with_x_nn(0x6000, x, random.next(256)));
+    }
+
+    unsigned short start = rom.here();
+    for (unsigned long i = 0; i < BODY_OPCODES / 8; i++) {
+        unsigned int x = random.next(8);
+        unsigned int y = random.next(8) + 8;
+
+        // One skip in eight taken, over arithmetic that is run either way
+        rom.op(with_x_nn(0xC000, x, 7));
+        rom.op(with_x_nn(0x3000, x, 0));
+        rom.op(with_x_nn(0x7000, y, random.next(256)));
+        for (unsigned int j = 0; j < 5; j++) {
+            rom.op(with_x_y(0x8004, random.next(15), random.next(15)));
+        }
+    }
+    rom.op(with_address(0x1000, start));
+
+    return rom.bytes();
+}
+
+std::vector<unsigned char> synthetic_scroll_rom() {
+    RomRandom random;
+    RomBuilder rom;
+
+    // Hi-res, both planes
+    rom.op({0x00FF, 0xF301});
+
+    // 00CN, 00DN, 00FB and 00FC
+    const unsigned short scroll_ops[] = {0x00C0, 0x00D0, 0x00FB, 0x00FC};
+    unsigned short start = rom.here();
+    for (unsigned long i = 0; i < BODY_OPCODES / 4; i++) {
+        rom.op(with_address(0xA000, 0x200 + random.next(256)));
+        rom.op(with_x_nn(0x6000, 0, random.next(128)));
+        rom.op(with_x_nn(0x6000, 1, random.next(64)));
+        if (random.next(4) == 0) {
+            unsigned short scroll = scroll_ops[random.next(4)];
+            rom.op(scroll < 0x00F0 ? static_cast<unsigned short>(scroll | (random.next(15) + 1)) : scroll);
+        } else {
+            rom.op(static_cast<unsigned short>(0xD010 | random.next(16)));
+        }
+    }
+    rom.op(with_address(0x1000, start));
+
+    return rom.bytes();
+}
+
+std::unique_ptr<Chip8> make_machine(const std::vector<unsigned char>& program) {
+    std::unique_ptr<Chip8> chip8(new Chip8());
+    chip8->initialize();
+    chip8->load_program(program.data(), program.size());
+    return chip8;
+}
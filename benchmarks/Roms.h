@@ -0,0 +1,52 @@
+#ifndef ROMS_H
+#define ROMS_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Chip8.h"
+
+// Programs for the benchmarks, assembled in memory.
+
+// Builds a program out of raw opcodes, starting at 0x200.
+class RomBuilder {
+    public:
+        // Address the next opcode will be placed at.
+        unsigned short here() const;
+
+        void op(unsigned short opcode);
+        void op(const std::vector<unsigned short>& opcodes);
+        // Appends count copies of the given opcodes.
+        void repeat(const std::vector<unsigned short>& opcodes, unsigned long count);
+
+        const std::vector<unsigned char>& bytes() const;
+    private:
+        std::vector<unsigned char> program;
+};
+
+// Runs `setup` once, then `body` repeated to fill a loop that jumps back to
+// the start of the repetitions forever.
+std::vector<unsigned char> loop_rom(const std::vector<unsigned short>& setup,
+                                    const std::vector<unsigned short>& body);
+
+// Synthetic workloads, generated from a fixed seed so that every build runs
+// the same programs.
+//   alu:    register arithmetic and logic only
+//   branch: skips and short jumps with data dependent outcomes
+//   draw:   sprites of varying height and position, with collisions
+//   memory: BCD stores and register dumps/loads walking through memory
+//   random: register arithmetic with skips on random numbers, so machines
+//           with different seeds take different paths
+//   scroll: hi-res sprites on both planes, with a scroll every few sprites
+std::vector<unsigned char> synthetic_alu_rom();
+std::vector<unsigned char> synthetic_branch_rom();
+std::vector<unsigned char> synthetic_draw_rom();
+std::vector<unsigned char> synthetic_memory_rom();
+std::vector<unsigned char> synthetic_random_rom();
+std::vector<unsigned char> synthetic_scroll_rom();
+
+// An initialized machine with the program loaded.
+std::unique_ptr<Chip8> make_machine(const std::vector<unsigned char>& program);
+
+#endif
@@ -0,0 +1,108 @@
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "Roms.h"
+#include "Scheduler.h"
+#include "Snapshot.h"
+#include "libchip8.h"
+
+// Frontend frames: everything main does for one 60 Hz frame short of the
+// SDL calls themselves. The scheduler runs a frame and ticks the timers, and
+// the rows that changed are expanded into the ARGB pixels that would be
+// uploaded to the texture. Time per iteration is the cost of one frame.
+
+const std::array<uint32_t, 4> BENCH_PALETTE = {{0xFF000000, 0xFFFFFFFF, 0xFFAA4400, 0xFFFFAA00}};
+
+static void BM_Frame(benchmark::State& state, std::vector<unsigned char> (*generate)()) {
+    unsigned long instructions_per_frame = static_cast<unsigned long>(state.range(0));
+
+    std::unique_ptr<Chip8> chip8 = make_machine(generate());
+    Scheduler scheduler(*chip8, instructions_per_frame);
+    std::array<uint32_t, 128 * 64> pixels;
+
+    for (auto _ : state) {
+        scheduler.run_frame();
+
+        if (chip8->gfx.dirty()) {
+            chip8->gfx.expand_rows_to_rgba(pixels.data(), chip8->gfx.first_dirty_row(),
+                                           chip8->gfx.last_dirty_row(), BENCH_PALETTE);
+            chip8->gfx.mark_clean();
+        }
+        benchmark::DoNotOptimize(pixels.data());
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(scheduler.total_instructions()));
+    state.counters["frames_per_second"] = benchmark::Counter(
+        static_cast<double>(scheduler.total_frames()), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK_CAPTURE(BM_Frame, alu, synthetic_alu_rom)->ArgName("ipf")->Arg(10)->Arg(1000);
+BENCHMARK_CAPTURE(BM_Frame, draw, synthetic_draw_rom)->ArgName("ipf")->Arg(10)->Arg(1000);
+BENCHMARK_CAPTURE(BM_Frame, scroll, synthetic_scroll_rom)->ArgName("ipf")->Arg(10)->Arg(1000);
+
+// A frame with --run-ahead: the frame itself, then the state is saved, the
+// frames ahead are run and the whole future display is expanded before
+// rolling back.
+static void BM_RunAheadFrame(benchmark::State& state, std::vector<unsigned char> (*generate)()) {
+    unsigned long instructions_per_frame = static_cast<unsigned long>(state.range(0));
+    unsigned long frames_ahead = static_cast<unsigned long>(state.range(1));
+
+    std::unique_ptr<Chip8> chip8 = make_machine(generate());
+    Jit jit(*chip8);
+    Scheduler scheduler(*chip8, instructions_per_frame);
+    std::unique_ptr<Snapshot> snapshot(new Snapshot());
+    std::array<uint32_t, 128 * 64> pixels;
+
+    for (auto _ : state) {
+        scheduler.run_frame();
+
+        chip8->save(*snapshot);
+        for (unsigned long i = 0; i < frames_ahead; i++) {
+            scheduler.run_frame_ahead();
+        }
+        chip8->gfx.expand_rows_to_rgba(pixels.data(), 0, chip8->gfx.height() - 1, BENCH_PALETTE);
+        jit.restore(*snapshot);
+        benchmark::DoNotOptimize(pixels.data());
+    }
+
+    state.counters["frames_per_second"] = benchmark::Counter(
+        static_cast<double>(scheduler.total_frames()), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK_CAPTURE(BM_RunAheadFrame, draw, synthetic_draw_rom)
+    ->ArgNames({"ipf", "ahead"})->ArgsProduct({{10, 1000}, {0, 1, 4}});
+BENCHMARK_CAPTURE(BM_RunAheadFrame, scroll, synthetic_scroll_rom)
+    ->ArgNames({"ipf", "ahead"})->ArgsProduct({{10, 1000}, {0, 1, 4}});
+
+// libchip8: one chip8_step_frames() call over many machines at 10 ipf, with
+// every machine's image written out (frames:1) or not. items_per_second is
+// machine frames.
+static void BM_StepFrames(benchmark::State& state) {
+    unsigned long count = static_cast<unsigned long>(state.range(0));
+    bool write_frames = state.range(1) != 0;
+
+    std::vector<unsigned char> program = synthetic_draw_rom();
+    std::vector<chip8_machine*> machines;
+    std::vector<uint16_t> inputs(count);
+    for (unsigned long i = 0; i < count; i++) {
+        machines.push_back(chip8_create());
+        chip8_load_rom(machines.back(), program.data(), program.size(), static_cast<uint32_t>(i));
+        inputs[i] = static_cast<uint16_t>(1u << (i % 16));
+    }
+    std::vector<uint8_t> frames(count * CHIP8_FRAME_BYTES);
+
+    for (auto _ : state) {
+        chip8_step_frames(machines.data(), count, inputs.data(), write_frames ? frames.data() : nullptr);
+        benchmark::DoNotOptimize(frames.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+
+    for (chip8_machine* machine : machines) {
+        chip8_destroy(machine);
+    }
+}
+
+BENCHMARK(BM_StepFrames)->ArgNames({"machines", "frames"})->ArgsProduct({{1, 64, 1024}, {0, 1}});
@@ -0,0 +1,144 @@
+#include <array>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "BatchCore.h"
+#include "Jit.h"
+#include "Roms.h"
+
+// Macro-benchmarks: generated programs with a realistic mix of instructions,
+// on the interpreter (core:0) and on the JIT (core:1). items_per_second is
+// the number of Chip8 instructions executed.
+
+const unsigned long MACRO_CYCLES_PER_ITERATION = 1 << 16;
+
+static void BM_Synthetic(benchmark::State& state, std::vector<unsigned char> (*generate)()) {
+    bool use_jit = state.range(0) != 0;
+    if (use_jit && !Jit::available()) {
+        state.SkipWithError("The JIT is not available on this host");
+        return;
+    }
+
+    std::unique_ptr<Chip8> chip8 = make_machine(generate());
+    Jit jit(*chip8);
+
+    unsigned long executed = 0;
+    for (auto _ : state) {
+        executed += use_jit ? jit.run(MACRO_CYCLES_PER_ITERATION) : chip8->run(MACRO_CYCLES_PER_ITERATION);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(executed));
+}
+
+BENCHMARK_CAPTURE(BM_Synthetic, alu, synthetic_alu_rom)->ArgName("core")->Arg(0)->Arg(1);
+BENCHMARK_CAPTURE(BM_Synthetic, branch, synthetic_branch_rom)->ArgName("core")->Arg(0)->Arg(1);
+BENCHMARK_CAPTURE(BM_Synthetic, draw, synthetic_draw_rom)->ArgName("core")->Arg(0)->Arg(1);
+BENCHMARK_CAPTURE(BM_Synthetic, memory, synthetic_memory_rom)->ArgName("core")->Arg(0)->Arg(1);
+BENCHMARK_CAPTURE(BM_Synthetic, random, synthetic_random_rom)->ArgName("core")->Arg(0)->Arg(1);
+BENCHMARK_CAPTURE(BM_Synthetic, scroll, synthetic_scroll_rom)->ArgName("core")->Arg(0)->Arg(1);
+
+// One program on many machines with different seeds: a BatchCore of that
+// many lanes (batch:1) against as many interpreters run one after the other
+// (batch:0). items_per_second counts the instructions of all machines.
+
+const unsigned long LOCKSTEP_CYCLES_PER_ITERATION = 1 << 12;
+
+// Before a batch is timed it is checked against separate interpreters for
+// a number of frames, of a length that ends them partway through loops.
+const unsigned long VERIFY_FRAMES = 60;
+const unsigned long VERIFY_CYCLES_PER_FRAME = 997;
+
+// Whether every lane of a batch runs each frame like a Chip8 by itself:
+// the same number of instructions, the same idle() and the same display.
+template <unsigned int Lanes>
+static bool lanes_match(const std::vector<unsigned char>& program, const std::array<uint32_t, Lanes>& seeds) {
+    std::unique_ptr<BatchCore<Lanes>> batch(new BatchCore<Lanes>());
+    batch->initialize(seeds);
+    batch->load_program(program.data(), program.size());
+
+    std::vector<std::unique_ptr<Chip8>> machines;
+    for (unsigned int lane = 0; lane < Lanes; lane++) {
+        machines.emplace_back(new Chip8());
+        machines.back()->initialize(seeds[lane]);
+        machines.back()->load_program(program.data(), program.size());
+    }
+
+    for (unsigned long frame = 0; frame < VERIFY_FRAMES; frame++) {
+        batch->run(VERIFY_CYCLES_PER_FRAME);
+        for (unsigned int lane = 0; lane < Lanes; lane++) {
+            Chip8& machine = *machines[lane];
+            const Chip8& batched = batch->lane(lane);
+            unsigned long executed = machine.run(VERIFY_CYCLES_PER_FRAME);
+            if (batch->lane_executed(lane) != executed || batched.idle() != machine.idle()
+                || batched.gfx.hash() != machine.gfx.hash()) {
+                return false;
+            }
+            machine.tick_timers();
+        }
+        batch->tick_timers();
+    }
+    return true;
+}
+
+template <unsigned int Lanes>
+static void run_lanes(benchmark::State& state, const std::vector<unsigned char>& program, bool batched) {
+    std::array<uint32_t, Lanes> seeds;
+    for (unsigned int lane = 0; lane < Lanes; lane++) {
+        seeds[lane] = DEFAULT_SEED + lane;
+    }
+
+    unsigned long executed = 0;
+    if (batched) {
+        if (!lanes_match<Lanes>(program, seeds)) {
+            state.SkipWithError("BatchCore lanes differ from separate interpreters");
+            return;
+        }
+
+        std::unique_ptr<BatchCore<Lanes>> batch(new BatchCore<Lanes>());
+        batch->initialize(seeds);
+        batch->load_program(program.data(), program.size());
+        for (auto _ : state) {
+            executed += batch->run(LOCKSTEP_CYCLES_PER_ITERATION);
+        }
+        state.counters["lockstep"] = static_cast<double>(batch->lockstep_instructions())
+                                     / static_cast<double>(batch->total_instructions());
+    } else {
+        std::vector<std::unique_ptr<Chip8>> machines;
+        for (unsigned int lane = 0; lane < Lanes; lane++) {
+            machines.emplace_back(new Chip8());
+            machines.back()->initialize(seeds[lane]);
+            machines.back()->load_program(program.data(), program.size());
+        }
+        for (auto _ : state) {
+            for (std::unique_ptr<Chip8>& machine : machines) {
+                executed += machine->run(LOCKSTEP_CYCLES_PER_ITERATION);
+            }
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(executed));
+}
+
+static void BM_Lockstep(benchmark::State& state, std::vector<unsigned char> (*generate)()) {
+    std::vector<unsigned char> program = generate();
+    bool batched = state.range(1) != 0;
+    switch (state.range(0)) {
+        case 8:
+            run_lanes<8>(state, program, batched);
+            break;
+        case 16:
+            run_lanes<16>(state, program, batched);
+            break;
+        default:
+            run_lanes<32>(state, program, batched);
+            break;
+    }
+}
+
+BENCHMARK_CAPTURE(BM_Lockstep, alu, synthetic_alu_rom)
+    ->ArgNames({"lanes", "batch"})->ArgsProduct({{8, 16, 32}, {0, 1}});
+BENCHMARK_CAPTURE(BM_Lockstep, branch, synthetic_branch_rom)
+    ->ArgNames({"lanes", "batch"})->ArgsProduct({{8, 16, 32}, {0, 1}});
+BENCHMARK_CAPTURE(BM_Lockstep, random, synthetic_random_rom)
+    ->ArgNames({"lanes", "batch"})->ArgsProduct({{8, 16, 32}, {0, 1}});
+BENCHMARK_CAPTURE(BM_Lockstep, draw, synthetic_draw_rom)
+    ->ArgNames({"lanes", "batch"})->ArgsProduct({{8, 16, 32}, {0, 1}});
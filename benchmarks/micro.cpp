@@ -0,0 +1,240 @@
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "Rewind.h"
+#include "Roms.h"
+#include "Snapshot.h"
+
+// Micro-benchmarks: one opcode family at a time, repeated in a tight loop.
+// items_per_second is the number of Chip8 instructions executed.
+
+const unsigned long CYCLES_PER_ITERATION = 4096;
+
+static void run_loop(benchmark::State& state, const std::vector<unsigned char>& program) {
+    std::unique_ptr<Chip8> chip8 = make_machine(program);
+
+    unsigned long executed = 0;
+    for (auto _ : state) {
+        executed += chip8->run(CYCLES_PER_ITERATION);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(executed));
+}
+
+static void BM_Opcode(benchmark::State& state, std::vector<unsigned short> setup,
+                      std::vector<unsigned short> body) {
+    run_loop(state, loop_rom(setup, body));
+}
+
+// Registers used by the bodies below: V0 = 0, V1 = 1, V2 = 0x20
+#define SETUP {0x6000, 0x6101, 0x6220}
+
+BENCHMARK_CAPTURE(BM_Opcode, 0_cls, SETUP, {0x00E0});
+BENCHMARK_CAPTURE(BM_Opcode, 3_se_not_taken, SETUP, {0x3001});
+BENCHMARK_CAPTURE(BM_Opcode, 3_se_taken, SETUP, {0x3000, 0x6000});
+BENCHMARK_CAPTURE(BM_Opcode, 4_sne, SETUP, {0x4000});
+BENCHMARK_CAPTURE(BM_Opcode, 5_se_vx_vy, SETUP, {0x5010});
+BENCHMARK_CAPTURE(BM_Opcode, 6_ld, SETUP, {0x6312});
+BENCHMARK_CAPTURE(BM_Opcode, 7_add, SETUP, {0x7301});
+BENCHMARK_CAPTURE(BM_Opcode, 8_ld, SETUP, {0x8310});
+BENCHMARK_CAPTURE(BM_Opcode, 8_or, SETUP, {0x8311});
+BENCHMARK_CAPTURE(BM_Opcode, 8_and, SETUP, {0x8312});
+BENCHMARK_CAPTURE(BM_Opcode, 8_xor, SETUP, {0x8313});
+BENCHMARK_CAPTURE(BM_Opcode, 8_add, SETUP, {0x8314});
+BENCHMARK_CAPTURE(BM_Opcode, 8_sub, SETUP, {0x8315});
+BENCHMARK_CAPTURE(BM_Opcode, 8_shr, SETUP, {0x8316});
+BENCHMARK_CAPTURE(BM_Opcode, 8_subn, SETUP, {0x8317});
+BENCHMARK_CAPTURE(BM_Opcode, 8_shl, SETUP, {0x831E});
+BENCHMARK_CAPTURE(BM_Opcode, 9_sne_vx_vy, SETUP, {0x9000});
+BENCHMARK_CAPTURE(BM_Opcode, a_ld_i, SETUP, {0xA300});
+BENCHMARK_CAPTURE(BM_Opcode, c_rnd, SETUP, {0xC3FF});
+BENCHMARK_CAPTURE(BM_Opcode, e_skp, SETUP, {0xE09E});
+BENCHMARK_CAPTURE(BM_Opcode, e_sknp, SETUP, {0xE0A1});
+BENCHMARK_CAPTURE(BM_Opcode, f_ld_vx_dt, SETUP, {0xF307});
+BENCHMARK_CAPTURE(BM_Opcode, f_ld_dt_vx, SETUP, {0xF215});
+BENCHMARK_CAPTURE(BM_Opcode, f_ld_st_vx, SETUP, {0xF218});
+BENCHMARK_CAPTURE(BM_Opcode, f_add_i_vx, SETUP, {0xA800, 0xF21E});
+BENCHMARK_CAPTURE(BM_Opcode, f_ld_f_vx, SETUP, {0xF129});
+BENCHMARK_CAPTURE(BM_Opcode, f_ld_b_vx, SETUP, {0xA800, 0xF233});
+BENCHMARK_CAPTURE(BM_Opcode, f_ld_mem_vx, SETUP, {0xA800, 0xFF55});
+BENCHMARK_CAPTURE(BM_Opcode, f_ld_vx_mem, SETUP, {0xA800, 0xFE65});
+
+// SUPER-CHIP and XO-CHIP, on the hi-res screen with both planes selected
+#define HIRES_SETUP {0x6000, 0x6101, 0x6220, 0x00FF, 0xF301}
+
+BENCHMARK_CAPTURE(BM_Opcode, 0_scd, HIRES_SETUP, {0x00C1});
+BENCHMARK_CAPTURE(BM_Opcode, 0_scu, HIRES_SETUP, {0x00D1});
+BENCHMARK_CAPTURE(BM_Opcode, 0_scr, HIRES_SETUP, {0x00FB});
+BENCHMARK_CAPTURE(BM_Opcode, 0_scl, HIRES_SETUP, {0x00FC});
+BENCHMARK_CAPTURE(BM_Opcode, 5_save_vx_vy, SETUP, {0xA800, 0x50F2});
+BENCHMARK_CAPTURE(BM_Opcode, d_drw_16x16, HIRES_SETUP, {0xA200, 0xD120});
+BENCHMARK_CAPTURE(BM_Opcode, f_ld_i_long, SETUP, {0xF000, 0x8000});
+
+// Jumps and calls need targets inside the program, so they are laid out by hand.
+
+static void BM_JumpChain(benchmark::State& state) {
+    RomBuilder rom;
+    // Every jump goes to the next one, the last back to the first
+    for (unsigned int i = 0; i < 255; i++) {
+        rom.op(static_cast<unsigned short>(0x1000 | (rom.here() + 2)));
+    }
+    rom.op(0x1200);
+    run_loop(state, rom.bytes());
+}
+BENCHMARK(BM_JumpChain);
+
+static void BM_JumpV0Chain(benchmark::State& state) {
+    RomBuilder rom;
+    rom.op(0x6002);
+    // BNNN with V0 = 2 lands on the next instruction
+    for (unsigned int i = 0; i < 255; i++) {
+        rom.op(static_cast<unsigned short>(0xB000 | rom.here()));
+    }
+    rom.op(0x1202);
+    run_loop(state, rom.bytes());
+}
+BENCHMARK(BM_JumpV0Chain);
+
+static void BM_CallReturn(benchmark::State& state) {
+    RomBuilder rom;
+    unsigned short subroutine = 0x200 + 2 * 129;
+    for (unsigned int i = 0; i < 128; i++) {
+        rom.op(static_cast<unsigned short>(0x2000 | subroutine));
+    }
+    rom.op(0x1200);
+    rom.op(0x00EE);
+    run_loop(state, rom.bytes());
+}
+BENCHMARK(BM_CallReturn);
+
+static void BM_WaitForKeyPressed(benchmark::State& state) {
+    std::vector<unsigned char> program = loop_rom(SETUP, {0xF30A});
+    std::unique_ptr<Chip8> chip8 = make_machine(program);
+    chip8->keys[5] = 1;
+
+    unsigned long executed = 0;
+    for (auto _ : state) {
+        executed += chip8->run(CYCLES_PER_ITERATION);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(executed));
+}
+BENCHMARK(BM_WaitForKeyPressed);
+
+// DXYN by sprite height, at a position that fits on screen and at one that
+// wraps around the right and bottom edges.
+static void BM_Draw(benchmark::State& state) {
+    unsigned short height = static_cast<unsigned short>(state.range(0));
+    bool wrap = state.range(1) != 0;
+
+    unsigned short x = wrap ? 0x603C : 0x6010;
+    unsigned short y = wrap ? 0x611C : 0x6108;
+    run_loop(state, loop_rom({x, y, 0xA200}, {static_cast<unsigned short>(0xD010 | height)}));
+}
+BENCHMARK(BM_Draw)->ArgNames({"height", "wrap"})->ArgsProduct({{1, 5, 8, 15}, {0, 1}});
+
+static void BM_Initialize(benchmark::State& state) {
+    std::unique_ptr<Chip8> chip8(new Chip8());
+    for (auto _ : state) {
+        chip8->initialize();
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_Initialize);
+
+static void BM_LoadProgramFromMemory(benchmark::State& state) {
+    std::vector<unsigned char> program = synthetic_alu_rom();
+    std::unique_ptr<Chip8> chip8 = make_machine(program);
+    for (auto _ : state) {
+        chip8->load_program(program.data(), program.size());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(program.size()));
+}
+BENCHMARK(BM_LoadProgramFromMemory);
+
+static void BM_LoadProgramFromFile(benchmark::State& state) {
+    std::vector<unsigned char> program = synthetic_alu_rom();
+    std::string path = "chip8-bench.ch8";
+    {
+        std::ofstream file(path, std::ios::out | std::ios::binary);
+        file.write(reinterpret_cast<const char*>(program.data()), static_cast<std::streamsize>(program.size()));
+    }
+
+    std::unique_ptr<Chip8> chip8 = make_machine(program);
+    for (auto _ : state) {
+        chip8->load_program(path);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(program.size()));
+
+    std::remove(path.c_str());
+}
+BENCHMARK(BM_LoadProgramFromFile);
+
+static void BM_SnapshotSave(benchmark::State& state) {
+    std::unique_ptr<Chip8> chip8 = make_machine(synthetic_memory_rom());
+    chip8->run(100000);
+    std::unique_ptr<Snapshot> snapshot(new Snapshot());
+    for (auto _ : state) {
+        chip8->save(*snapshot);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_SnapshotSave);
+
+// Alternates between the states one frame apart, as rewinding and running
+// ahead do.
+static void BM_SnapshotRestore(benchmark::State& state) {
+    std::unique_ptr<Chip8> chip8 = make_machine(synthetic_memory_rom());
+    chip8->run(100000);
+    std::unique_ptr<Snapshot> before(new Snapshot());
+    std::unique_ptr<Snapshot> after(new Snapshot());
+    chip8->save(*before);
+    chip8->run(10);
+    chip8->save(*after);
+
+    bool back = true;
+    for (auto _ : state) {
+        chip8->restore(back ? *before : *after);
+        back = !back;
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_SnapshotRestore);
+
+// Records a frame of history, a delta against the keyframe most of the time.
+static void BM_RewindPush(benchmark::State& state) {
+    std::unique_ptr<Chip8> chip8 = make_machine(synthetic_memory_rom());
+    chip8->run(100000);
+    Rewind rewind(16 << 20);
+    for (auto _ : state) {
+        chip8->run(10);
+        rewind.push(*chip8);
+    }
+}
+BENCHMARK(BM_RewindPush);
+
+// Steps back one frame and restores it, as holding the rewind key does.
+// The history is refilled outside the timing when it runs out.
+static void BM_RewindStepBack(benchmark::State& state) {
+    std::unique_ptr<Chip8> chip8 = make_machine(synthetic_memory_rom());
+    chip8->run(100000);
+    Rewind rewind(16 << 20);
+    std::unique_ptr<Snapshot> snapshot(new Snapshot());
+    for (auto _ : state) {
+        if (rewind.frames() == 0) {
+            state.PauseTiming();
+            for (unsigned int i = 0; i < 10 * REWIND_KEYFRAME_INTERVAL; i++) {
+                chip8->run(10);
+                rewind.push(*chip8);
+            }
+            state.ResumeTiming();
+        }
+        rewind.step_back(*snapshot);
+        chip8->restore(*snapshot);
+    }
+}
+BENCHMARK(BM_RewindStepBack);
@@ -0,0 +1,174 @@
+#ifndef AOT_RUNTIME_H
+#define AOT_RUNTIME_H
+
+#include <memory>
+#include <vector>
+
+#include "Chip8.h"
+
+// A block of a program translated ahead of time by chip8-aot, see
+// include/Recompiler.h.
+struct AotBlock {
+    unsigned short start;
+    // First address after the memory the block was translated from
+    unsigned int end;
+    unsigned short count;
+};
+
+// A translated program: the ROM it was translated from, the quirks it was
+// translated for and its blocks in address order.
+//
+// run() runs the blocks from the instruction at the PC for up to budget
+// instructions, going from block to block as long as valid[address] is
+// set for where they lead, and returns how many instructions ran with the
+// PC after them. It stops early at an instruction it leaves to the
+// interpreter, after one that wrote memory, and before one that would
+// fault, for the interpreter to raise the fault.
+struct AotProgram {
+    const char* name;
+    const unsigned char* rom;
+    unsigned long size;
+    unsigned int quirks;
+    const AotBlock* blocks;
+    unsigned long block_count;
+    unsigned long (*run)(Chip8& chip8, const unsigned char* valid, unsigned long budget);
+};
+
+// Defined by the translation unit chip8-aot writes.
+extern const AotProgram aot_program;
+
+// Runs a Chip8 on the blocks of a translated program, and on the
+// interpreter wherever there are none: code only reached through BNNN,
+// instructions the translation leaves out, and the ends of frames that
+// are too short for a whole block.
+//
+// A block only runs while the machine's memory still holds the bytes it
+// was translated from. Whatever writes to memory, the blocks it changes
+// are left to the interpreter until their bytes are back, and the machine
+// must have the program's quirks or it is interpreted throughout.
+class AotRuntime {
+    public:
+        AotRuntime(Chip8& machine, const AotProgram& translated);
+
+        AotRuntime(const AotRuntime&) = delete;
+        AotRuntime& operator=(const AotRuntime&) = delete;
+
+        // Same contract as Chip8::run().
+        unsigned long run(unsigned long cycles);
+
+        // Checks every block against the interpreter in lockstep and throws
+        // on the first difference.
+        void enable_check();
+
+        // Instructions run by translated blocks so far, out of all of them.
+        unsigned long long translated_instructions() const;
+        unsigned long long total_instructions() const;
+
+        // The machine state translated code works on.
+        static unsigned short pc(const Chip8& chip8) {
+            return chip8.pc;
+        }
+        static unsigned char* registers(Chip8& chip8) {
+            return chip8.regs.data();
+        }
+        static unsigned short& index(Chip8& chip8) {
+            return chip8.I;
+        }
+        static unsigned char& delay_timer(Chip8& chip8) {
+            return chip8.delay_timer;
+        }
+        static unsigned char& sound_timer(Chip8& chip8) {
+            return chip8.sound_timer;
+        }
+        static bool key(const Chip8& chip8, unsigned char value) {
+            return chip8.keys[value & 0xF] != 0;
+        }
+
+        // The instructions translated code leaves to Chip8, with the same
+        // semantics as the interpreter.
+        static void clear_display(Chip8& chip8) {
+            chip8.clear_display();
+        }
+        static unsigned char random(Chip8& chip8) {
+            return chip8.next_random();
+        }
+        static void draw_sprite(Chip8& chip8, unsigned char X, unsigned char Y, unsigned char N, bool clip) {
+            chip8.draw_sprite(X, Y, N, clip);
+        }
+        static void store_bcd(Chip8& chip8, unsigned char X) {
+            chip8.store_bcd(X);
+        }
+        static void store_registers(Chip8& chip8, unsigned char X) {
+            chip8.store_registers(X);
+        }
+        static void load_registers(Chip8& chip8, unsigned char X) {
+            chip8.load_registers(X);
+        }
+
+        // Calls target, returning to return_address. False if the stack is
+        // full, leaving the machine as it was.
+        static bool call(Chip8& chip8, unsigned short return_address, unsigned short target) {
+            if (chip8.sp == chip8.stack.size()) {
+                return false;
+            }
+            chip8.pc = return_address;
+            chip8.call_subroutine(target);
+            return true;
+        }
+        // False if the stack is empty, leaving the machine as it was.
+        static bool ret(Chip8& chip8) {
+            if (chip8.sp == 0) {
+                return false;
+            }
+            chip8.return_from_subroutine();
+            return true;
+        }
+
+        // Stops translated code at pc after executed instructions.
+        static unsigned long leave(Chip8& chip8, unsigned short pc, unsigned long executed) {
+            chip8.pc = pc;
+            return executed;
+        }
+        // Stops translated code at the target of the 1NNN at from, adding
+        // the cycles the interpreter would skip as a wait after it.
+        static unsigned long jump(Chip8& chip8, unsigned short from, unsigned short target, unsigned long executed,
+                                  unsigned long budget) {
+            chip8.pc = target;
+            if (!chip8.waits_after_jump(from, target)) {
+                return executed;
+            }
+            unsigned long idle = chip8.idle_cycles(budget - executed);
+            chip8.waiting = chip8.waiting || idle != 0;
+            return executed + idle;
+        }
+    private:
+        // The block instruction at each address
+        struct Entry {
+            unsigned int end;
+            // Instructions from here to the end of the block, 0 if there
+            // is no block instruction here
+            unsigned short count;
+        };
+
+        Chip8& chip8;
+        const AotProgram& program;
+        std::vector<Entry> entries;
+        // Set while memory holds what the block at the address was
+        // translated from, from there to the end of the block
+        std::vector<unsigned char> valid;
+        // Entries starting up to this many bytes before an address may
+        // cover it
+        unsigned long longest_block;
+
+        unsigned long long translated_count;
+        unsigned long long total_count;
+
+        std::unique_ptr<Chip8> reference;
+
+        void take_writes();
+        void check(unsigned long low, unsigned long high);
+        bool unchanged(unsigned long start, unsigned long end) const;
+        static bool same_state(const Chip8& a, const Chip8& b);
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "Chip8.h"
+#include "SpscRing.h"
+
+// What the speaker should be doing, as of the end of a frame.
+struct SoundState {
+    bool playing;
+    unsigned char pitch;
+    std::array<unsigned char, 16> pattern;
+    // steady_clock time it was published, in nanoseconds
+    int64_t published;
+};
+
+// Number of sound states that can be waiting for the audio callback,
+// about a second of frames.
+const unsigned long SOUND_QUEUE_SIZE = 64;
+
+// Sound output of one machine.
+//
+// The emulation thread publishes the sound state after every frame and the
+// audio thread renders samples from it. Neither side blocks or locks: when
+// the audio side has stopped draining, new states are dropped, and when no
+// new state arrived the audio side keeps playing the last one.
+//
+// The sound is XO-CHIP's: the 128 bit pattern played one bit per sample at
+// 4000 * 2^((pitch - 64) / 48) Hz while the sound timer runs. The default
+// pattern makes a 500 Hz square wave, the plain CHIP-8 beep.
+class AudioStream {
+    public:
+        explicit AudioStream(unsigned int sample_rate);
+
+        // Emulation thread, once per frame.
+        void publish(const Chip8& chip8);
+
+        // Audio thread. Fills out with count mono samples.
+        void render(int16_t* out, unsigned long count);
+
+        // Time from a state being published until the end of the first
+        // buffer it sounds in, the most recent and the worst one so far.
+        // Any thread.
+        int64_t latency_ns() const;
+        int64_t worst_latency_ns() const;
+        // States dropped because the audio side fell behind. Any thread.
+        unsigned long dropped() const;
+    private:
+        SpscRing<SoundState, SOUND_QUEUE_SIZE> queue;
+        std::atomic<unsigned long> dropped_states;
+
+        // Audio thread state
+        unsigned int rate;
+        SoundState current;
+        double position;
+        double step;
+
+        std::atomic<int64_t> last_latency;
+        std::atomic<int64_t> worst_latency;
+
+        static int64_t now_ns();
+};
+
+#endif
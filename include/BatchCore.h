@@ -0,0 +1,120 @@
+#ifndef BATCH_CORE_H
+#define BATCH_CORE_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Chip8.h"
+
+// Lanes that must share a PC before they run in lockstep instead of on
+// their own.
+const unsigned int LOCKSTEP_MIN_LANES = 2;
+// Instructions a lane runs on its own before the lanes are grouped again.
+const unsigned long SCALAR_CHUNK = 64;
+
+// One program run on Lanes (8, 16 or 32) machines at once, for searches
+// and training loops that replay the same ROM with many seeds and inputs.
+//
+// Each lane is a whole Chip8 that owns its memory, display and everything
+// else, but while a batch runs the registers, I, the stack, the delay timer
+// and the random number generator of every lane live here, one array per
+// register with a byte or word per lane. Lanes at the same PC form a group
+// that runs in lockstep: the instruction is decoded once and executed for
+// the whole group by loops over the lanes that the compiler turns into
+// SSE2 or AVX2 operations. When a branch sends the group different ways,
+// the lanes split, and the ones earliest in the program run first so that
+// they meet the others again where the paths join. A lane with no other
+// lane at its PC runs on its own Chip8 for a while. Sprites are drawn on
+// each lane's own display; memory stores and the other rare instructions
+// run on each lane's Chip8 by itself.
+//
+// Every lane ends a run exactly as a Chip8 running the same instructions
+// alone would, including idle skipping and faults. All lanes share the
+// program's quirks. Tracing and profiling only see the instructions lanes
+// run on their own Chip8.
+//
+// A BatchCore is large, keep it off the stack.
+template <unsigned int Lanes>
+class BatchCore {
+    static_assert(Lanes == 8 || Lanes == 16 || Lanes == 32, "a batch has 8, 16 or 32 lanes");
+
+    public:
+        BatchCore();
+
+        BatchCore(const BatchCore&) = delete;
+        BatchCore& operator=(const BatchCore&) = delete;
+
+        // Resets every lane, lane i with seeds[i].
+        void initialize(const std::array<uint32_t, Lanes>& seeds);
+        void load_program(const unsigned char* program, unsigned long size);
+        void set_quirks(unsigned int quirks);
+
+        // Runs the given number of instructions on every lane that has not
+        // faulted, like Chip8::run() on each of them. Returns the number run
+        // over all lanes.
+        unsigned long run(unsigned long cycles);
+        void tick_timers();
+
+        // A lane between runs, to set its keys or look at its display,
+        // faults and state.
+        Chip8& lane(unsigned int index);
+        const Chip8& lane(unsigned int index) const;
+        // Instructions the lane ran in the last run(), as its own run()
+        // would have returned.
+        unsigned long lane_executed(unsigned int index) const;
+
+        // Lane instructions run in lockstep so far, out of all of them.
+        unsigned long long lockstep_instructions() const;
+        unsigned long long total_instructions() const;
+    private:
+        typedef std::array<unsigned char, Lanes> Bytes;
+        typedef std::array<unsigned short, Lanes> Words;
+        typedef std::array<uint32_t, Lanes> Longs;
+
+        std::array<std::unique_ptr<Chip8>, Lanes> machines;
+        unsigned int quirk_flags;
+
+        // Instructions decoded once for all lanes, while every lane holds
+        // the same bytes there
+        std::vector<MicroOp> decoded;
+
+        // Lane state while running, a lane per element
+        alignas(64) std::array<Bytes, 16> regs;
+        alignas(64) Words I;
+        alignas(64) Words pc;
+        alignas(64) std::array<Words, 16> stack;
+        alignas(64) Bytes sp;
+        alignas(64) Bytes delay_timer;
+        alignas(64) Longs rng_state;
+        // Bit n set while key n is held
+        alignas(64) Words keys;
+        std::array<unsigned long, Lanes> remaining;
+        // See lane_executed()
+        std::array<unsigned long, Lanes> lane_counts;
+
+        // Lanes in the running group: all bits set or clear per lane
+        alignas(64) Bytes byte_mask;
+        alignas(64) Words word_mask;
+        alignas(64) Longs long_mask;
+
+        unsigned long long lockstep_count;
+        unsigned long long total_count;
+
+        void load_lane(unsigned int lane);
+        void store_lane(unsigned int lane);
+        void take_writes(unsigned int lane);
+        void invalidate(unsigned long low, unsigned long high);
+        const MicroOp* fetch(unsigned short addr);
+
+        unsigned long run_alone(unsigned int lane, unsigned long cycles);
+        unsigned long run_lockstep(uint32_t group, unsigned long limit);
+        bool run_each(uint32_t group, unsigned short addr, unsigned long steps, std::array<unsigned long, Lanes>& done);
+        bool branch(uint32_t group, const Bytes& taken, unsigned short& addr, uint32_t& skipping);
+        bool jump(uint32_t group, const Words& targets, unsigned short& addr);
+        unsigned short skip_length(unsigned int lane, unsigned short addr);
+        void set_group(uint32_t group);
+};
+
+#endif
@@ -2,20 +2,137 @@
 #define CHIP8_H
 
 #include <array>
+#include <cstdint>
+#include <ostream>
 #include <string>
 
+#include "Display.h"
+#include "MicroOp.h"
+#include "Profile.h"
+#include "Quirks.h"
+#include "Trace.h"
+
+// Size of the address space, the 64 KB of XO-CHIP. Every address,
+// including the PC and I based accesses, wraps around at the end of memory.
+const unsigned long MEMORY_SIZE = 0x10000;
+const unsigned short ADDRESS_MASK = MEMORY_SIZE - 1;
+
+// Programs are loaded here and may fill the rest of memory.
+const unsigned short PROGRAM_START = 0x200;
+const unsigned long MAX_PROGRAM_SIZE = MEMORY_SIZE - PROGRAM_START;
+
+// Where the 4x5 (FX29) and 8x10 (FX30) fonts are stored.
+const unsigned short FONT_ADDRESS = 0x000;
+const unsigned short BIG_FONT_ADDRESS = 0x050;
+
+// Why a machine stopped executing.
+enum FaultKind : unsigned char {
+    FAULT_NONE,
+    FAULT_INVALID_OPCODE,   // 8XYN or FXNN with an unknown N/NN
+    FAULT_STACK_OVERFLOW,   // 2NNN with all 16 stack entries in use
+    FAULT_STACK_UNDERFLOW,  // 00EE with an empty stack
+    FAULT_EXIT              // 00FD, the program ended itself
+};
+
+// The instruction that caused a fault. It has not been executed, and the
+// PC still points at it.
+struct Fault {
+    FaultKind kind;
+    unsigned short pc;
+    unsigned short opcode;
+};
+
+// A one line description of a fault, such as
+// "Invalid opcode 812F at 0x204".
+std::string describe_fault(const Fault& fault);
+
+struct Snapshot;
+
+// Seed of the CXNN random number generator when none is given.
+const uint32_t DEFAULT_SEED = 0x2545F491;
+
 class Chip8 {
+    // Translated code and batches of lanes work on the machine state
+    // directly
+    friend class Jit;
+    friend class AotRuntime;
+    template <unsigned int Lanes>
+    friend class BatchCore;
+
     public:
-        Chip8() {}
+        Chip8() : quirk_flags(0) {}
 
-        std::array<unsigned char, 64 * 32> gfx;
+        Display gfx;
         std::array<unsigned char, 16> keys;
 
-        void initialize();
+        // Resets the machine. The same seed, program and key input always
+        // produce the same run.
+        void initialize(uint32_t seed = DEFAULT_SEED);
         void load_program(std::string path);
+        void load_program(const unsigned char* program, unsigned long size);
         void emulate_cycle();
+        // Executes the given number of instructions, returns how many ran.
+        // Fewer run only if an instruction faults; the machine then stays
+        // stopped and run() returns 0 until it is initialized again.
+        unsigned long run(unsigned long cycles);
+        bool faulted() const;
+        const Fault& fault() const;
+        // Whether the last run() ended with the program waiting for the
+        // next frame: halted on FX0A with no key held, or in a loop that
+        // cannot exit before the timers tick or the keys change. The
+        // cycles it would have spent waiting are skipped.
+        bool idle() const;
+
+        // QUIRK_* flags the program expects. They are kept across
+        // initialize().
+        void set_quirks(unsigned int quirks);
+        unsigned int quirks() const;
+        // Decrements the delay and sound timers; must be called at 60 Hz.
+        void tick_timers();
+
+        // Sound output: whether the sound timer was running over the last
+        // frame, and the XO-CHIP pattern and pitch to play while it does.
+        bool sound_playing() const;
+        const std::array<unsigned char, 16>& sound_pattern() const;
+        unsigned char sound_pitch() const;
+
+        // Writes the registers, stack and timers in a human readable form.
+        void dump_state(std::ostream& out) const;
+
+        // Current state of the CXNN random number generator, for saving and
+        // restoring it along with the rest of the machine.
+        uint32_t random_state() const;
+        void set_random_state(uint32_t state);
+        // Restarts the generator from a seed, as initialize(seed) does.
+        void seed_random(uint32_t seed);
+
+        // Copies the whole machine state into a snapshot, or back from it,
+        // see Snapshot.h. Only the memory the program has used is copied,
+        // and restoring only decodes again what differs.
+        void save(Snapshot& snapshot) const;
+        void restore(const Snapshot& snapshot);
+
+#if CHIP8_TRACE
+        // Most recently executed instructions
+        TraceBuffer trace;
+#endif
+#if CHIP8_PROFILE
+        // Where interpreted instructions spend their time
+        Profiler profile;
+#endif
     private:
-        std::array<unsigned char, 4096> memory;
+        std::array<unsigned char, MEMORY_SIZE> memory;
+        // Bytes of memory from address 0 that may be non-zero: the fonts,
+        // the program and everything written since
+        unsigned long memory_used;
+        // Decoded instruction starting at each address of memory.
+        // Entries are decoded on first execution and reset to OP_UNDECODED
+        // whenever memory they were decoded from is written.
+        std::array<MicroOp, MEMORY_SIZE> decoded;
+        // Lowest and highest address written since a BatchCore or an
+        // AotRuntime last looked, low > high when nothing was
+        unsigned long written_low;
+        unsigned long written_high;
 
         std::array<unsigned char, 16> regs;
         unsigned short I;
@@ -24,35 +141,67 @@ class Chip8 {
         std::array<unsigned short, 16> stack;
         unsigned short sp;
 
+        // FX75/FX85 storage, the HP48's RPL user flags
+        std::array<unsigned char, 16> rpl_flags;
+
+        // F002/FX3A: the XO-CHIP sound pattern and its pitch
+        std::array<unsigned char, 16> audio_pattern;
+        unsigned char pitch;
+
         unsigned char delay_timer;
         unsigned char sound_timer;
+        // Whether the sound timer ran during the last tick
+        bool sounding;
+
+        // State of the CXNN random number generator, never 0
+        uint32_t rng_state;
+
+        Fault last_fault;
+        // See idle()
+        bool waiting;
+
+        unsigned int quirk_flags;
 
         void setup_graphics();
         void setup_input();
 
+        // run() for one combination of quirks
+        template <unsigned int Quirks>
+        unsigned long run_quirks(unsigned long cycles);
+
+        void decode(unsigned short addr);
+        void invalidate(unsigned short addr);
+        void invalidate_all();
+#if CHIP8_TRACE
+        void record_trace();
+#endif
+
+        // How many of the remaining cycles the instruction at the PC and
+        // those after it would spend waiting, leaving the machine exactly
+        // as it is now. 0 if it is not waiting.
+        unsigned long idle_cycles(unsigned long remaining) const;
+        // Whether run() looks for a wait with idle_cycles() once the 1NNN
+        // at from has jumped to target: it only does for jumps to
+        // themselves and to an FX07.
+        bool waits_after_jump(unsigned short from, unsigned short target) const;
+
+        unsigned char next_random();
+        unsigned long raise_fault(FaultKind kind, unsigned long executed);
+
         void clear_display();
 
         void call_subroutine(unsigned short addr);
         void return_from_subroutine();
 
-        void handle_opcode();
-
-        void handle_opcode_0(unsigned short opcode);
-        void inline handle_opcode_1(unsigned short opcode);
-        void inline handle_opcode_2(unsigned short opcode);
-        void inline handle_opcode_3(unsigned short opcode);
-        void inline handle_opcode_4(unsigned short opcode);
-        void inline handle_opcode_5(unsigned short opcode);
-        void inline handle_opcode_6(unsigned short opcode);
-        void inline handle_opcode_7(unsigned short opcode);
-        void handle_opcode_8(unsigned short opcode);
-        void inline handle_opcode_9(unsigned short opcode);
-        void inline handle_opcode_A(unsigned short opcode);
-        void inline handle_opcode_B(unsigned short opcode);
-        void handle_opcode_C(unsigned short opcode);
-        void handle_opcode_D(unsigned short opcode);
-        void handle_opcode_E(unsigned short opcode);
-        void handle_opcode_F(unsigned short opcode);
+        void skip_next();
+        void draw_sprite(unsigned char X, unsigned char Y, unsigned char N, bool clip);
+        bool wait_for_key(unsigned char X);
+        void store_bcd(unsigned char X);
+        void store_registers(unsigned char X);
+        void load_registers(unsigned char X);
+        void store_register_range(unsigned char X, unsigned char Y);
+        void load_register_range(unsigned char X, unsigned char Y);
+        void load_audio_pattern();
 };
 
 const std::array<unsigned char, 80> chip8_fontset =
@@ -75,4 +224,25 @@ const std::array<unsigned char, 80> chip8_fontset =
   0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+// SUPER-CHIP's 8x10 digits, with XO-CHIP's A-F.
+const std::array<unsigned char, 160> chip8_big_fontset =
+{
+  0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+  0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+  0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+  0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+  0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+  0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+  0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+  0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+  0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+  0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+  0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+  0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
 #endif
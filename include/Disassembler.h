@@ -0,0 +1,10 @@
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+
+#include <string>
+
+// Returns the assembly mnemonic for an opcode, e.g. "LD V1, 0x05".
+// Unknown opcodes are rendered as a data word.
+std::string disassemble(unsigned short opcode);
+
+#endif
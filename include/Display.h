@@ -0,0 +1,138 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <array>
+#include <cstdint>
+
+#include "Framebuffer.h"
+
+// Number of bitplanes. A pixel's color is 0-3, bit n set if the pixel is
+// lit in plane n.
+const unsigned int PLANE_COUNT = 2;
+
+// The screen as SUPER-CHIP and XO-CHIP extend it: 64x32 (lo-res) or
+// 128x64 (hi-res), each with two bitplanes.
+//
+// Drawing, clearing and scrolling only affect the selected planes. With
+// the power-on state, lo-res and only the first plane selected, the display
+// behaves exactly like the plain CHIP-8 one.
+//
+// The lo-res and hi-res planes are kept separately, so lo-res programs
+// never pay for the larger screen. Switching resolution clears the screen.
+class Display {
+    public:
+        typedef Framebuffer<64, 32> LoresPlane;
+        typedef Framebuffer<128, 64> HiresPlane;
+
+        Display() : lores_planes(), hires_planes(), hires_mode(false), selected(1) {}
+
+        // Back to lo-res with only the first plane selected, all dark.
+        void reset();
+
+        bool hires() const {
+            return hires_mode;
+        }
+
+        // 00FE/00FF
+        void set_hires(bool enabled);
+
+        unsigned int width() const {
+            return hires_mode ? HiresPlane::WIDTH : LoresPlane::WIDTH;
+        }
+
+        unsigned int height() const {
+            return hires_mode ? HiresPlane::HEIGHT : LoresPlane::HEIGHT;
+        }
+
+        // FN01: bit n selects plane n.
+        unsigned char selected_planes() const {
+            return selected;
+        }
+
+        void select_planes(unsigned char mask) {
+            selected = mask & ((1 << PLANE_COUNT) - 1);
+        }
+
+        // Clears the selected planes.
+        void clear();
+
+        // XORs 8 pixels onto the given plane of the current resolution, see
+        // Framebuffer::draw_row(). When clipping, x and y must have been
+        // wrapped onto the screen and pixels past the edges are dropped.
+        bool draw_row(unsigned int plane, unsigned int x, unsigned int y, unsigned char bits, bool clip) {
+            if (hires_mode) {
+                return draw_plane_row(hires_planes[plane], x, y, bits, clip);
+            }
+            return draw_plane_row(lores_planes[plane], x, y, bits, clip);
+        }
+
+        // Scroll the selected planes, in pixels of the current resolution.
+        void scroll_down(unsigned int n);
+        void scroll_up(unsigned int n);
+        void scroll_left(unsigned int n);
+        void scroll_right(unsigned int n);
+
+        // Color of a pixel at the current resolution.
+        unsigned int pixel(unsigned int x, unsigned int y) const;
+
+        // The planes themselves, for code that only handles one resolution.
+        LoresPlane& lores_plane(unsigned int plane) {
+            return lores_planes[plane];
+        }
+
+        const LoresPlane& lores_plane(unsigned int plane) const {
+            return lores_planes[plane];
+        }
+
+        const HiresPlane& hires_plane(unsigned int plane) const {
+            return hires_planes[plane];
+        }
+
+        // Rows of the current resolution changed since the last
+        // mark_clean(), over all planes.
+        bool dirty() const;
+        unsigned int first_dirty_row() const;
+        unsigned int last_dirty_row() const;
+        void mark_clean();
+        void mark_all_dirty();
+
+        // Writes one 32-bit color per pixel of the current resolution for
+        // rows first to last, picked from palette by the pixel's color.
+        void expand_rows_to_rgba(uint32_t* out, unsigned int first, unsigned int last,
+                                 const std::array<uint32_t, 4>& palette) const;
+
+        // Writes one byte per pixel, the pixel's color, for a 128x64 image
+        // of the whole screen. Lo-res pixels are doubled both ways, so the
+        // image is the same size at either resolution.
+        void expand_to_hires_colors(unsigned char* out) const;
+
+        // Hash of the visible image, the same on every host. A lo-res image
+        // drawn only on the first plane hashes like its Framebuffer, so
+        // hashes recorded for CHIP-8 programs stay valid.
+        uint64_t hash() const;
+
+        // Whether this is a state the Display can get into, for one read
+        // from a file: the mode is a real bool, only existing planes are
+        // selected and the dirty rows are inside the planes.
+        bool valid() const;
+
+        bool operator==(const Display& other) const;
+    private:
+        std::array<LoresPlane, PLANE_COUNT> lores_planes;
+        std::array<HiresPlane, PLANE_COUNT> hires_planes;
+        bool hires_mode;
+        unsigned char selected;
+
+        template <typename Plane>
+        static bool draw_plane_row(Plane& plane, unsigned int x, unsigned int y, unsigned char bits, bool clip) {
+            if (!clip) {
+                return plane.draw_row(x, y, bits);
+            }
+            if (x >= Plane::WIDTH) {
+                return false;
+            }
+            return plane.draw_row_clipped(x, y, bits);
+        }
+};
+
+#endif
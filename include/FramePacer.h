@@ -0,0 +1,77 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Number of frames the rolling statistics cover, about four seconds.
+const unsigned long FRAME_TIME_WINDOW = 256;
+
+// Durations of the last FRAME_TIME_WINDOW frames.
+class FrameTimes {
+    public:
+        FrameTimes();
+
+        void add(std::chrono::nanoseconds time);
+
+        // The p-th percentile, 0-100, of the window. Zero while empty.
+        std::chrono::nanoseconds percentile(unsigned int p) const;
+        std::chrono::nanoseconds max() const;
+    private:
+        std::array<int64_t, FRAME_TIME_WINDOW> samples;
+        unsigned long count;
+};
+
+// Starts frames at a steady rate on the monotonic clock.
+//
+// wait() sleeps until just before the next frame is due and spins the
+// rest of the way, so frames start within microseconds of their deadline
+// instead of the millisecond or so a sleep alone gives. A frame that
+// overruns starts the next one late; once a whole frame behind, e.g. after
+// being suspended, the schedule restarts from now instead of catching up.
+//
+// Locked to vsync, frames start when the display thread reports a present
+// instead, so the timers follow the display's refresh rate.
+class FramePacer {
+    public:
+        explicit FramePacer(std::chrono::nanoseconds frame_period);
+
+        FramePacer(const FramePacer&) = delete;
+        FramePacer& operator=(const FramePacer&) = delete;
+
+        // Set before the first wait().
+        void lock_to_vsync(bool enabled);
+
+        // Emulation thread, at the end of every frame. Records how long the
+        // frame's work took and blocks until the next one is due.
+        void wait();
+
+        // Display thread, after every present. Only used locked to vsync.
+        void vsync();
+
+        // Emulation thread. Time from the start of one frame to the next,
+        // and time spent on each frame's work.
+        const FrameTimes& frame_times() const;
+        const FrameTimes& emulation_times() const;
+    private:
+        std::chrono::nanoseconds period;
+        bool vsync_locked;
+
+        std::chrono::steady_clock::time_point frame_start;
+        std::chrono::steady_clock::time_point deadline;
+        FrameTimes frames;
+        FrameTimes emulation;
+
+        std::mutex vsync_mutex;
+        std::condition_variable vsync_signal;
+        unsigned long presents;
+        unsigned long presents_seen;
+
+        void wait_for_deadline();
+        void wait_for_vsync();
+};
+
+#endif
@@ -0,0 +1,321 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+// Horizontal scrolling shifts whole rows with SIMD where the target has it.
+// SSE2 is part of x86-64; AVX2 is used when enabled, e.g. -march=native.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// A monochrome display stored one bit per pixel.
+//
+// Each row is Width / 64 words; the most significant bit of a row's first
+// word is its leftmost pixel. 64x32 is the CHIP-8 display and 128x64 the
+// hi-res display, where a row spans two words.
+//
+// The range of rows changed since the last mark_clean() is tracked, so
+// frontends only need to redraw when something actually changed.
+//
+// Scrolling moves whole words: memmove for rows, SIMD shifts for columns,
+// so that a full screen scroll costs a few dozen instructions.
+template <unsigned int Width, unsigned int Height>
+class Framebuffer {
+    static_assert(Width == 64 || Width == 128, "rows must be one or two words wide");
+
+    public:
+        static const unsigned int WIDTH = Width;
+        static const unsigned int HEIGHT = Height;
+        static const unsigned int WORDS_PER_ROW = Width / 64;
+
+        Framebuffer() : words(), first_dirty(0), last_dirty(Height - 1) {}
+
+        void clear() {
+            for (uint64_t word : words) {
+                if (word != 0) {
+                    words.fill(0);
+                    mark_all_dirty();
+                    return;
+                }
+            }
+        }
+
+        bool empty() const {
+            for (uint64_t word : words) {
+                if (word != 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Moves the image n rows down or up. Rows scrolled in are dark.
+        void scroll_down(unsigned int n) {
+            if (n == 0) {
+                return;
+            }
+            n = std::min(n, Height);
+            std::memmove(&words[n * WORDS_PER_ROW], &words[0], (Height - n) * WORDS_PER_ROW * sizeof(uint64_t));
+            std::fill(words.begin(), words.begin() + n * WORDS_PER_ROW, 0);
+            mark_all_dirty();
+        }
+
+        void scroll_up(unsigned int n) {
+            if (n == 0) {
+                return;
+            }
+            n = std::min(n, Height);
+            std::memmove(&words[0], &words[n * WORDS_PER_ROW], (Height - n) * WORDS_PER_ROW * sizeof(uint64_t));
+            std::fill(words.end() - n * WORDS_PER_ROW, words.end(), 0);
+            mark_all_dirty();
+        }
+
+        // Moves the image n columns (less than 64) left or right. Columns
+        // scrolled in are dark.
+        void scroll_left(unsigned int n) {
+            if (n == 0) {
+                return;
+            }
+            shift_rows<true>(n);
+            mark_all_dirty();
+        }
+
+        void scroll_right(unsigned int n) {
+            if (n == 0) {
+                return;
+            }
+            shift_rows<false>(n);
+            mark_all_dirty();
+        }
+
+        bool dirty() const {
+            return first_dirty <= last_dirty;
+        }
+
+        // First and last row changed since the last mark_clean().
+        unsigned int first_dirty_row() const {
+            return first_dirty;
+        }
+
+        unsigned int last_dirty_row() const {
+            return last_dirty;
+        }
+
+        void mark_clean() {
+            first_dirty = Height;
+            last_dirty = 0;
+        }
+
+        void mark_all_dirty() {
+            first_dirty = 0;
+            last_dirty = Height - 1;
+        }
+
+        // Whether the dirty rows are ones mark_clean() and drawing leave,
+        // for a Framebuffer read from a file.
+        bool valid() const {
+            return first_dirty <= Height && last_dirty < Height;
+        }
+
+        bool pixel(unsigned int x, unsigned int y) const {
+            uint64_t word = words[y * WORDS_PER_ROW + x / 64];
+            return (word >> (63 - x % 64)) & 1;
+        }
+
+        // XORs 8 pixels, most significant bit first, onto row y starting at
+        // column x. Coordinates wrap around the edges. Returns true if a lit
+        // pixel was turned off.
+        bool draw_row(unsigned int x, unsigned int y, unsigned char bits) {
+            y %= Height;
+            x %= Width;
+            uint64_t* row = &words[y * WORDS_PER_ROW];
+            if (bits != 0) {
+                mark_dirty(y);
+            }
+
+            if (WORDS_PER_ROW == 1) {
+                // Place the sprite at column 0 and rotate it into place
+                uint64_t sprite = rotate_right(static_cast<uint64_t>(bits) << 56, x);
+                bool collision = (row[0] & sprite) != 0;
+                row[0] ^= sprite;
+                return collision;
+            }
+
+            bool collision = false;
+            for (unsigned int w = 0; w < WORDS_PER_ROW; w++) {
+                int offset = static_cast<int>(x) - static_cast<int>(64 * w);
+                // Pixels that run past the right edge come back on the left
+                uint64_t sprite = word_bits(bits, offset) | word_bits(bits, offset - static_cast<int>(Width));
+                collision = collision || (row[w] & sprite) != 0;
+                row[w] ^= sprite;
+            }
+            return collision;
+        }
+
+        // Same as draw_row(), but pixels past the right or bottom edge are
+        // dropped instead of wrapping. x and y must be on screen.
+        bool draw_row_clipped(unsigned int x, unsigned int y, unsigned char bits) {
+            if (y >= Height) {
+                return false;
+            }
+            if (bits != 0) {
+                mark_dirty(y);
+            }
+
+            uint64_t* row = &words[y * WORDS_PER_ROW];
+            bool collision = false;
+            for (unsigned int w = 0; w < WORDS_PER_ROW; w++) {
+                uint64_t sprite = word_bits(bits, static_cast<int>(x) - static_cast<int>(64 * w));
+                collision = collision || (row[w] & sprite) != 0;
+                row[w] ^= sprite;
+            }
+            return collision;
+        }
+
+        // Writes one byte per pixel, 1 for lit and 0 for dark, row by row.
+        void expand_to_bytes(unsigned char* out) const {
+            for (unsigned int i = 0; i < words.size(); i++) {
+                for (unsigned int bit = 0; bit < 64; bit++) {
+                    *out++ = static_cast<unsigned char>((words[i] >> (63 - bit)) & 1);
+                }
+            }
+        }
+
+        // Writes one 32-bit color per pixel, row by row.
+        void expand_to_rgba(uint32_t* out, uint32_t on, uint32_t off) const {
+            expand_rows_to_rgba(out, 0, Height - 1, on, off);
+        }
+
+        // Same as expand_to_rgba() for rows first to last only.
+        void expand_rows_to_rgba(uint32_t* out, unsigned int first, unsigned int last,
+                                 uint32_t on, uint32_t off) const {
+            for (unsigned int i = first * WORDS_PER_ROW; i < (last + 1) * WORDS_PER_ROW; i++) {
+                for (unsigned int bit = 0; bit < 64; bit++) {
+                    *out++ = (words[i] >> (63 - bit)) & 1 ? on : off;
+                }
+            }
+        }
+
+        const std::array<uint64_t, Height * Width / 64>& rows() const {
+            return words;
+        }
+
+        // 64-bit FNV-1a hash of the pixels, the same on every host.
+        uint64_t hash() const {
+            uint64_t h = 0xCBF29CE484222325;
+            for (uint64_t word : words) {
+                for (unsigned int byte = 0; byte < 8; byte++) {
+                    h ^= (word >> (8 * byte)) & 0xFF;
+                    h *= 0x100000001B3;
+                }
+            }
+            return h;
+        }
+
+        bool operator==(const Framebuffer& other) const {
+            return words == other.words;
+        }
+    private:
+        std::array<uint64_t, Height * Width / 64> words;
+        unsigned int first_dirty;
+        unsigned int last_dirty;
+
+        void mark_dirty(unsigned int y) {
+            if (y < first_dirty) {
+                first_dirty = y;
+            }
+            if (y > last_dirty) {
+                last_dirty = y;
+            }
+        }
+
+        // Shifts every row by n bits, 0 < n < 64. The vector loops handle
+        // as many whole rows as fit in a register, the scalar loop the rest.
+        template <bool Left>
+        void shift_rows(unsigned int n) {
+            const unsigned int count = Height * WORDS_PER_ROW;
+            uint64_t* data = words.data();
+            unsigned int i = 0;
+
+#if defined(__SSE2__)
+            const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(n));
+            const __m128i carry_shift = _mm_cvtsi32_si128(static_cast<int>(64 - n));
+#endif
+#if defined(__AVX2__)
+            // Four words: four 64 pixel rows or two 128 pixel rows
+            for (; i + 4 <= count; i += 4) {
+                __m256i* p = reinterpret_cast<__m256i*>(data + i);
+                __m256i v = _mm256_loadu_si256(p);
+                __m256i shifted;
+                if (Left) {
+                    shifted = _mm256_sll_epi64(v, shift);
+                    if (WORDS_PER_ROW == 2) {
+                        // Bits leaving a row's right word enter its left word
+                        shifted = _mm256_or_si256(shifted, _mm256_srli_si256(_mm256_srl_epi64(v, carry_shift), 8));
+                    }
+                } else {
+                    shifted = _mm256_srl_epi64(v, shift);
+                    if (WORDS_PER_ROW == 2) {
+                        shifted = _mm256_or_si256(shifted, _mm256_slli_si256(_mm256_sll_epi64(v, carry_shift), 8));
+                    }
+                }
+                _mm256_storeu_si256(p, shifted);
+            }
+#endif
+#if defined(__SSE2__)
+            for (; i + 2 <= count; i += 2) {
+                __m128i* p = reinterpret_cast<__m128i*>(data + i);
+                __m128i v = _mm_loadu_si128(p);
+                __m128i shifted;
+                if (Left) {
+                    shifted = _mm_sll_epi64(v, shift);
+                    if (WORDS_PER_ROW == 2) {
+                        shifted = _mm_or_si128(shifted, _mm_srli_si128(_mm_srl_epi64(v, carry_shift), 8));
+                    }
+                } else {
+                    shifted = _mm_srl_epi64(v, shift);
+                    if (WORDS_PER_ROW == 2) {
+                        shifted = _mm_or_si128(shifted, _mm_slli_si128(_mm_sll_epi64(v, carry_shift), 8));
+                    }
+                }
+                _mm_storeu_si128(p, shifted);
+            }
+#endif
+            for (; i < count; i += WORDS_PER_ROW) {
+                uint64_t* row = data + i;
+                if (WORDS_PER_ROW == 1) {
+                    row[0] = Left ? row[0] << n : row[0] >> n;
+                } else if (Left) {
+                    row[0] = (row[0] << n) | (row[WORDS_PER_ROW - 1] >> (64 - n));
+                    row[WORDS_PER_ROW - 1] <<= n;
+                } else {
+                    row[WORDS_PER_ROW - 1] = (row[WORDS_PER_ROW - 1] >> n) | (row[0] << (64 - n));
+                    row[0] >>= n;
+                }
+            }
+        }
+
+        static uint64_t rotate_right(uint64_t value, unsigned int amount) {
+            return (value >> amount) | (value << ((64 - amount) & 63));
+        }
+
+        // The part of an 8 pixel sprite row starting offset columns into a
+        // word that lands inside that word. offset may be negative.
+        static uint64_t word_bits(unsigned char bits, int offset) {
+            if (offset <= -8 || offset >= 64) {
+                return 0;
+            }
+            if (offset <= 56) {
+                return static_cast<uint64_t>(bits) << (56 - offset);
+            }
+            return static_cast<uint64_t>(bits) >> (offset - 56);
+        }
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef INPUT_MOVIE_H
+#define INPUT_MOVIE_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One change of the key state: from `frame` on, the keys whose bits are set
+// in `keys` are held down (bit n is key n).
+struct MovieEvent {
+    uint32_t frame;
+    uint16_t keys;
+    uint16_t reserved;
+};
+
+// Header of a movie file, followed by `count` MovieEvent records in frame
+// order. All fields are stored in host byte order.
+struct MovieFileHeader {
+    std::array<char, 4> magic;
+    uint16_t version;
+    uint16_t event_size;
+    // Settings the session was recorded with
+    uint32_t seed;
+    uint32_t instructions_per_frame;
+    uint32_t quirks;
+    uint32_t count;
+    // Length of the session and the display hash after its last frame
+    uint32_t frames;
+    uint32_t reserved;
+    uint64_t final_hash;
+};
+
+const std::array<char, 4> MOVIE_MAGIC = {{'C', '8', 'M', 'V'}};
+const uint16_t MOVIE_VERSION = 2;
+
+// A recorded play session: the key state of every frame, stored as the
+// frames where it changed.
+//
+// Replaying a movie with the same program, seed, instructions per frame and
+// quirks reproduces the session exactly, so the display hash at the end
+// must match the recorded one.
+class InputMovie {
+    public:
+        InputMovie() : header(), last_keys(0), next(0) {}
+
+        // Starts a new recording.
+        void start(uint32_t seed, unsigned long instructions_per_frame, unsigned int quirks);
+        // Records the key state at the start of a frame. Frames must be
+        // recorded in order.
+        void record(unsigned long frame, const std::array<unsigned char, 16>& keys);
+        // Ends the recording after the given number of frames.
+        void finish(unsigned long frames, uint64_t final_hash);
+
+        void write(std::string path) const;
+        void load(std::string path);
+
+        // Sets keys to the recorded state for the given frame.
+        void apply(unsigned long frame, std::array<unsigned char, 16>& keys);
+
+        uint32_t seed() const;
+        unsigned long instructions_per_frame() const;
+        unsigned int quirks() const;
+        unsigned long frames() const;
+        uint64_t final_hash() const;
+    private:
+        MovieFileHeader header;
+        std::vector<MovieEvent> events;
+
+        uint16_t last_keys;
+        unsigned long next;
+};
+
+#endif
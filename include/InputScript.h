@@ -0,0 +1,32 @@
+#ifndef INPUT_SCRIPT_H
+#define INPUT_SCRIPT_H
+
+#include <array>
+#include <string>
+#include <vector>
+
+// A scripted sequence of key presses and releases, keyed by frame number.
+//
+// Scripts are plain text with one event per line:
+//     <frame> <key> <down|up>
+// where key is a hex digit 0-F. Blank lines and lines starting with '#'
+// are ignored. Events are applied at the start of their frame.
+class InputScript {
+    public:
+        InputScript() : next(0) {}
+
+        void load(std::string path);
+        // Applies every event scheduled for the given frame to keys.
+        void apply(unsigned long frame, std::array<unsigned char, 16>& keys);
+    private:
+        struct Event {
+            unsigned long frame;
+            unsigned char key;
+            unsigned char pressed;
+        };
+
+        std::vector<Event> events;
+        unsigned long next;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <array>
+#include <bitset>
+#include <memory>
+#include <vector>
+
+#include "Chip8.h"
+
+// The JIT is only built for x86-64 hosts that can map executable memory.
+#if defined(__x86_64__) && defined(__unix__)
+#define CHIP8_JIT 1
+#else
+#define CHIP8_JIT 0
+#endif
+
+// Granularity at which the JIT tracks the memory it translated, in bytes.
+const unsigned long CODE_PAGE_SIZE = 16;
+
+// Translates basic blocks of a Chip8 program into native x86-64 code.
+//
+// A block is a run of instructions that ends at a jump or a skip, which the
+// native code resolves itself, or just before a call, return, key check or
+// any other instruction that may not go on to the next one, which is then
+// run by the interpreter. Register, timer and memory operations are
+// translated, and the V registers and I live in host registers between
+// them; display, random number and XO-CHIP instructions are run by the
+// interpreter from within the block. A block goes on directly into the
+// block it exits to, while there are cycles left for all of it.
+//
+// Blocks are dropped when FX33/FX55/5XY2 write into the memory they were
+// translated from, and all of them when the machine's quirks change. Call
+// flush() after reloading the program.
+class Jit {
+    public:
+        explicit Jit(Chip8& machine);
+        ~Jit();
+
+        Jit(const Jit&) = delete;
+        Jit& operator=(const Jit&) = delete;
+
+        static bool available();
+
+        // Same contract as Chip8::run().
+        unsigned long run(unsigned long cycles);
+        void flush();
+        // Chip8::restore(), also dropping the blocks translated from memory
+        // the snapshot changes.
+        void restore(const Snapshot& snapshot);
+
+        // Checks every translated block against the interpreter in lockstep
+        // and throws on the first difference.
+        void enable_check();
+    private:
+        struct Block {
+            // Native code taking the Chip8 and the cycles it may run. It
+            // returns the next PC in bits 0-15, one past the address of the
+            // 1NNN that led there (or 0) in bits 16-31 and the cycles left
+            // in the upper half.
+            unsigned long (*code)(Chip8*, unsigned long);
+            // First address after the memory the block was translated from,
+            // up to MEMORY_SIZE + 2.
+            unsigned int end;
+            // Number of instructions the block executes when run to its end.
+            unsigned short count;
+            // Set once translation was attempted and failed.
+            bool untranslatable;
+        };
+
+        Chip8& chip8;
+        std::array<Block, MEMORY_SIZE> blocks;
+        // Where the native code goes on at each address: the block there,
+        // or the start of code_buffer, which returns to run()
+        std::array<unsigned char*, MEMORY_SIZE> links;
+        // Pages that blocks were translated from since the last flush()
+        std::bitset<MEMORY_SIZE / CODE_PAGE_SIZE> code_pages;
+
+        unsigned char* code_buffer;
+        unsigned long code_size;
+        // Quirks the current blocks were translated with
+        unsigned int translated_quirks;
+
+        std::unique_ptr<Chip8> reference;
+
+        Block& translate(unsigned short addr);
+        void mark_code(unsigned long start, unsigned long end);
+        // Drops the blocks translated from [start, end). Returns whether it
+        // is on a code page at all.
+        bool invalidate(unsigned long start, unsigned long end);
+        // invalidate() for a write, which may wrap around the end of memory
+        bool written(unsigned long start, unsigned long length);
+        // Bytes FX33/FX55/5XY2 write at I, 0 for other opcodes
+        static unsigned long written_by(unsigned short opcode);
+        // Runs an FX33, FX55 or 5XY2 for the native code. Returns non-zero
+        // if it wrote on a code page.
+        static unsigned int write(Jit* jit, unsigned int opcode);
+        // Runs the instruction at addr with the interpreter, for the native
+        // code
+        static unsigned int step(Jit* jit, unsigned int addr);
+        static bool same_state(const Chip8& a, const Chip8& b);
+};
+
+#endif
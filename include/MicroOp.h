@@ -0,0 +1,80 @@
+#ifndef MICRO_OP_H
+#define MICRO_OP_H
+
+// Operations an instruction is decoded into. Each opcode family of the
+// form 8XYN, EXNN and FXNN gets one kind per N/NN so that executing a
+// decoded instruction never needs a second switch.
+//
+// The SUPER-CHIP and XO-CHIP instructions are always decoded; none of them
+// means anything else to a CHIP-8 program.
+enum OpKind : unsigned char {
+    OP_UNDECODED,
+    OP_SYS,         // 0NNN, ignored
+    OP_CLS,         // 00E0
+    OP_RET,         // 00EE
+    OP_JP,          // 1NNN
+    OP_CALL,        // 2NNN
+    OP_SE_VX_NN,    // 3XNN
+    OP_SNE_VX_NN,   // 4XNN
+    OP_SE_VX_VY,    // 5XY0
+    OP_LD_VX_NN,    // 6XNN
+    OP_ADD_VX_NN,   // 7XNN
+    OP_LD_VX_VY,    // 8XY0
+    OP_OR,          // 8XY1
+    OP_AND,         // 8XY2
+    OP_XOR,         // 8XY3
+    OP_ADD_VX_VY,   // 8XY4
+    OP_SUB,         // 8XY5
+    OP_SHR,         // 8XY6
+    OP_SUBN,        // 8XY7
+    OP_SHL,         // 8XYE
+    OP_SNE_VX_VY,   // 9XY0
+    OP_LD_I,        // ANNN
+    OP_JP_V0,       // BNNN
+    OP_RND,         // CXNN
+    OP_DRW,         // DXYN
+    OP_SKP,         // EX9E
+    OP_SKNP,        // EXA1
+    OP_LD_VX_DT,    // FX07
+    OP_LD_VX_K,     // FX0A
+    OP_LD_DT_VX,    // FX15
+    OP_LD_ST_VX,    // FX18
+    OP_ADD_I_VX,    // FX1E
+    OP_LD_F_VX,     // FX29
+    OP_LD_B_VX,     // FX33
+    OP_LD_MEM_VX,   // FX55
+    OP_LD_VX_MEM,   // FX65
+    // SUPER-CHIP
+    OP_SCD,         // 00CN
+    OP_SCR,         // 00FB
+    OP_SCL,         // 00FC
+    OP_EXIT,        // 00FD
+    OP_LOW,         // 00FE
+    OP_HIGH,        // 00FF
+    OP_LD_HF_VX,    // FX30
+    OP_LD_R_VX,     // FX75
+    OP_LD_VX_R,     // FX85
+    // XO-CHIP
+    OP_SCU,         // 00DN
+    OP_SAVE_VX_VY,  // 5XY2
+    OP_LOAD_VX_VY,  // 5XY3
+    OP_LD_I_LONG,   // F000 NNNN, nnn holds NNNN
+    OP_PLANE,       // FN01
+    OP_AUDIO,       // F002
+    OP_PITCH,       // FX3A
+    OP_INVALID_8,   // 8XYN with an unknown N
+    OP_INVALID_F,   // FXNN with an unknown NN
+    OP_COUNT
+};
+
+// An instruction decoded once with all of its operands extracted.
+struct MicroOp {
+    OpKind kind;
+    unsigned char x;
+    unsigned char y;
+    unsigned char n;
+    unsigned char nn;
+    unsigned short nnn;
+};
+
+#endif
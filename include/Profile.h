@@ -0,0 +1,124 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "MicroOp.h"
+
+// Compile-time profiler switch, set with `make PROFILE=1`:
+//   0 - profiling is compiled out entirely (default)
+//   1 - count executions and host time per instruction kind, per address
+//       and per call path
+#ifndef CHIP8_PROFILE
+#define CHIP8_PROFILE 0
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Execution profile of the interpreter.
+//
+// Host time is measured between the starts of consecutive instructions, so
+// an instruction's time includes its share of the dispatch overhead. Time
+// spent outside run() (between frames) is not counted.
+//
+// Calls and returns are followed to build a call tree rooted at "main", the
+// code outside any subroutine.
+class Profiler {
+    public:
+        Profiler() { clear(); }
+
+        void clear();
+
+        // Called at the start of every instruction with its address and the
+        // kind of the instruction before it, which has finished by now.
+        void instruction(unsigned short pc, OpKind previous_kind) {
+            uint64_t now = ticks();
+            if (running) {
+                uint64_t elapsed = now - started;
+                kind_counts[previous_kind]++;
+                kind_ticks[previous_kind] += elapsed;
+                pc_ticks[current_pc] += elapsed;
+                nodes[current_node].instructions++;
+                nodes[current_node].ticks += elapsed;
+            } else {
+                resumed_ticks = now;
+                resumed_time = std::chrono::steady_clock::now();
+            }
+            pc_counts[pc]++;
+            current_pc = pc;
+            current_node = node;
+            started = now;
+            running = true;
+        }
+
+        // Stops timing when run() returns.
+        void pause(OpKind previous_kind);
+
+        unsigned short last_pc() const {
+            return current_pc;
+        }
+
+        void call(unsigned short addr);
+        void ret();
+
+        // Writes the report to path and the folded stacks to path.folded.
+        void write(std::string path) const;
+
+        // Writes a human readable summary.
+        void write_report(std::ostream& out) const;
+        // Writes one "main;sub_2A0;sub_310 <instructions>" line per call
+        // path, the folded stack format that flamegraph.pl and similar
+        // tools read.
+        void write_folded(std::ostream& out) const;
+    private:
+        struct CallNode {
+            unsigned short addr;
+            unsigned int parent;
+            std::vector<unsigned int> children;
+            // Executed in this subroutine itself, not in its callees
+            uint64_t instructions;
+            uint64_t ticks;
+        };
+
+        std::array<uint64_t, OP_COUNT> kind_counts;
+        std::array<uint64_t, OP_COUNT> kind_ticks;
+        // One entry per address of the 64 KB address space
+        std::array<uint64_t, 1 << 16> pc_counts;
+        std::array<uint64_t, 1 << 16> pc_ticks;
+
+        std::vector<CallNode> nodes;
+        // Node of the subroutine currently executing
+        unsigned int node;
+
+        // The instruction being timed
+        bool running;
+        unsigned short current_pc;
+        unsigned int current_node;
+        uint64_t started;
+
+        // Time ticks were counted over, to convert them to nanoseconds
+        uint64_t total_ticks;
+        std::chrono::steady_clock::duration total_time;
+        uint64_t resumed_ticks;
+        std::chrono::steady_clock::time_point resumed_time;
+
+        static uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+        }
+
+        double nanoseconds(uint64_t count) const;
+        std::string path(unsigned int index) const;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef QUIRKS_H
+#define QUIRKS_H
+
+#include <string>
+
+// Behaviours that differ between CHIP-8 implementations. Programs written
+// for one often misbehave on another, so each can be switched on per
+// program. With none set the machine behaves as it always has.
+//
+// The interpreter is compiled once per combination, so checking a quirk
+// costs nothing at run time.
+
+// 8XY6/8XYE shift VY and store the result in VX, instead of shifting VX.
+const unsigned int QUIRK_SHIFT_VY = 1 << 0;
+// FX55/FX65 leave I pointing after the last register stored or loaded.
+const unsigned int QUIRK_LOAD_STORE_INCREMENT = 1 << 1;
+// BNNN jumps to NNN plus VX, where X is the top digit of NNN, not V0.
+const unsigned int QUIRK_JUMP_VX = 1 << 2;
+// Sprites are cut off at the right and bottom edges instead of wrapping.
+// The starting position still wraps.
+const unsigned int QUIRK_CLIP_SPRITES = 1 << 3;
+
+// Number of distinct combinations.
+const unsigned int QUIRK_COMBINATIONS = 1 << 4;
+
+// The original COSMAC VIP interpreter.
+const unsigned int QUIRKS_COSMAC = QUIRK_SHIFT_VY | QUIRK_LOAD_STORE_INCREMENT | QUIRK_CLIP_SPRITES;
+// SUPER-CHIP 1.1 on the HP48.
+const unsigned int QUIRKS_SCHIP = QUIRK_JUMP_VX | QUIRK_CLIP_SPRITES;
+// XO-CHIP.
+const unsigned int QUIRKS_XOCHIP = QUIRK_SHIFT_VY | QUIRK_LOAD_STORE_INCREMENT;
+
+// Parses a comma separated list of presets (default, cosmac, schip, xochip)
+// and single quirks (shift-vy, load-store-increment, jump-vx, clip). Throws
+// on unknown names.
+unsigned int parse_quirks(const std::string& spec);
+
+#endif
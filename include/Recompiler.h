@@ -0,0 +1,71 @@
+#ifndef RECOMPILER_H
+#define RECOMPILER_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Translates a Chip8 program ahead of time into a C++ translation unit,
+// for chip8-aot. Built with AotRuntime.cpp, the unit runs the program at
+// native speed; see include/AotRuntime.h.
+//
+// The code is found by following the program from PROGRAM_START: on past
+// each instruction, to the targets of 1NNN and 2NNN and the return
+// address of each call, and both ways out of every skip. Code only
+// reached through BNNN, which jumps to a computed address, is not found
+// and is left to the interpreter, as is code the program writes itself.
+//
+// A block is a run of register, timer, sprite and key instructions that
+// ends at a jump, call, return or skip, just after FX33/FX55 in case they
+// write over the code that follows, or just before an instruction that is
+// not translated (BNNN, FX0A, the SUPER-CHIP and XO-CHIP extensions),
+// which the interpreter then runs. All blocks are written into one
+// function, where each can be entered at any of its instructions and goes
+// straight on to the blocks it leads to, as long as they are still valid
+// and the budget of instructions covers them.
+struct RecoveredBlock {
+    unsigned short start;
+    // First address after the memory the block was translated from
+    unsigned int end;
+    unsigned short count;
+};
+
+class Recompiler {
+    public:
+        // Recovers the blocks of program for the given quirks. Throws if
+        // the program is empty or too large.
+        Recompiler(const std::vector<unsigned char>& program, unsigned int quirks);
+
+        const std::vector<RecoveredBlock>& blocks() const;
+        // Instructions found, and how many of them are in blocks
+        unsigned long reachable_instructions() const;
+        unsigned long translated_instructions() const;
+
+        // Writes the translation unit, defining aot_program for the program
+        // called name.
+        void write(std::ostream& out, const std::string& name) const;
+    private:
+        std::vector<unsigned char> rom;
+        unsigned int quirk_flags;
+        std::vector<RecoveredBlock> recovered;
+        unsigned long reachable_count;
+
+        // Instructions from each translated address to the end of its
+        // block, 0 elsewhere
+        std::vector<unsigned short> counts;
+
+        bool contains(unsigned long addr, unsigned long length) const;
+        unsigned short opcode_at(unsigned long addr) const;
+        unsigned short skip_length(unsigned long addr) const;
+        bool translatable(unsigned long addr) const;
+        static bool ends_block(unsigned short opcode);
+
+        void recover();
+        void write_run(std::ostream& out) const;
+        std::string link(unsigned long target) const;
+        std::string jump(unsigned long from, unsigned long target) const;
+        std::string enter(unsigned long target, const std::string& leave) const;
+        std::string translate(unsigned long addr, const RecoveredBlock& block, unsigned int index) const;
+};
+
+#endif
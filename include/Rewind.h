@@ -0,0 +1,74 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "Chip8.h"
+#include "Snapshot.h"
+
+// Frames between keyframes, one second.
+const unsigned int REWIND_KEYFRAME_INTERVAL = 60;
+
+// History of machine states for stepping back in time, frame by frame,
+// within a fixed memory budget.
+//
+// Every REWIND_KEYFRAME_INTERVAL frames the whole Snapshot is stored as a
+// keyframe; each frame in between stores only its XOR against that
+// keyframe. Both are run-length encoded, so the unchanged bytes, which are
+// almost all of them, cost next to nothing. Any frame is its keyframe plus
+// one delta, so stepping back costs the same however long the history is.
+//
+// Entries live in one ring of budget bytes. When it is full the oldest
+// second of history is dropped, keyframe and deltas together.
+class Rewind {
+    public:
+        explicit Rewind(unsigned long budget_bytes);
+
+        Rewind(const Rewind&) = delete;
+        Rewind& operator=(const Rewind&) = delete;
+
+        // Records the state at the end of a frame.
+        void push(const Chip8& chip8);
+
+        // Drops the newest frame and writes the one before it to state, for
+        // Chip8::restore() or Jit::restore(). Returns false, leaving state
+        // alone, when there is no earlier frame.
+        bool step_back(Snapshot& state);
+
+        void clear();
+
+        // Frames that can be stepped back.
+        unsigned long frames() const;
+        unsigned long bytes_used() const;
+    private:
+        struct Entry {
+            // Where the encoded bytes are in the ring
+            unsigned long offset;
+            unsigned long size;
+            // Position of the frame's keyframe
+            unsigned long keyframe_offset;
+            unsigned long keyframe_size;
+            // Frames since the keyframe, 0 for the keyframe itself
+            unsigned int position;
+        };
+
+        std::vector<unsigned char> ring;
+        std::deque<Entry> entries;
+        unsigned long used;
+        unsigned int since_keyframe;
+
+        // The newest entry's keyframe, decoded
+        std::unique_ptr<Snapshot> base;
+        std::unique_ptr<Snapshot> current;
+        std::vector<unsigned char> encoded;
+
+        void push_keyframe();
+        bool store(unsigned int position);
+        bool allocate(unsigned long size, unsigned long& offset) const;
+        void drop_oldest_second();
+        void apply(unsigned long offset, unsigned long size, Snapshot& target) const;
+};
+
+#endif
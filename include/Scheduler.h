@@ -0,0 +1,60 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <chrono>
+
+#include "Chip8.h"
+#include "Jit.h"
+
+// Length of one frame of the 60 Hz timer clock.
+const std::chrono::nanoseconds FRAME_DURATION(16666667);
+// When running unbounded, how much of each frame may be spent emulating.
+// The rest is left for drawing and input handling.
+const std::chrono::nanoseconds UNBOUNDED_FRAME_BUDGET(12000000);
+
+// Runs a Chip8 one 60 Hz frame at a time.
+// Each frame executes a configurable number of instructions and then ticks
+// the delay and sound timers exactly once, so the timers stay at 60 Hz no
+// matter how fast the CPU is clocked.
+class Scheduler {
+    public:
+        // An instructions_per_frame of 0 runs unbounded: instructions are
+        // executed until UNBOUNDED_FRAME_BUDGET has been used up or the
+        // program waits for the next frame.
+        Scheduler(Chip8& machine, unsigned long instructions_per_frame);
+
+        // Runs instructions on the JIT instead of the interpreter.
+        void use_jit(Jit* translator);
+
+        void run_frame();
+        // Runs a frame like run_frame() without counting it, for run-ahead
+        // frames that are rolled back afterwards.
+        void run_frame_ahead();
+        // Runs instructions without advancing the frame or the timers.
+        unsigned long run_cycles(unsigned long cycles);
+
+        unsigned long instructions_per_frame() const;
+        unsigned long long total_instructions() const;
+        unsigned long long total_frames() const;
+
+        // Instructions per second actually achieved over the last complete
+        // measurement window (about one second of wall time).
+        double instructions_per_second() const;
+    private:
+        Chip8& chip8;
+        Jit* jit;
+        unsigned long ipf;
+
+        unsigned long long instructions;
+        unsigned long long frames;
+
+        std::chrono::steady_clock::time_point window_start;
+        unsigned long long window_instructions;
+        double measured_ips;
+
+        unsigned long run_instructions();
+        unsigned long run_unbounded();
+        void update_measurement(unsigned long executed);
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Chip8.h"
+
+const std::array<char, 4> SNAPSHOT_MAGIC = {{'C', '8', 'S', 'T'}};
+// Bumped whenever the layout of Snapshot changes.
+const uint16_t SNAPSHOT_VERSION = 1;
+
+// The whole state of a Chip8 in one flat block: registers, timers, stack,
+// display, keys, quirks, random number generator and memory. Instructions
+// decoded or translated from memory are not part of it; they are rebuilt
+// as needed.
+//
+// The small, frequently changing state comes first and memory last, at the
+// start of its own cache line. Only the part of memory the machine has used
+// is copied by Chip8::save() and Chip8::restore(); the rest of the
+// snapshot's memory is kept zero, so a snapshot is always a complete image.
+//
+// Snapshots are trivially copyable and written to disk as they are, in
+// host byte order. A new Snapshot's memory is all zero; it is over 64 KB,
+// so keep it off the stack.
+struct alignas(64) Snapshot {
+    // File identification
+    std::array<char, 4> magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t size;
+
+    // Bytes of memory from address 0 that may be non-zero
+    uint32_t memory_used = 0;
+
+    std::array<unsigned char, 16> regs;
+    std::array<unsigned short, 16> stack;
+    unsigned short I;
+    unsigned short pc;
+    unsigned short sp;
+    unsigned char delay_timer;
+    unsigned char sound_timer;
+    bool sounding;
+    unsigned char pitch;
+    uint32_t rng_state;
+    uint32_t quirks;
+    Fault fault;
+    std::array<unsigned char, 16> keys;
+    std::array<unsigned char, 16> rpl_flags;
+    std::array<unsigned char, 16> audio_pattern;
+
+    Display gfx;
+
+    alignas(64) std::array<unsigned char, MEMORY_SIZE> memory = {};
+};
+
+static_assert(std::is_trivially_copyable<Snapshot>::value, "snapshots are copied and stored as raw bytes");
+static_assert(std::is_standard_layout<Snapshot>::value, "snapshots are copied and stored as raw bytes");
+
+// Writes a snapshot to a file. Throws std::runtime_error on failure.
+void write_snapshot(const Snapshot& snapshot, std::string path);
+
+// A snapshot file mapped read-only into memory, so loading it costs no more
+// than restoring from memory. Throws std::runtime_error if the file cannot
+// be opened, was not written by this version of the emulator or holds a
+// state no machine can be in.
+class SnapshotFile {
+    public:
+        explicit SnapshotFile(std::string path);
+        ~SnapshotFile();
+
+        SnapshotFile(const SnapshotFile&) = delete;
+        SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+        const Snapshot& snapshot() const;
+    private:
+        const Snapshot* mapped;
+        // Used instead of a mapping where the host has no mmap()
+        std::vector<Snapshot> copy;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <array>
+#include <atomic>
+
+// A bounded queue between exactly one producer thread and one consumer
+// thread. Neither side ever blocks or takes a lock: push() fails when the
+// ring is full and pop() when it is empty.
+//
+// Each side keeps a cached copy of the other side's index and only reloads
+// it when the ring looks full or empty, and the two sides' indexes live on
+// separate cache lines, so the threads rarely touch each other's lines.
+template <typename T, unsigned long Capacity>
+class SpscRing {
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+    public:
+        SpscRing() : head(0), tail_cache(0), tail(0), head_cache(0), slots() {}
+
+        SpscRing(const SpscRing&) = delete;
+        SpscRing& operator=(const SpscRing&) = delete;
+
+        // Producer only. Returns false, dropping the value, if full.
+        bool push(const T& value) {
+            unsigned long t = tail.load(std::memory_order_relaxed);
+            if (t - head_cache == Capacity) {
+                head_cache = head.load(std::memory_order_acquire);
+                if (t - head_cache == Capacity) {
+                    return false;
+                }
+            }
+
+            slots[t & (Capacity - 1)] = value;
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer only. Returns false, leaving value alone, if empty.
+        bool pop(T& value) {
+            unsigned long h = head.load(std::memory_order_relaxed);
+            if (h == tail_cache) {
+                tail_cache = tail.load(std::memory_order_acquire);
+                if (h == tail_cache) {
+                    return false;
+                }
+            }
+
+            value = slots[h & (Capacity - 1)];
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+    private:
+        // Consumer side
+        alignas(64) std::atomic<unsigned long> head;
+        unsigned long tail_cache;
+
+        // Producer side
+        alignas(64) std::atomic<unsigned long> tail;
+        unsigned long head_cache;
+
+        alignas(64) std::array<T, Capacity> slots;
+};
+
+#endif
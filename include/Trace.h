@@ -0,0 +1,67 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Compile-time trace level, set with `make TRACE=n`:
+//   0 - tracing is compiled out entirely (default)
+//   1 - record the PC and opcode of every instruction
+//   2 - also record I, SP and the registers before each instruction
+#ifndef CHIP8_TRACE
+#define CHIP8_TRACE 0
+#endif
+
+// Number of entries kept; older entries are overwritten.
+const unsigned long TRACE_CAPACITY = 1 << 14;
+
+struct TraceEntry {
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t I;
+    uint8_t sp;
+    uint8_t level;
+    std::array<uint8_t, 16> regs;
+};
+
+// Header of a trace file, followed by `count` TraceEntry records from
+// oldest to newest. All fields are stored in host byte order.
+struct TraceFileHeader {
+    std::array<char, 4> magic;
+    uint16_t version;
+    uint16_t entry_size;
+    uint32_t count;
+};
+
+const std::array<char, 4> TRACE_MAGIC = {{'C', '8', 'T', 'R'}};
+const uint16_t TRACE_VERSION = 1;
+
+// Binary in-memory ring buffer of executed instructions.
+class TraceBuffer {
+    public:
+        TraceBuffer() : entries(), head(0), size(0) {}
+
+        TraceEntry& next() {
+            TraceEntry& entry = entries[head];
+            head = (head + 1) % TRACE_CAPACITY;
+            if (size < TRACE_CAPACITY) {
+                size++;
+            }
+            return entry;
+        }
+
+        void clear() {
+            head = 0;
+            size = 0;
+        }
+
+        // Writes the buffered entries, oldest first, to a trace file.
+        void write(std::string path) const;
+    private:
+        std::array<TraceEntry, TRACE_CAPACITY> entries;
+        unsigned long head;
+        unsigned long size;
+};
+
+#endif
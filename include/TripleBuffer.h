@@ -0,0 +1,65 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <array>
+#include <atomic>
+
+// Hands the latest value from one producer thread to one consumer thread.
+//
+// The producer fills its back slot and publishes it, the consumer picks up
+// the newest published slot as its front. The third slot sits between them,
+// so neither side ever waits for the other or takes a lock: the producer can
+// publish as often as it likes and the consumer only sees the latest value,
+// skipping any it was too slow for.
+template <typename T>
+class TripleBuffer {
+    public:
+        TripleBuffer() : slots(), middle(1), back(0), front(2) {}
+
+        TripleBuffer(const TripleBuffer&) = delete;
+        TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+        // Producer only. The slot to fill before publish().
+        T& write_slot() {
+            return slots[back].value;
+        }
+
+        // Producer only. Makes the back slot the newest value and continues
+        // in the slot that was in the middle.
+        void publish() {
+            back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+        }
+
+        // Consumer only. Moves the newest value to the front slot and
+        // returns true if one was published since the last call.
+        bool update() {
+            if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+                return false;
+            }
+            front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+            return true;
+        }
+
+        // Consumer only.
+        const T& read_slot() const {
+            return slots[front].value;
+        }
+    private:
+        // The middle slot holds a value the consumer has not seen yet
+        static const unsigned int FRESH = 4;
+        static const unsigned int INDEX = 3;
+
+        // Slots on separate cache lines, the threads write two of them
+        struct alignas(64) Slot {
+            T value;
+        };
+
+        std::array<Slot, 3> slots;
+        // Index of the middle slot, plus FRESH
+        alignas(64) std::atomic<unsigned int> middle;
+        // Owned by the producer and the consumer
+        alignas(64) unsigned int back;
+        alignas(64) unsigned int front;
+};
+
+#endif
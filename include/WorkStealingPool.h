@@ -0,0 +1,55 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads, each with its own task queue.
+//
+// Submitted tasks are spread over the queues round-robin. A worker takes
+// tasks from the back of its own queue and, once that is empty, steals from
+// the front of the other workers' queues, so long and short tasks balance
+// out without a single shared queue.
+class WorkStealingPool {
+    public:
+        // 0 threads means one per hardware thread.
+        explicit WorkStealingPool(unsigned int threads);
+        ~WorkStealingPool();
+
+        WorkStealingPool(const WorkStealingPool&) = delete;
+        WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+        void submit(std::function<void()> task);
+        // Blocks until every submitted task has finished.
+        void wait();
+
+        unsigned int size() const;
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        unsigned int next_queue;
+
+        // Tasks submitted but not yet finished
+        std::atomic<unsigned long> pending;
+        std::atomic<bool> stopping;
+
+        std::mutex idle_mutex;
+        std::condition_variable work_available;
+        std::condition_variable all_done;
+
+        void work(unsigned int index);
+        bool take(unsigned int index, std::function<void()>& task);
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef LIBCHIP8_H
+#define LIBCHIP8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// C interface to the emulator, for embedding it in other programs and
+// languages. `make libchip8` builds it as libchip8.a and libchip8.so.
+//
+// A chip8_machine is one machine with its program. Machines are
+// independent: different machines may be used from different threads at
+// the same time, each machine from one thread at a time.
+//
+// Loading a program copies it once. After that nothing allocates:
+// chip8_step_frames() runs a frame on each of many machines and writes
+// their images straight into memory the caller owns.
+
+#define CHIP8_API __attribute__((visibility("default")))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Images written by chip8_step_frames(): one byte per pixel, row by row,
+// holding the pixel's color 0-3 (bit n set if it is lit in plane n). Lo-res
+// pixels are doubled both ways, so every image is 128x64.
+#define CHIP8_FRAME_WIDTH 128
+#define CHIP8_FRAME_HEIGHT 64
+#define CHIP8_FRAME_BYTES (CHIP8_FRAME_WIDTH * CHIP8_FRAME_HEIGHT)
+
+// Instructions a new machine runs per frame.
+#define CHIP8_DEFAULT_INSTRUCTIONS_PER_FRAME 10
+
+// Quirks, the same bits as in Quirks.h.
+#define CHIP8_QUIRK_SHIFT_VY (1u << 0)
+#define CHIP8_QUIRK_LOAD_STORE_INCREMENT (1u << 1)
+#define CHIP8_QUIRK_JUMP_VX (1u << 2)
+#define CHIP8_QUIRK_CLIP_SPRITES (1u << 3)
+
+// Results of chip8_load_rom().
+#define CHIP8_OK 0
+#define CHIP8_ERROR_TOO_LARGE (-1)
+
+typedef struct chip8_machine chip8_machine;
+
+// A new machine with no program, or NULL if there is not enough memory.
+CHIP8_API chip8_machine* chip8_create(void);
+CHIP8_API void chip8_destroy(chip8_machine* machine);
+
+// Copies the program into a freshly reset machine, with seed for the
+// random numbers of CXNN. Returns CHIP8_OK, or CHIP8_ERROR_TOO_LARGE and
+// leaves the machine alone.
+CHIP8_API int chip8_load_rom(chip8_machine* machine, const uint8_t* rom, size_t size, uint32_t seed);
+
+// Puts the machine back to the state chip8_load_rom() left it in, but with
+// a new seed. Costs about as much as the program's size, so it can be
+// called every episode.
+CHIP8_API void chip8_reset(chip8_machine* machine, uint32_t seed);
+
+// CHIP8_QUIRK_* bits. They are kept across resets and loads.
+CHIP8_API void chip8_set_quirks(chip8_machine* machine, uint32_t quirks);
+// At least 1.
+CHIP8_API void chip8_set_instructions_per_frame(chip8_machine* machine, uint32_t instructions);
+
+// Runs one frame on each of the n machines: sets its keys from inputs[i],
+// where bit k is key k, runs its instructions and ticks its timers once.
+// With inputs NULL the keys are left as they were. Unless frames is NULL,
+// machine i's image is then written to frames + i * CHIP8_FRAME_BYTES.
+// Returns how many of the machines have stopped on a fault.
+CHIP8_API size_t chip8_step_frames(chip8_machine* const machines[], size_t n, const uint16_t inputs[],
+                                   uint8_t* frames);
+
+// Whether the machine has stopped on a fault; it stays stopped until it is
+// reset.
+CHIP8_API int chip8_faulted(const chip8_machine* machine);
+// Whether the sound timer is running.
+CHIP8_API int chip8_sound_playing(const chip8_machine* machine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "AotRuntime.h"
+
+AotRuntime::AotRuntime(Chip8& machine, const AotProgram& translated)
+    : chip8(machine),
+      program(translated),
+      entries(MEMORY_SIZE, Entry()),
+      valid(MEMORY_SIZE, 0),
+      longest_block(0),
+      translated_count(0),
+      total_count(0) {
+    for (unsigned long b = 0; b < program.block_count; b++) {
+        const AotBlock& block = program.blocks[b];
+        for (unsigned short i = 0; i < block.count; i++) {
+            Entry& entry = entries[block.start + 2ul * i];
+            entry.end = block.end;
+            entry.count = static_cast<unsigned short>(block.count - i);
+        }
+        longest_block = std::max(longest_block, static_cast<unsigned long>(block.end - block.start));
+    }
+
+    // Whatever the machine holds now, rather than what it wrote since
+    // loading the program
+    check(0, MEMORY_SIZE - 1);
+    chip8.written_low = MEMORY_SIZE;
+    chip8.written_high = 0;
+}
+
+void AotRuntime::enable_check() {
+    reference.reset(new Chip8(chip8));
+}
+
+unsigned long AotRuntime::run(unsigned long cycles) {
+    // Blocks are translated for one set of quirks
+    if (chip8.quirks() != program.quirks) {
+        unsigned long executed = chip8.run(cycles);
+        total_count += executed;
+        return executed;
+    }
+
+    unsigned long remaining = cycles;
+    bool waiting = false;
+    while (remaining > 0 && !chip8.faulted()) {
+        // Blocks can exit past the end of memory, where execution wraps
+        unsigned short pc = chip8.pc & ADDRESS_MASK;
+        chip8.pc = pc;
+
+        // Translated code skips the same waits as the interpreter, after
+        // the same jumps, and sets chip8.waiting when it does
+        unsigned long executed = 0;
+        if (valid[pc] && entries[pc].count <= remaining) {
+            if (reference) {
+                *reference = chip8;
+            }
+
+            chip8.waiting = false;
+            executed = program.run(chip8, valid.data(), remaining);
+            translated_count += executed;
+            waiting = waiting || chip8.waiting;
+
+            if (reference) {
+                reference->run(executed);
+                if (!same_state(chip8, *reference) || reference->idle() != chip8.idle()) {
+                    throw std::runtime_error("Translated code and interpreter disagree after running from "
+                                             + std::to_string(pc));
+                }
+            }
+        }
+
+        // Left to the interpreter: one instruction, or the rest of the
+        // frame when it is too short for the block here. Translated code
+        // that stopped on a fault lets the interpreter raise it.
+        if (executed == 0) {
+            unsigned long budget = valid[pc] ? remaining : 1;
+            bool jumps = (chip8.memory[pc] & 0xF0) == 0x10;
+            executed = chip8.run(budget);
+            if (executed == 0) {
+                break;
+            }
+            if (chip8.idle()) {
+                waiting = true;
+                // FX0A spends the rest of the frame
+                executed = remaining;
+            } else if (budget == 1 && jumps && !chip8.faulted() && chip8.waits_after_jump(pc, chip8.pc)) {
+                // A jump the interpreter ran by itself, with no cycles
+                // left to look for a wait in
+                unsigned long idle = chip8.idle_cycles(remaining - 1);
+                waiting = waiting || idle != 0;
+                executed += idle;
+            }
+        }
+
+        remaining -= executed;
+        total_count += executed;
+        take_writes();
+    }
+
+    chip8.waiting = waiting;
+    return cycles - remaining;
+}
+
+unsigned long long AotRuntime::translated_instructions() const {
+    return translated_count;
+}
+
+unsigned long long AotRuntime::total_instructions() const {
+    return total_count;
+}
+
+// Checks the blocks covering whatever was written since the last look,
+// by the blocks, the interpreter or from outside.
+void AotRuntime::take_writes() {
+    if (chip8.written_low <= chip8.written_high) {
+        check(chip8.written_low, chip8.written_high);
+        chip8.written_low = MEMORY_SIZE;
+        chip8.written_high = 0;
+    }
+}
+
+void AotRuntime::check(unsigned long low, unsigned long high) {
+    unsigned long first = low > longest_block ? low - longest_block : 0;
+    for (unsigned long addr = first; addr <= high && addr < entries.size(); addr++) {
+        const Entry& entry = entries[addr];
+        if (entry.count != 0 && entry.end > low) {
+            valid[addr] = unchanged(addr, entry.end);
+        }
+    }
+}
+
+bool AotRuntime::unchanged(unsigned long start, unsigned long end) const {
+    const unsigned char* memory = chip8.memory.data();
+    return std::equal(memory + start, memory + end, program.rom + (start - PROGRAM_START));
+}
+
+bool AotRuntime::same_state(const Chip8& a, const Chip8& b) {
+    return a.memory == b.memory && a.regs == b.regs && a.I == b.I && a.pc == b.pc
+        && a.stack == b.stack && a.sp == b.sp && a.delay_timer == b.delay_timer
+        && a.sound_timer == b.sound_timer && a.rng_state == b.rng_state
+        && a.rpl_flags == b.rpl_flags && a.audio_pattern == b.audio_pattern && a.pitch == b.pitch
+        && a.gfx == b.gfx && a.keys == b.keys && a.last_fault.kind == b.last_fault.kind;
+}
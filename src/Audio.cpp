@@ -0,0 +1,80 @@
+#include <chrono>
+#include <cmath>
+
+#include "Audio.h"
+
+// Bits in the XO-CHIP sound pattern.
+const unsigned int PATTERN_BITS = 128;
+// Peak sample value, well below full scale.
+const int16_t AMPLITUDE = 4000;
+
+AudioStream::AudioStream(unsigned int sample_rate)
+    : dropped_states(0), rate(sample_rate), current(), position(0.0), step(0.0),
+      last_latency(0), worst_latency(0) {}
+
+int64_t AudioStream::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void AudioStream::publish(const Chip8& chip8) {
+    SoundState state;
+    state.playing = chip8.sound_playing();
+    state.pitch = chip8.sound_pitch();
+    state.pattern = chip8.sound_pattern();
+    state.published = now_ns();
+
+    if (!queue.push(state)) {
+        dropped_states.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void AudioStream::render(int16_t* out, unsigned long count) {
+    int64_t now = now_ns();
+    // This buffer is heard once the ones queued before it have played
+    int64_t buffer_ns = static_cast<int64_t>(count) * 1000000000 / rate;
+
+    SoundState state;
+    while (queue.pop(state)) {
+        int64_t latency = now - state.published + buffer_ns;
+        last_latency.store(latency, std::memory_order_relaxed);
+        if (latency > worst_latency.load(std::memory_order_relaxed)) {
+            worst_latency.store(latency, std::memory_order_relaxed);
+        }
+
+        if (state.playing && !current.playing) {
+            position = 0.0;
+        }
+        double frequency = 4000.0 * std::pow(2.0, (state.pitch - 64) / 48.0);
+        step = frequency / rate;
+        current = state;
+    }
+
+    for (unsigned long i = 0; i < count; i++) {
+        if (!current.playing) {
+            out[i] = 0;
+            continue;
+        }
+
+        unsigned int bit = static_cast<unsigned int>(position);
+        bool high = (current.pattern[bit / 8] >> (7 - bit % 8)) & 1;
+        out[i] = high ? AMPLITUDE : -AMPLITUDE;
+
+        position += step;
+        if (position >= PATTERN_BITS) {
+            position -= PATTERN_BITS;
+        }
+    }
+}
+
+int64_t AudioStream::latency_ns() const {
+    return last_latency.load(std::memory_order_relaxed);
+}
+
+int64_t AudioStream::worst_latency_ns() const {
+    return worst_latency.load(std::memory_order_relaxed);
+}
+
+unsigned long AudioStream::dropped() const {
+    return dropped_states.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,856 @@
+#include <algorithm>
+
+#include "BatchCore.h"
+
+template <unsigned int Lanes>
+BatchCore<Lanes>::BatchCore()
+    : machines(),
+      quirk_flags(0),
+      decoded(MEMORY_SIZE),
+      regs(),
+      I(),
+      pc(),
+      stack(),
+      sp(),
+      delay_timer(),
+      rng_state(),
+      keys(),
+      remaining(),
+      lane_counts(),
+      byte_mask(),
+      word_mask(),
+      long_mask(),
+      lockstep_count(0),
+      total_count(0) {
+    for (std::unique_ptr<Chip8>& machine : machines) {
+        machine.reset(new Chip8());
+    }
+}
+
+template <unsigned int Lanes>
+void BatchCore<Lanes>::initialize(const std::array<uint32_t, Lanes>& seeds) {
+    for (unsigned int lane = 0; lane < Lanes; lane++) {
+        machines[lane]->initialize(seeds[lane]);
+        machines[lane]->set_quirks(quirk_flags);
+    }
+    lockstep_count = 0;
+    total_count = 0;
+}
+
+template <unsigned int Lanes>
+void BatchCore<Lanes>::load_program(const unsigned char* program, unsigned long size) {
+    for (std::unique_ptr<Chip8>& machine : machines) {
+        machine->load_program(program, size);
+    }
+}
+
+template <unsigned int Lanes>
+void BatchCore<Lanes>::set_quirks(unsigned int quirks) {
+    for (std::unique_ptr<Chip8>& machine : machines) {
+        machine->set_quirks(quirks);
+    }
+    quirk_flags = machines[0]->quirks();
+}
+
+template <unsigned int Lanes>
+void BatchCore<Lanes>::tick_timers() {
+    for (std::unique_ptr<Chip8>& machine : machines) {
+        machine->tick_timers();
+    }
+}
+
+template <unsigned int Lanes>
+Chip8& BatchCore<Lanes>::lane(unsigned int index) {
+    return *machines[index];
+}
+
+template <unsigned int Lanes>
+const Chip8& BatchCore<Lanes>::lane(unsigned int index) const {
+    return *machines[index];
+}
+
+template <unsigned int Lanes>
+unsigned long BatchCore<Lanes>::lane_executed(unsigned int index) const {
+    return lane_counts[index];
+}
+
+template <unsigned int Lanes>
+unsigned long long BatchCore<Lanes>::lockstep_instructions() const {
+    return lockstep_count;
+}
+
+template <unsigned int Lanes>
+unsigned long long BatchCore<Lanes>::total_instructions() const {
+    return total_count;
+}
+
+template <unsigned int Lanes>
+void BatchCore<Lanes>::load_lane(unsigned int lane) {
+    const Chip8& machine = *machines[lane];
+    for (unsigned int x = 0; x < 16; x++) {
+        regs[x][lane] = machine.regs[x];
+        stack[x][lane] = machine.stack[x];
+    }
+    I[lane] = machine.I;
+    pc[lane] = machine.pc;
+    sp[lane] = static_cast<unsigned char>(machine.sp);
+    delay_timer[lane] = machine.delay_timer;
+    rng_state[lane] = machine.rng_state;
+}
+
+template <unsigned int Lanes>
+void BatchCore<Lanes>::store_lane(unsigned int lane) {
+    Chip8& machine = *machines[lane];
+    for (unsigned int x = 0; x < 16; x++) {
+        machine.regs[x] = regs[x][lane];
+        machine.stack[x] = stack[x][lane];
+    }
+    machine.I = I[lane];
+    machine.pc = pc[lane];
+    machine.sp = sp[lane];
+    machine.delay_timer = delay_timer[lane];
+    machine.rng_state = rng_state[lane];
+}
+
+// Forgets the shared decoding of whatever the lane wrote since the last
+// look, on its own or from outside the batch.
+template <unsigned int Lanes>
+void BatchCore<Lanes>::take_writes(unsigned int lane) {
+    Chip8& machine = *machines[lane];
+    if (machine.written_low <= machine.written_high) {
+        invalidate(machine.written_low, machine.written_high);
+        machine.written_low = MEMORY_SIZE;
+        machine.written_high = 0;
+    }
+}
+
+template <unsigned int Lanes>
+void BatchCore<Lanes>::invalidate(unsigned long low, unsigned long high) {
+    // Instructions starting up to three bytes earlier also cover low
+    unsigned long count = std::min(high - low + 4, MEMORY_SIZE);
+    for (unsigned long i = 0; i < count; i++) {
+        decoded[(low + MEMORY_SIZE - 3 + i) & ADDRESS_MASK].kind = OP_UNDECODED;
+    }
+}
+
+// The opcode at addr in one lane's memory.
+static unsigned short opcode_at(const std::array<unsigned char, MEMORY_SIZE>& memory, unsigned long addr) {
+    return static_cast<unsigned short>((memory[addr & ADDRESS_MASK] << 8) | memory[(addr + 1) & ADDRESS_MASK]);
+}
+
+// The instruction at addr, or nullptr if the lanes do not all hold the
+// same one there.
+template <unsigned int Lanes>
+const MicroOp* BatchCore<Lanes>::fetch(unsigned short addr) {
+    addr &= ADDRESS_MASK;
+    MicroOp& op = decoded[addr];
+    if (op.kind != OP_UNDECODED) {
+        return &op;
+    }
+
+    // F000 NNNN is four bytes long
+    const Chip8& first = *machines[0];
+    for (unsigned int lane = 1; lane < Lanes; lane++) {
+        for (unsigned int i = 0; i < 4; i++) {
+            unsigned short byte = static_cast<unsigned short>((addr + i) & ADDRESS_MASK);
+            if (machines[lane]->memory[byte] != first.memory[byte]) {
+                return nullptr;
+            }
+        }
+    }
+
+    machines[0]->decode(addr);
+    op = machines[0]->decoded[addr];
+    return &op;
+}
+
+template <unsigned int Lanes>
+unsigned long BatchCore<Lanes>::run(unsigned long cycles) {
+    for (unsigned int lane = 0; lane < Lanes; lane++) {
+        const Chip8& machine = *machines[lane];
+        take_writes(lane);
+        load_lane(lane);
+        remaining[lane] = machine.faulted() ? 0 : cycles;
+        lane_counts[lane] = 0;
+        machines[lane]->waiting = false;
+
+        // Keys only change between runs
+        unsigned short held = 0;
+        for (unsigned int key = 0; key < 16; key++) {
+            held = static_cast<unsigned short>(held | (machine.keys[key] != 0) << key);
+        }
+        keys[lane] = held;
+    }
+
+    unsigned long executed = 0;
+    for (;;) {
+        // The lanes earliest in the program go first, with every lane at
+        // their PC, so that lanes split by a branch meet again where the
+        // paths join
+        unsigned int leader = Lanes;
+        for (unsigned int lane = 0; lane < Lanes; lane++) {
+            if (remaining[lane] != 0 && (leader == Lanes || pc[lane] < pc[leader])) {
+                leader = lane;
+            }
+        }
+        if (leader == Lanes) {
+            break;
+        }
+
+        uint32_t group = 0;
+        unsigned int size = 0;
+        unsigned long limit = remaining[leader];
+        for (unsigned int lane = 0; lane < Lanes; lane++) {
+            if (remaining[lane] != 0 && pc[lane] == pc[leader]) {
+                group |= 1u << lane;
+                size++;
+                limit = std::min(limit, remaining[lane]);
+            }
+        }
+
+        if (size < LOCKSTEP_MIN_LANES) {
+            executed += run_alone(leader, std::min(limit, SCALAR_CHUNK));
+        } else {
+            executed += run_lockstep(group, limit);
+        }
+    }
+
+    for (unsigned int lane = 0; lane < Lanes; lane++) {
+        store_lane(lane);
+    }
+    total_count += executed;
+    return executed;
+}
+
+template <unsigned int Lanes>
+unsigned long BatchCore<Lanes>::run_alone(unsigned int lane, unsigned long cycles) {
+    Chip8& machine = *machines[lane];
+    bool waited = machine.waiting;
+    store_lane(lane);
+    unsigned long ran = machine.run(cycles);
+    // Idle for the whole run if it was for any part of it
+    machine.waiting = machine.waiting || waited;
+    load_lane(lane);
+    take_writes(lane);
+
+    remaining[lane] = machines[lane]->faulted() ? 0 : remaining[lane] - ran;
+    lane_counts[lane] += ran;
+    return ran;
+}
+
+template <unsigned int Lanes>
+void BatchCore<Lanes>::set_group(uint32_t group) {
+    for (unsigned int lane = 0; lane < Lanes; lane++) {
+        bool in = (group >> lane) & 1;
+        byte_mask[lane] = in ? 0xFF : 0;
+        word_mask[lane] = in ? 0xFFFF : 0;
+        long_mask[lane] = in ? 0xFFFFFFFF : 0;
+    }
+}
+
+// Writes value to the lanes of the group, leaving the others alone.
+template <typename T, unsigned long Lanes>
+static inline void blend(std::array<T, Lanes>& out, const std::array<T, Lanes>& value,
+                         const std::array<T, Lanes>& mask) {
+    for (unsigned long lane = 0; lane < Lanes; lane++) {
+        out[lane] = static_cast<T>((value[lane] & mask[lane]) | (out[lane] & ~mask[lane]));
+    }
+}
+
+// Runs the instruction at addr, the group's steps-th, on each lane of the
+// group by itself. Returns true if the group is still together, at the
+// new addr.
+template <unsigned int Lanes>
+bool BatchCore<Lanes>::run_each(uint32_t group, unsigned short addr, unsigned long steps,
+                                std::array<unsigned long, Lanes>& done) {
+    bool together = true;
+    unsigned int first = Lanes;
+    for (unsigned int lane = 0; lane < Lanes; lane++) {
+        if (!((group >> lane) & 1)) {
+            continue;
+        }
+
+        Chip8& machine = *machines[lane];
+        bool waited = machine.waiting;
+        bool jumps = (machine.memory[addr] & 0xF0) == 0x10;
+        pc[lane] = addr;
+        store_lane(lane);
+        if (machine.run(1) == 0) {
+            // Not executed
+            done[lane]--;
+            together = false;
+        } else if (jumps && machine.waits_after_jump(addr, machine.pc)) {
+            // Chip8::run() looks for a wait after the jump, with what is
+            // left of the lane's run
+            unsigned long idle = machine.idle_cycles(remaining[lane] - steps - done[lane]);
+            if (idle != 0) {
+                done[lane] += idle;
+                machine.waiting = true;
+                together = false;
+            }
+        }
+        machine.waiting = machine.waiting || waited;
+        load_lane(lane);
+        take_writes(lane);
+
+        if (first == Lanes) {
+            first = lane;
+        } else if (pc[lane] != pc[first]) {
+            together = false;
+        }
+    }
+    return together;
+}
+
+// Instructions that only change registers through blend(), so that they
+// can run on part of a group.
+static bool maskable(OpKind kind) {
+    switch (kind) {
+        case OP_SYS:
+        case OP_LD_VX_NN:
+        case OP_ADD_VX_NN:
+        case OP_LD_VX_VY:
+        case OP_OR:
+        case OP_AND:
+        case OP_XOR:
+        case OP_ADD_VX_VY:
+        case OP_SUB:
+        case OP_SHR:
+        case OP_SUBN:
+        case OP_SHL:
+        case OP_LD_I:
+        case OP_ADD_I_VX:
+        case OP_LD_F_VX:
+        case OP_LD_HF_VX:
+        case OP_RND:
+        case OP_LD_VX_DT:
+        case OP_LD_DT_VX:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Skips the next instruction on the lanes where taken is 1. When only some
+// lanes skip an instruction that can be masked, the group stays together
+// and those lanes are left in skipping. Returns true if the group is still
+// together, at the new addr.
+template <unsigned int Lanes>
+bool BatchCore<Lanes>::branch(uint32_t group, const Bytes& taken, unsigned short& addr, uint32_t& skipping) {
+    unsigned int count = 0;
+    unsigned int size = 0;
+    for (unsigned int lane = 0; lane < Lanes; lane++) {
+        count += static_cast<unsigned int>(taken[lane] & byte_mask[lane] & 1);
+        size += static_cast<unsigned int>(byte_mask[lane] & 1);
+    }
+    if (count == 0) {
+        return true;
+    }
+
+    const MicroOp* next = fetch(addr);
+    if (count == size && next != nullptr) {
+        addr = static_cast<unsigned short>(addr + (next->kind == OP_LD_I_LONG ? 4 : 2));
+        return true;
+    }
+    if (next != nullptr && maskable(next->kind)) {
+        for (unsigned int lane = 0; lane < Lanes; lane++) {
+            skipping |= static_cast<uint32_t>(taken[lane] & 1) << lane;
+        }
+        skipping &= group;
+        return true;
+    }
+
+    for (unsigned int lane = 0; lane < Lanes; lane++) {
+        if ((group >> lane) & 1) {
+            pc[lane] = taken[lane] ? static_cast<unsigned short>(addr + skip_length(lane, addr)) : addr;
+        }
+    }
+    return false;
+}
+
+// Jumps each lane of the group to its target. Returns true if the group is
+// still together, at the new addr.
+template <unsigned int Lanes>
+bool BatchCore<Lanes>::jump(uint32_t group, const Words& targets, unsigned short& addr) {
+    unsigned short first = 0;
+    for (unsigned int lane = 0; lane < Lanes; lane++) {
+        if ((group >> lane) & 1) {
+            first = targets[lane];
+            break;
+        }
+    }
+
+    unsigned short differ = 0;
+    for (unsigned int lane = 0; lane < Lanes; lane++) {
+        differ = static_cast<unsigned short>(differ | ((targets[lane] ^ first) & word_mask[lane]));
+    }
+    if (differ == 0) {
+        addr = first;
+        return true;
+    }
+
+    for (unsigned int lane = 0; lane < Lanes; lane++) {
+        if ((group >> lane) & 1) {
+            pc[lane] = targets[lane];
+        }
+    }
+    return false;
+}
+
+template <unsigned int Lanes>
+unsigned short BatchCore<Lanes>::skip_length(unsigned int lane, unsigned short addr) {
+    const Chip8& machine = *machines[lane];
+    addr &= ADDRESS_MASK;
+    bool long_load = machine.memory[addr] == 0xF0 && machine.memory[(addr + 1) & ADDRESS_MASK] == 0x00;
+    return long_load ? 4 : 2;
+}
+
+// Runs the group of lanes at one PC in lockstep, for at most limit
+// instructions, until the lanes go different ways. Returns the number of
+// instructions run over all lanes.
+template <unsigned int Lanes>
+unsigned long BatchCore<Lanes>::run_lockstep(uint32_t group, unsigned long limit) {
+    set_group(group);
+    unsigned int first = 0;
+    while (!((group >> first) & 1)) {
+        first++;
+    }
+
+    // Lanes still to run outside the group, which it joins if it gets to
+    // their PC
+    uint32_t others = 0;
+    for (unsigned int lane = 0; lane < Lanes; lane++) {
+        if (!((group >> lane) & 1) && remaining[lane] != 0) {
+            others |= 1u << lane;
+        }
+    }
+
+    unsigned short addr = pc[first];
+    // Instructions run by every lane of the group, and those only some ran
+    // or skipped as idle
+    unsigned long steps = 0;
+    std::array<unsigned long, Lanes> done = {};
+    bool together = true;
+    bool stop = false;
+    // Lanes that skip the next instruction while the rest of the group
+    // runs it
+    uint32_t skipping = 0;
+
+    Words targets;
+    Bytes taken;
+
+    while (together && !stop && steps < limit) {
+        addr &= ADDRESS_MASK;
+        const MicroOp* op = fetch(addr);
+        steps++;
+
+        uint32_t skipped = skipping;
+        skipping = 0;
+        if (skipped != 0) {
+            set_group(group & ~skipped);
+            for (unsigned int lane = 0; lane < Lanes; lane++) {
+                done[lane] -= (skipped >> lane) & 1;
+            }
+        }
+
+        if (op == nullptr) {
+            together = run_each(group, addr, steps, done);
+            addr = pc[first];
+            continue;
+        }
+
+        unsigned short next = static_cast<unsigned short>(addr + 2);
+        // Copies, so that the loops below need no alias checks and become
+        // vector operations
+        Bytes vx = regs[op->x];
+        Bytes vy = regs[op->y];
+        const unsigned char nn = op->nn;
+
+        switch (op->kind) {
+            case OP_SYS:
+                break;
+
+            case OP_JP:
+                next = op->nnn;
+                if (next == addr) {
+                    // Jumping to itself until the frame ends
+                    for (unsigned int lane = 0; lane < Lanes; lane++) {
+                        unsigned long left = remaining[lane] - steps - done[lane];
+                        if (((group >> lane) & 1) && left != 0) {
+                            done[lane] += left;
+                            machines[lane]->waiting = true;
+                        }
+                    }
+                    stop = true;
+                    break;
+                }
+
+                // Polling the delay timer with FX07, 3XNN or 4XNN and a jump
+                // back: lanes where it cannot exit before the next tick skip
+                // whole passes, as Chip8::run() does. Past the FX07 the lanes
+                // may hold different bytes, so each reads its own memory.
+                {
+                    const MicroOp* shared = fetch(next);
+                    if (shared != nullptr && shared->kind != OP_LD_VX_DT) {
+                        break;
+                    }
+                    for (unsigned int lane = 0; lane < Lanes; lane++) {
+                        if (!((group >> lane) & 1)) {
+                            continue;
+                        }
+                        const std::array<unsigned char, MEMORY_SIZE>& memory = machines[lane]->memory;
+                        unsigned short poll = opcode_at(memory, next);
+                        unsigned short skip = opcode_at(memory, next + 2ul);
+                        unsigned short back = opcode_at(memory, next + 4ul);
+                        unsigned int x = (poll & 0x0F00) >> 8;
+                        bool skips = ((skip & 0xF000) == 0x3000 || (skip & 0xF000) == 0x4000)
+                                     && ((skip & 0x0F00) >> 8) == x;
+                        if ((poll & 0xF0FF) != 0xF007 || !skips || back != (0x1000 | next)
+                            || regs[x][lane] != delay_timer[lane]) {
+                            continue;
+                        }
+                        unsigned char skip_nn = static_cast<unsigned char>(skip & 0x00FF);
+                        bool stays = (skip & 0xF000) == 0x3000 ? delay_timer[lane] != skip_nn
+                                                               : delay_timer[lane] == skip_nn;
+                        unsigned long left = remaining[lane] - steps - done[lane];
+                        if (stays && left >= 3) {
+                            done[lane] += left - left % 3;
+                            machines[lane]->waiting = true;
+                            stop = true;
+                        }
+                    }
+                }
+                break;
+
+            case OP_CALL: {
+                bool full = false;
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    full |= ((group >> lane) & 1) && sp[lane] == stack.size();
+                }
+                if (full) {
+                    together = run_each(group, addr, steps, done);
+                    next = pc[first];
+                    break;
+                }
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    if ((group >> lane) & 1) {
+                        stack[sp[lane]][lane] = next;
+                        sp[lane]++;
+                    }
+                }
+                next = op->nnn;
+                break;
+            }
+
+            case OP_RET: {
+                bool empty = false;
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    empty |= ((group >> lane) & 1) && sp[lane] == 0;
+                }
+                if (empty) {
+                    together = run_each(group, addr, steps, done);
+                    next = pc[first];
+                    break;
+                }
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    if ((group >> lane) & 1) {
+                        sp[lane]--;
+                        targets[lane] = stack[sp[lane]][lane];
+                    }
+                }
+                together = jump(group, targets, next);
+                break;
+            }
+
+            case OP_SE_VX_NN:
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    taken[lane] = vx[lane] == nn;
+                }
+                together = branch(group, taken, next, skipping);
+                break;
+
+            case OP_SNE_VX_NN:
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    taken[lane] = vx[lane] != nn;
+                }
+                together = branch(group, taken, next, skipping);
+                break;
+
+            case OP_SE_VX_VY:
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    taken[lane] = vx[lane] == vy[lane];
+                }
+                together = branch(group, taken, next, skipping);
+                break;
+
+            case OP_SNE_VX_VY:
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    taken[lane] = vx[lane] != vy[lane];
+                }
+                together = branch(group, taken, next, skipping);
+                break;
+
+            case OP_LD_VX_NN:
+                vx.fill(nn);
+                blend(regs[op->x], vx, byte_mask);
+                break;
+
+            case OP_ADD_VX_NN:
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    vx[lane] = static_cast<unsigned char>(vx[lane] + nn);
+                }
+                blend(regs[op->x], vx, byte_mask);
+                break;
+
+            case OP_LD_VX_VY:
+                blend(regs[op->x], vy, byte_mask);
+                break;
+
+            case OP_OR:
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    vx[lane] = vx[lane] | vy[lane];
+                }
+                blend(regs[op->x], vx, byte_mask);
+                break;
+
+            case OP_AND:
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    vx[lane] = vx[lane] & vy[lane];
+                }
+                blend(regs[op->x], vx, byte_mask);
+                break;
+
+            case OP_XOR:
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    vx[lane] = vx[lane] ^ vy[lane];
+                }
+                blend(regs[op->x], vx, byte_mask);
+                break;
+
+            case OP_ADD_VX_VY:
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    vx[lane] = static_cast<unsigned char>(vx[lane] + vy[lane]);
+                }
+                blend(regs[op->x], vx, byte_mask);
+                break;
+
+            case OP_SUB:
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    vx[lane] = static_cast<unsigned char>(vx[lane] - vy[lane]);
+                }
+                blend(regs[op->x], vx, byte_mask);
+                break;
+
+            case OP_SHR:
+                if (quirk_flags & QUIRK_SHIFT_VY) {
+                    vx = vy;
+                }
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    vx[lane] = vx[lane] >> 1;
+                }
+                blend(regs[op->x], vx, byte_mask);
+                break;
+
+            case OP_SUBN:
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    vx[lane] = static_cast<unsigned char>(vy[lane] - vx[lane]);
+                }
+                blend(regs[op->x], vx, byte_mask);
+                break;
+
+            case OP_SHL:
+                if (quirk_flags & QUIRK_SHIFT_VY) {
+                    vx = vy;
+                }
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    vx[lane] = static_cast<unsigned char>(vx[lane] << 1);
+                }
+                blend(regs[op->x], vx, byte_mask);
+                break;
+
+            case OP_LD_I:
+                targets.fill(op->nnn);
+                blend(I, targets, word_mask);
+                break;
+
+            case OP_LD_I_LONG:
+                targets.fill(op->nnn);
+                blend(I, targets, word_mask);
+                next = static_cast<unsigned short>(addr + 4);
+                break;
+
+            case OP_ADD_I_VX:
+                targets = I;
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    targets[lane] = static_cast<unsigned short>(targets[lane] + vx[lane]);
+                }
+                blend(I, targets, word_mask);
+                break;
+
+            case OP_LD_F_VX:
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    targets[lane] = static_cast<unsigned short>(vx[lane] * 5);
+                }
+                blend(I, targets, word_mask);
+                break;
+
+            case OP_LD_HF_VX:
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    targets[lane] = static_cast<unsigned short>(BIG_FONT_ADDRESS + (vx[lane] & 0xF) * 10);
+                }
+                blend(I, targets, word_mask);
+                break;
+
+            case OP_JP_V0:
+                if (!(quirk_flags & QUIRK_JUMP_VX)) {
+                    vx = regs[0];
+                }
+                targets.fill(op->nnn);
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    targets[lane] = static_cast<unsigned short>(targets[lane] + vx[lane]);
+                }
+                together = jump(group, targets, next);
+                break;
+
+            case OP_RND: {
+                // xorshift32, as Chip8::next_random()
+                Longs state = rng_state;
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    state[lane] ^= state[lane] << 13;
+                    state[lane] ^= state[lane] >> 17;
+                    state[lane] ^= state[lane] << 5;
+                }
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    vx[lane] = static_cast<unsigned char>((state[lane] >> 24) & nn);
+                }
+                blend(rng_state, state, long_mask);
+                blend(regs[op->x], vx, byte_mask);
+                break;
+            }
+
+            case OP_SKP:
+                targets = keys;
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    taken[lane] = (targets[lane] >> (vx[lane] & 0xF)) & 1;
+                }
+                together = branch(group, taken, next, skipping);
+                break;
+
+            case OP_SKNP:
+                targets = keys;
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    taken[lane] = !((targets[lane] >> (vx[lane] & 0xF)) & 1);
+                }
+                together = branch(group, taken, next, skipping);
+                break;
+
+            case OP_CLS:
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    if ((group >> lane) & 1) {
+                        machines[lane]->clear_display();
+                    }
+                }
+                break;
+
+            case OP_DRW:
+                // Each lane draws on its own display, with the registers
+                // the sprite needs
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    if (!((group >> lane) & 1)) {
+                        continue;
+                    }
+                    Chip8& machine = *machines[lane];
+                    machine.regs[op->x] = vx[lane];
+                    machine.regs[op->y] = vy[lane];
+                    machine.I = I[lane];
+                    machine.draw_sprite(op->x, op->y, op->n, quirk_flags & QUIRK_CLIP_SPRITES);
+                    regs[15][lane] = machine.regs[15];
+                }
+                break;
+
+            case OP_LD_VX_DT:
+                vy = delay_timer;
+                blend(regs[op->x], vy, byte_mask);
+                break;
+
+            case OP_LD_DT_VX:
+                blend(delay_timer, vx, byte_mask);
+                break;
+
+            case OP_LD_VX_K: {
+                // Lanes with a key held take the lowest one, the others wait
+                // on this instruction for the rest of the run
+                unsigned int waiting = 0;
+                unsigned int size = 0;
+                for (unsigned int lane = 0; lane < Lanes; lane++) {
+                    if (!((group >> lane) & 1)) {
+                        continue;
+                    }
+                    size++;
+                    if (keys[lane] == 0) {
+                        waiting++;
+                        targets[lane] = addr;
+                        unsigned long left = remaining[lane] - steps - done[lane];
+                        done[lane] += left;
+                        machines[lane]->waiting = true;
+                        continue;
+                    }
+                    unsigned char key = 0;
+                    while (!((keys[lane] >> key) & 1)) {
+                        key++;
+                    }
+                    regs[op->x][lane] = key;
+                    targets[lane] = next;
+                }
+                if (waiting == size) {
+                    next = addr;
+                    stop = true;
+                } else if (waiting != 0) {
+                    together = jump(group, targets, next);
+                }
+                break;
+            }
+
+            default:
+                // Memory, sound, scrolling, faults: each lane by itself
+                together = run_each(group, addr, steps, done);
+                next = pc[first];
+                break;
+        }
+        addr = next;
+
+        if (skipped != 0) {
+            set_group(group);
+        }
+        if (others != 0 && together) {
+            for (unsigned int lane = 0; lane < Lanes; lane++) {
+                stop = stop || (((others >> lane) & 1) && pc[lane] == addr);
+            }
+        }
+    }
+
+    if (together) {
+        for (unsigned int lane = 0; lane < Lanes; lane++) {
+            if ((group >> lane) & 1) {
+                pc[lane] = (skipping >> lane) & 1 ? static_cast<unsigned short>(addr + 2) : addr;
+            }
+        }
+    }
+
+    unsigned long executed = 0;
+    for (unsigned int lane = 0; lane < Lanes; lane++) {
+        if (!((group >> lane) & 1)) {
+            continue;
+        }
+        unsigned long ran = steps + done[lane];
+        remaining[lane] = machines[lane]->faulted() ? 0 : remaining[lane] - ran;
+        lane_counts[lane] += ran;
+        executed += ran;
+    }
+    lockstep_count += executed;
+    return executed;
+}
+
+template class BatchCore<8>;
+template class BatchCore<16>;
+template class BatchCore<32>;
@@ -1,421 +1,1047 @@
 #include <iostream>
+#include <iomanip>
 #include <fstream>
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <stdio.h>
+#include <sstream>
+#include <vector>
 
 #include "Chip8.h"
+#include "Snapshot.h"
 
-void Chip8::initialize() {
-    pc = 0x200;
+// Spreads the bits of a seed over the whole word (the murmur3 finalizer),
+// so that nearby seeds such as 1, 2, 3 give unrelated random sequences.
+static uint32_t scramble_seed(uint32_t seed) {
+    seed ^= seed >> 16;
+    seed *= 0x85EBCA6B;
+    seed ^= seed >> 13;
+    seed *= 0xC2B2AE35;
+    seed ^= seed >> 16;
+    return seed;
+}
+
+void Chip8::initialize(uint32_t seed) {
+    pc = PROGRAM_START;
     I = 0;
     sp = 0;
 
-    // Clear display
-    gfx.fill(0);
+    // Clear display, back to lo-res
+    gfx.reset();
+    // Release all keys
+    keys.fill(0);
     // Clear stack
     stack.fill(0);
     // Clear registers
     regs.fill(0);
+    rpl_flags.fill(0);
     // Clear memory
     memory.fill(0);
+    invalidate_all();
 
-    // Load fontset
-    for (unsigned long i = 0; i < chip8_fontset.size(); i++) {
-        memory[i] = chip8_fontset[i];
-    }
+    // Load fontsets
+    std::copy(chip8_fontset.begin(), chip8_fontset.end(), memory.begin() + FONT_ADDRESS);
+    std::copy(chip8_big_fontset.begin(), chip8_big_fontset.end(), memory.begin() + BIG_FONT_ADDRESS);
+    memory_used = BIG_FONT_ADDRESS + chip8_big_fontset.size();
 
     delay_timer = 0;
     sound_timer = 0;
+    sounding = false;
+    waiting = false;
+    // A square wave of four bits high, four low; at XO-CHIP's default
+    // 4000 Hz playback rate that is a 500 Hz beep
+    audio_pattern.fill(0xF0);
+    pitch = 64;
+
+    seed_random(seed);
+
+    last_fault = {FAULT_NONE, 0, 0};
+
+#if CHIP8_TRACE
+    trace.clear();
+#endif
+#if CHIP8_PROFILE
+    profile.clear();
+#endif
 }
 
 void Chip8::load_program(std::string path) {
-    std::streampos size;
     std::ifstream file (path, std::ios::in|std::ios::binary|std::ios::ate);
 
-    unsigned char* program_loc = &memory[0x200];
+    if (!file.is_open()) {
+        throw std::runtime_error("Unable to open program file!");
+    }
+
+    std::streamoff size = file.tellg();
+    // Check and verify that size is not too large for memory
+    if (size > static_cast<std::streamoff>(MAX_PROGRAM_SIZE)) {
+        throw std::runtime_error("Program is too large!");
+    }
 
-    if (file.is_open()) {
-        size = file.tellg();
-        // Check and verify that size is not too large for memory
-        if (size > 0xC9F) {
-            throw std::runtime_error("Program is too large!");
-        }
+    std::vector<unsigned char> program(static_cast<unsigned long>(size));
+    file.seekg(0, std::ios::beg);
+    file.read(reinterpret_cast<char*>(program.data()), size);
+    file.close();
 
-        file.seekg(0, std::ios::beg);
-        file.read(reinterpret_cast<char*>(program_loc), size);
-        file.close();
-    } else {
-        throw std::runtime_error("Unable to open program file!");
+    load_program(program.data(), program.size());
+}
+
+void Chip8::load_program(const unsigned char* program, unsigned long size) {
+    if (size > MAX_PROGRAM_SIZE) {
+        throw std::runtime_error("Program is too large!");
     }
 
-    // for (unsigned long i = 0; i < memory.size(); i++) {
-    //     if (i % 8 == 0) {
-    //         printf("\n");
-    //         printf("%08lx: ", i);
-    //     }
-    //     printf("%04x ", memory[i]);
-    // }
-    // printf("\n");
+    std::copy(program, program + size, memory.begin() + PROGRAM_START);
+    memory_used = std::max(memory_used, PROGRAM_START + size);
+    invalidate_all();
 }
 
 void Chip8::emulate_cycle() {
-    printf("PC: %04x\tOpcode: %04x\n", pc, (memory[pc] << 8) | memory[pc + 1]);
-    handle_opcode();
+    run(1);
+}
+
+#if CHIP8_TRACE
+void Chip8::record_trace() {
+    TraceEntry& entry = trace.next();
+    entry.pc = pc;
+    entry.opcode = static_cast<uint16_t>((memory[pc] << 8) | memory[(pc + 1) & ADDRESS_MASK]);
+    entry.level = CHIP8_TRACE;
+#if CHIP8_TRACE >= 2
+    entry.I = I;
+    entry.sp = static_cast<uint8_t>(sp);
+    entry.regs = regs;
+#endif
+}
+#endif
 
+void Chip8::tick_timers() {
     if (delay_timer > 0)
         delay_timer--;
 
+    // A timer set to 1 still sounds for the frame it counts down in
+    sounding = sound_timer > 0;
     if (sound_timer > 0) {
-        if (sound_timer == 1) {
-            // TODO: Play noise
-            std::cout << "BEEP!" << std::endl;
-        }
         sound_timer--;
     }
 }
 
-void Chip8::handle_opcode() {
-    int first = memory[pc];
-    int second = memory[pc + 1];
-    unsigned short opcode = static_cast<unsigned short>((first << 8) | (second & 0x00FF));
-    pc += 2;
+bool Chip8::sound_playing() const {
+    return sounding;
+}
 
-    unsigned short top = opcode & 0xF000;
+const std::array<unsigned char, 16>& Chip8::sound_pattern() const {
+    return audio_pattern;
+}
 
-    switch (top) {
+unsigned char Chip8::sound_pitch() const {
+    return pitch;
+}
+
+void Chip8::dump_state(std::ostream& out) const {
+    std::ios_base::fmtflags flags = out.flags();
+    out << std::hex << std::uppercase << std::setfill('0');
+
+    for (unsigned long i = 0; i < regs.size(); i++) {
+        out << "V" << i << "=" << std::setw(2) << static_cast<unsigned int>(regs[i])
+            << (i % 8 == 7 ? "\n" : " ");
+    }
+
+    out << "I=" << std::setw(3) << I
+        << " PC=" << std::setw(3) << pc
+        << " SP=" << sp
+        << " DT=" << std::setw(2) << static_cast<unsigned int>(delay_timer)
+        << " ST=" << std::setw(2) << static_cast<unsigned int>(sound_timer)
+        << " RNG=" << std::setw(8) << rng_state << "\n";
+
+    out << "Stack:";
+    for (unsigned short i = 0; i < sp; i++) {
+        out << " " << std::setw(3) << stack[i];
+    }
+    out << "\n";
+
+    out.flags(flags);
+}
+
+void Chip8::decode(unsigned short addr) {
+    unsigned short opcode = static_cast<unsigned short>((memory[addr] << 8) | memory[(addr + 1) & ADDRESS_MASK]);
+    MicroOp& op = decoded[addr];
+
+    op.x = static_cast<unsigned char>((opcode & 0x0F00) >> 8);
+    op.y = static_cast<unsigned char>((opcode & 0x00F0) >> 4);
+    op.n = static_cast<unsigned char>(opcode & 0x000F);
+    op.nn = static_cast<unsigned char>(opcode & 0x00FF);
+    op.nnn = opcode & 0x0FFF;
+
+    switch (opcode & 0xF000) {
         case 0x0000:
-            handle_opcode_0(opcode);
+            if ((opcode & 0xFFF0) == 0x00C0) {
+                op.kind = OP_SCD;
+            } else if ((opcode & 0xFFF0) == 0x00D0) {
+                op.kind = OP_SCU;
+            } else {
+                switch (opcode) {
+                    case 0x00E0: op.kind = OP_CLS; break;
+                    case 0x00EE: op.kind = OP_RET; break;
+                    case 0x00FB: op.kind = OP_SCR; break;
+                    case 0x00FC: op.kind = OP_SCL; break;
+                    case 0x00FD: op.kind = OP_EXIT; break;
+                    case 0x00FE: op.kind = OP_LOW; break;
+                    case 0x00FF: op.kind = OP_HIGH; break;
+                    default: op.kind = OP_SYS; break;
+                }
+            }
             break;
         case 0x1000:
-            handle_opcode_1(opcode);
+            op.kind = OP_JP;
             break;
         case 0x2000:
-            handle_opcode_2(opcode);
+            op.kind = OP_CALL;
             break;
         case 0x3000:
-            handle_opcode_3(opcode);
+            op.kind = OP_SE_VX_NN;
             break;
         case 0x4000:
-            handle_opcode_4(opcode);
+            op.kind = OP_SNE_VX_NN;
             break;
         case 0x5000:
-            handle_opcode_5(opcode);
+            switch (op.n) {
+                case 0x2: op.kind = OP_SAVE_VX_VY; break;
+                case 0x3: op.kind = OP_LOAD_VX_VY; break;
+                default: op.kind = OP_SE_VX_VY; break;
+            }
             break;
         case 0x6000:
-            handle_opcode_6(opcode);
+            op.kind = OP_LD_VX_NN;
             break;
         case 0x7000:
-            handle_opcode_7(opcode);
+            op.kind = OP_ADD_VX_NN;
             break;
         case 0x8000:
-            handle_opcode_8(opcode);
+            switch (op.n) {
+                case 0x0: op.kind = OP_LD_VX_VY; break;
+                case 0x1: op.kind = OP_OR; break;
+                case 0x2: op.kind = OP_AND; break;
+                case 0x3: op.kind = OP_XOR; break;
+                case 0x4: op.kind = OP_ADD_VX_VY; break;
+                case 0x5: op.kind = OP_SUB; break;
+                case 0x6: op.kind = OP_SHR; break;
+                case 0x7: op.kind = OP_SUBN; break;
+                case 0xE: op.kind = OP_SHL; break;
+                default: op.kind = OP_INVALID_8; break;
+            }
             break;
         case 0x9000:
-            handle_opcode_9(opcode);
+            op.kind = OP_SNE_VX_VY;
             break;
         case 0xA000:
-            handle_opcode_A(opcode);
+            op.kind = OP_LD_I;
             break;
         case 0xB000:
-            handle_opcode_B(opcode);
+            op.kind = OP_JP_V0;
             break;
         case 0xC000:
-            handle_opcode_C(opcode);
+            op.kind = OP_RND;
             break;
         case 0xD000:
-            handle_opcode_D(opcode);
+            op.kind = OP_DRW;
             break;
         case 0xE000:
-            handle_opcode_E(opcode);
-            break;
-        case 0xF000:
-            handle_opcode_F(opcode);
+            op.kind = op.nn == 0x9E ? OP_SKP : OP_SKNP;
             break;
         default:
-            std::cout << "Opcode not supported!" << std::endl;
+            switch (op.nn) {
+                case 0x00:
+                    // The address is the whole next word
+                    if (op.x == 0) {
+                        op.kind = OP_LD_I_LONG;
+                        op.nnn = static_cast<unsigned short>((memory[(addr + 2) & ADDRESS_MASK] << 8)
+                                                             | memory[(addr + 3) & ADDRESS_MASK]);
+                    } else {
+                        op.kind = OP_INVALID_F;
+                    }
+                    break;
+                case 0x01: op.kind = OP_PLANE; break;
+                case 0x02: op.kind = op.x == 0 ? OP_AUDIO : OP_INVALID_F; break;
+                case 0x07: op.kind = OP_LD_VX_DT; break;
+                case 0x0A: op.kind = OP_LD_VX_K; break;
+                case 0x15: op.kind = OP_LD_DT_VX; break;
+                case 0x18: op.kind = OP_LD_ST_VX; break;
+                case 0x1E: op.kind = OP_ADD_I_VX; break;
+                case 0x29: op.kind = OP_LD_F_VX; break;
+                case 0x30: op.kind = OP_LD_HF_VX; break;
+                case 0x33: op.kind = OP_LD_B_VX; break;
+                case 0x3A: op.kind = OP_PITCH; break;
+                case 0x55: op.kind = OP_LD_MEM_VX; break;
+                case 0x65: op.kind = OP_LD_VX_MEM; break;
+                case 0x75: op.kind = OP_LD_R_VX; break;
+                case 0x85: op.kind = OP_LD_VX_R; break;
+                default: op.kind = OP_INVALID_F; break;
+            }
             break;
     }
 }
 
-void Chip8::handle_opcode_0(unsigned short opcode) {
-    if (opcode == 0x00E0) {
+void Chip8::invalidate(unsigned short addr) {
+    // Instructions starting up to three bytes earlier (F000 NNNN is four
+    // bytes long) also cover addr
+    for (unsigned int back = 0; back < 4; back++) {
+        decoded[(addr - back) & ADDRESS_MASK].kind = OP_UNDECODED;
+    }
+    memory_used = std::max(memory_used, addr + 1ul);
+    written_low = std::min(written_low, static_cast<unsigned long>(addr));
+    written_high = std::max(written_high, static_cast<unsigned long>(addr));
+}
+
+void Chip8::invalidate_all() {
+    for (MicroOp& op : decoded) {
+        op.kind = OP_UNDECODED;
+    }
+    written_low = 0;
+    written_high = MEMORY_SIZE - 1;
+}
+
+// GCC and clang can take the address of a label, so every handler can jump
+// straight to the next one (threaded code) instead of going back through a
+// single switch. Other compilers fall back to the switch.
+#if defined(__GNUC__)
+#define CHIP8_THREADED_DISPATCH 1
+#else
+#define CHIP8_THREADED_DISPATCH 0
+#endif
+
+#if CHIP8_TRACE
+#define TRACE_INSTRUCTION() record_trace()
+#else
+#define TRACE_INSTRUCTION()
+#endif
+
+// Stops at the current instruction, which is not counted as executed.
+#define FAULT(kind) return raise_fault(kind, cycles - remaining - 1)
+
+#if CHIP8_PROFILE
+#define PROFILE_INSTRUCTION() profile.instruction(pc, decoded[profile.last_pc()].kind)
+#else
+#define PROFILE_INSTRUCTION()
+#endif
+
+#if CHIP8_THREADED_DISPATCH && defined(__clang__)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wgnu-label-as-value"
+#endif
+
+template <unsigned int Quirks>
+unsigned long Chip8::run_quirks(unsigned long cycles) {
+    unsigned long remaining = cycles;
+    const MicroOp* op;
+
+    waiting = false;
+    if (last_fault.kind != FAULT_NONE) {
+        return 0;
+    }
+
+#if CHIP8_PROFILE
+    // Stops the profiler's clock however run() is left
+    struct PauseProfile {
+        Chip8& chip8;
+        ~PauseProfile() {
+            chip8.profile.pause(chip8.decoded[chip8.profile.last_pc()].kind);
+        }
+    } pause_profile = {*this};
+#endif
+
+#if CHIP8_THREADED_DISPATCH
+    // One label per OpKind, in the same order
+    static void* const handlers[OP_COUNT] = {
+        &&label_OP_UNDECODED, &&label_OP_SYS, &&label_OP_CLS, &&label_OP_RET,
+        &&label_OP_JP, &&label_OP_CALL, &&label_OP_SE_VX_NN, &&label_OP_SNE_VX_NN,
+        &&label_OP_SE_VX_VY, &&label_OP_LD_VX_NN, &&label_OP_ADD_VX_NN, &&label_OP_LD_VX_VY,
+        &&label_OP_OR, &&label_OP_AND, &&label_OP_XOR, &&label_OP_ADD_VX_VY,
+        &&label_OP_SUB, &&label_OP_SHR, &&label_OP_SUBN, &&label_OP_SHL,
+        &&label_OP_SNE_VX_VY, &&label_OP_LD_I, &&label_OP_JP_V0, &&label_OP_RND,
+        &&label_OP_DRW, &&label_OP_SKP, &&label_OP_SKNP, &&label_OP_LD_VX_DT,
+        &&label_OP_LD_VX_K, &&label_OP_LD_DT_VX, &&label_OP_LD_ST_VX, &&label_OP_ADD_I_VX,
+        &&label_OP_LD_F_VX, &&label_OP_LD_B_VX, &&label_OP_LD_MEM_VX, &&label_OP_LD_VX_MEM,
+        &&label_OP_SCD, &&label_OP_SCR, &&label_OP_SCL, &&label_OP_EXIT,
+        &&label_OP_LOW, &&label_OP_HIGH, &&label_OP_LD_HF_VX, &&label_OP_LD_R_VX,
+        &&label_OP_LD_VX_R, &&label_OP_SCU, &&label_OP_SAVE_VX_VY, &&label_OP_LOAD_VX_VY,
+        &&label_OP_LD_I_LONG, &&label_OP_PLANE, &&label_OP_AUDIO, &&label_OP_PITCH,
+        &&label_OP_INVALID_8, &&label_OP_INVALID_F
+    };
+
+#define HANDLER(kind) label_##kind:
+#define REDISPATCH() goto *handlers[op->kind]
+#define NEXT()                              \
+    do {                                    \
+        if (remaining == 0)                 \
+            return cycles;                  \
+        remaining--;                        \
+        pc &= ADDRESS_MASK;                 \
+        TRACE_INSTRUCTION();                \
+        PROFILE_INSTRUCTION();              \
+        op = &decoded[pc];                  \
+        pc += 2;                            \
+        goto *handlers[op->kind];           \
+    } while (0)
+
+    NEXT();
+#else
+#define HANDLER(kind) case kind:
+#define REDISPATCH() goto redispatch
+#define NEXT() continue
+
+    for (;;) {
+        if (remaining == 0)
+            return cycles;
+        remaining--;
+        pc &= ADDRESS_MASK;
+        TRACE_INSTRUCTION();
+        PROFILE_INSTRUCTION();
+        op = &decoded[pc];
+        pc += 2;
+
+    redispatch:
+        switch (op->kind) {
+#endif
+
+    HANDLER(OP_UNDECODED)
+        decode(static_cast<unsigned short>(pc - 2));
+        REDISPATCH();
+
+    HANDLER(OP_SYS)
+        NEXT();
+
+    HANDLER(OP_CLS)
         clear_display();
-    } else if (opcode == 0x00EE) {
+        NEXT();
+
+    HANDLER(OP_RET)
+        if (sp == 0) {
+            FAULT(FAULT_STACK_UNDERFLOW);
+        }
         return_from_subroutine();
+        NEXT();
+
+    HANDLER(OP_JP)
+        // Jumps to itself and back to a delay timer poll may be waiting
+        if (waits_after_jump(static_cast<unsigned short>(pc - 2), op->nnn)) {
+            pc = op->nnn;
+            unsigned long idle = idle_cycles(remaining);
+            if (idle != 0) {
+                remaining -= idle;
+                waiting = true;
+            }
+            NEXT();
+        }
+        pc = op->nnn;
+        NEXT();
+
+    HANDLER(OP_CALL)
+        if (sp == stack.size()) {
+            FAULT(FAULT_STACK_OVERFLOW);
+        }
+        call_subroutine(op->nnn);
+        NEXT();
+
+    HANDLER(OP_SE_VX_NN)
+        if (regs[op->x] == op->nn) {
+            skip_next();
+        }
+        NEXT();
+
+    HANDLER(OP_SNE_VX_NN)
+        if (regs[op->x] != op->nn) {
+            skip_next();
+        }
+        NEXT();
+
+    HANDLER(OP_SE_VX_VY)
+        if (regs[op->x] == regs[op->y]) {
+            skip_next();
+        }
+        NEXT();
+
+    HANDLER(OP_LD_VX_NN)
+        regs[op->x] = op->nn;
+        NEXT();
+
+    HANDLER(OP_ADD_VX_NN)
+        regs[op->x] += op->nn;
+        NEXT();
+
+    HANDLER(OP_LD_VX_VY)
+        regs[op->x] = regs[op->y];
+        NEXT();
+
+    HANDLER(OP_OR)
+        regs[op->x] |= regs[op->y];
+        NEXT();
+
+    HANDLER(OP_AND)
+        regs[op->x] &= regs[op->y];
+        NEXT();
+
+    HANDLER(OP_XOR)
+        regs[op->x] ^= regs[op->y];
+        NEXT();
+
+    HANDLER(OP_ADD_VX_VY)
+        regs[op->x] += regs[op->y];
+        NEXT();
+
+    HANDLER(OP_SUB)
+        regs[op->x] -= regs[op->y];
+        NEXT();
+
+    HANDLER(OP_SHR)
+        if (Quirks & QUIRK_SHIFT_VY) {
+            regs[op->x] = regs[op->y] >> 1;
+        } else {
+            regs[op->x] >>= 1;
+        }
+        NEXT();
+
+    HANDLER(OP_SUBN)
+        regs[op->x] = static_cast<unsigned char>(regs[op->y] - regs[op->x]);
+        NEXT();
+
+    HANDLER(OP_SHL)
+        if (Quirks & QUIRK_SHIFT_VY) {
+            regs[op->x] = static_cast<unsigned char>(regs[op->y] << 1);
+        } else {
+            regs[op->x] = static_cast<unsigned char>(regs[op->x] << 1);
+        }
+        NEXT();
+
+    HANDLER(OP_SNE_VX_VY)
+        if (regs[op->x] != regs[op->y]) {
+            skip_next();
+        }
+        NEXT();
+
+    HANDLER(OP_LD_I)
+        I = op->nnn;
+        NEXT();
+
+    HANDLER(OP_JP_V0)
+        if (Quirks & QUIRK_JUMP_VX) {
+            pc = static_cast<unsigned short>(regs[op->x] + op->nnn);
+        } else {
+            pc = static_cast<unsigned short>(regs[0] + op->nnn);
+        }
+        NEXT();
+
+    HANDLER(OP_RND)
+        regs[op->x] = static_cast<unsigned char>(next_random() & op->nn);
+        NEXT();
+
+    HANDLER(OP_DRW)
+        draw_sprite(op->x, op->y, op->n, Quirks & QUIRK_CLIP_SPRITES);
+        NEXT();
+
+    HANDLER(OP_SKP)
+        if (keys[regs[op->x] & 0xF]) {
+            skip_next();
+        }
+        NEXT();
+
+    HANDLER(OP_SKNP)
+        if (!keys[regs[op->x] & 0xF]) {
+            skip_next();
+        }
+        NEXT();
+
+    HANDLER(OP_LD_VX_DT)
+        regs[op->x] = delay_timer;
+        NEXT();
+
+    HANDLER(OP_LD_VX_K)
+        // Keys only change between runs, so there is no point retrying
+        if (!wait_for_key(op->x)) {
+            remaining = 0;
+            waiting = true;
+        }
+        NEXT();
+
+    HANDLER(OP_LD_DT_VX)
+        delay_timer = regs[op->x];
+        NEXT();
+
+    HANDLER(OP_LD_ST_VX)
+        sound_timer = regs[op->x];
+        NEXT();
+
+    HANDLER(OP_ADD_I_VX)
+        I += regs[op->x];
+        NEXT();
+
+    HANDLER(OP_LD_F_VX)
+        // Chars 0-F are represented by a 4x5 font.
+        I = static_cast<unsigned short>(regs[op->x] * 5);
+        NEXT();
+
+    HANDLER(OP_LD_B_VX)
+        store_bcd(op->x);
+        NEXT();
+
+    HANDLER(OP_LD_MEM_VX)
+        store_registers(op->x);
+        if (Quirks & QUIRK_LOAD_STORE_INCREMENT) {
+            I = static_cast<unsigned short>(I + op->x + 1);
+        }
+        NEXT();
+
+    HANDLER(OP_LD_VX_MEM)
+        load_registers(op->x);
+        if (Quirks & QUIRK_LOAD_STORE_INCREMENT) {
+            I = static_cast<unsigned short>(I + op->x + 1);
+        }
+        NEXT();
+
+    HANDLER(OP_SCD)
+        gfx.scroll_down(op->n);
+        NEXT();
+
+    HANDLER(OP_SCR)
+        gfx.scroll_right(4);
+        NEXT();
+
+    HANDLER(OP_SCL)
+        gfx.scroll_left(4);
+        NEXT();
+
+    HANDLER(OP_EXIT)
+        FAULT(FAULT_EXIT);
+
+    HANDLER(OP_LOW)
+        gfx.set_hires(false);
+        NEXT();
+
+    HANDLER(OP_HIGH)
+        gfx.set_hires(true);
+        NEXT();
+
+    HANDLER(OP_LD_HF_VX)
+        // Chars 0-F of the 8x10 font
+        I = static_cast<unsigned short>(BIG_FONT_ADDRESS + (regs[op->x] & 0xF) * 10);
+        NEXT();
+
+    HANDLER(OP_LD_R_VX)
+        std::copy(regs.begin(), regs.begin() + op->x + 1, rpl_flags.begin());
+        NEXT();
+
+    HANDLER(OP_LD_VX_R)
+        std::copy(rpl_flags.begin(), rpl_flags.begin() + op->x + 1, regs.begin());
+        NEXT();
+
+    HANDLER(OP_SCU)
+        gfx.scroll_up(op->n);
+        NEXT();
+
+    HANDLER(OP_SAVE_VX_VY)
+        store_register_range(op->x, op->y);
+        NEXT();
+
+    HANDLER(OP_LOAD_VX_VY)
+        load_register_range(op->x, op->y);
+        NEXT();
+
+    HANDLER(OP_LD_I_LONG)
+        I = op->nnn;
+        pc += 2;
+        NEXT();
+
+    HANDLER(OP_PLANE)
+        gfx.select_planes(op->x);
+        NEXT();
+
+    HANDLER(OP_AUDIO)
+        load_audio_pattern();
+        NEXT();
+
+    HANDLER(OP_PITCH)
+        pitch = regs[op->x];
+        NEXT();
+
+    HANDLER(OP_INVALID_8)
+        FAULT(FAULT_INVALID_OPCODE);
+
+    HANDLER(OP_INVALID_F)
+        FAULT(FAULT_INVALID_OPCODE);
+
+#if !CHIP8_THREADED_DISPATCH
+            default:
+                NEXT();
+        }
     }
+#endif
 }
 
-void inline Chip8::handle_opcode_1(unsigned short opcode) {
-    // Opcode: 1NNN
-    // Only one possible opcode: jump to address NNN
-    pc = opcode & 0x0FFF;
-}
+#undef HANDLER
+#undef REDISPATCH
+#undef NEXT
+#undef FAULT
+#undef TRACE_INSTRUCTION
+#undef PROFILE_INSTRUCTION
 
-void Chip8::clear_display() {
-    gfx.fill(0);
+#if CHIP8_THREADED_DISPATCH && defined(__clang__)
+#pragma clang diagnostic pop
+#endif
+
+unsigned long Chip8::run(unsigned long cycles) {
+    typedef unsigned long (Chip8::*RunFunction)(unsigned long);
+    // One specialized interpreter per combination of quirks
+    static const RunFunction runners[QUIRK_COMBINATIONS] = {
+        &Chip8::run_quirks<0>, &Chip8::run_quirks<1>, &Chip8::run_quirks<2>, &Chip8::run_quirks<3>,
+        &Chip8::run_quirks<4>, &Chip8::run_quirks<5>, &Chip8::run_quirks<6>, &Chip8::run_quirks<7>,
+        &Chip8::run_quirks<8>, &Chip8::run_quirks<9>, &Chip8::run_quirks<10>, &Chip8::run_quirks<11>,
+        &Chip8::run_quirks<12>, &Chip8::run_quirks<13>, &Chip8::run_quirks<14>, &Chip8::run_quirks<15>
+    };
+    static_assert(QUIRK_COMBINATIONS == 16, "one runner per combination of quirks");
+
+    return (this->*runners[quirk_flags])(cycles);
 }
 
-void inline Chip8::handle_opcode_2(unsigned short opcode) {
-    // Opcode: 2NNN
-    // Only one possible opcode: calls subroutine at address NNN.
-    call_subroutine(opcode & 0x0FFF);
+void Chip8::set_quirks(unsigned int quirks) {
+    quirk_flags = quirks & (QUIRK_COMBINATIONS - 1);
 }
 
-void inline Chip8::handle_opcode_3(unsigned short opcode) {
-    // Opcode: 0x3XNN
-    // Only one possible opcode: `if (Vx == NN)`
-    unsigned short X = (opcode & 0x0F00) >> 8;
-    unsigned short NN = opcode & 0x00FF;
+unsigned int Chip8::quirks() const {
+    return quirk_flags;
+}
 
-    if (regs[X] == NN) {
-        pc += 2;
-    }
+bool Chip8::faulted() const {
+    return last_fault.kind != FAULT_NONE;
 }
 
-void inline Chip8::handle_opcode_4(unsigned short opcode) {
-    // Opcode: 0x4XNN
-    // Only one possible opcode: `if (Vx != NN)`
-    unsigned short X = (opcode & 0x0F00) >> 8;
-    unsigned short NN = opcode & 0x00FF;
+const Fault& Chip8::fault() const {
+    return last_fault;
+}
 
-    if (regs[X] != NN) {
-        pc += 2;
-    }
+bool Chip8::idle() const {
+    return waiting;
 }
 
-void inline Chip8::handle_opcode_5(unsigned short opcode) {
-    // Opcode: 0x5XY0
-    // Only one possible opcode: `if (Vx == Vy)`
-    unsigned short X = (opcode & 0x0F00) >> 8;
-    unsigned short Y = (opcode & 0x00F0) >> 4;
+unsigned long Chip8::idle_cycles(unsigned long remaining) const {
+    unsigned short addr = pc & ADDRESS_MASK;
+    unsigned short opcode = static_cast<unsigned short>((memory[addr] << 8) | memory[(addr + 1) & ADDRESS_MASK]);
 
-    if (regs[X] == regs[Y]) {
-        pc += 2;
+    // 1NNN jumping to itself
+    if ((opcode & 0xF000) == 0x1000 && (opcode & 0x0FFF) == addr) {
+        return remaining;
     }
-}
 
-void inline Chip8::handle_opcode_6(unsigned short opcode) {
-    // Opcode: 0x6XNN
-    // Only one possible opcode: `Vx = NN`
-    unsigned short X = (opcode & 0x0F00) >> 8;
-    unsigned short NN = opcode & 0x00FF;
+    // FX0A with no key held
+    if ((opcode & 0xF0FF) == 0xF00A && std::none_of(keys.begin(), keys.end(), [](unsigned char key) { return key != 0; })) {
+        return remaining;
+    }
+
+    // FX07, 3XNN or 4XNN, and 1NNN back to the FX07: polling the delay
+    // timer, which cannot change before the next tick. Once VX holds the
+    // timer and the skip is not taken, every pass leaves the machine as it
+    // was, so whole passes can be skipped.
+    if ((opcode & 0xF0FF) == 0xF007) {
+        unsigned char X = (opcode & 0x0F00) >> 8;
+        unsigned short skip = static_cast<unsigned short>(
+            (memory[(addr + 2) & ADDRESS_MASK] << 8) | memory[(addr + 3) & ADDRESS_MASK]);
+        unsigned short jump = static_cast<unsigned short>(
+            (memory[(addr + 4) & ADDRESS_MASK] << 8) | memory[(addr + 5) & ADDRESS_MASK]);
 
-    regs[X] = static_cast<unsigned char>(NN);
+        if (jump != (0x1000 | addr) || ((skip & 0x0F00) >> 8) != X || regs[X] != delay_timer) {
+            return 0;
+        }
+        unsigned char NN = static_cast<unsigned char>(skip & 0x00FF);
+        bool stays = ((skip & 0xF000) == 0x3000 && delay_timer != NN)
+            || ((skip & 0xF000) == 0x4000 && delay_timer == NN);
+        if (stays) {
+            return remaining - remaining % 3;
+        }
+    }
+
+    return 0;
 }
 
-void inline Chip8::handle_opcode_7(unsigned short opcode) {
-    // Opcode: 0x7XNN
-    // Only one possible opcode: `Vx = NN`
-    unsigned short X = (opcode & 0x0F00) >> 8;
-    unsigned short NN = opcode & 0x00FF;
+bool Chip8::waits_after_jump(unsigned short from, unsigned short target) const {
+    return target == from || ((memory[target] & 0xF0) == 0xF0 && memory[(target + 1) & ADDRESS_MASK] == 0x07);
+}
 
-    regs[X] += NN;
+unsigned long Chip8::raise_fault(FaultKind kind, unsigned long executed) {
+    // Leave the PC on the faulting instruction
+    pc = static_cast<unsigned short>((pc - 2) & ADDRESS_MASK);
+    last_fault.kind = kind;
+    last_fault.pc = pc;
+    last_fault.opcode = static_cast<unsigned short>((memory[pc] << 8) | memory[(pc + 1) & ADDRESS_MASK]);
+    return executed;
 }
 
-void Chip8::handle_opcode_8(unsigned short opcode) {
-    // Opcode: 0x8XYN
-    unsigned short X = (opcode & 0x0F00) >> 8;
-    unsigned short Y = (opcode & 0x00F0) >> 4;
-    unsigned short N = opcode & 0x000F;
+std::string describe_fault(const Fault& fault) {
+    std::ostringstream out;
+    out << std::hex << std::uppercase << std::setfill('0');
 
-    switch (N) {
-        case 0x0:
-            regs[X] = regs[Y];
+    switch (fault.kind) {
+        case FAULT_NONE:
+            return "No fault";
+        case FAULT_INVALID_OPCODE:
+            out << "Invalid opcode " << std::setw(4) << fault.opcode;
             break;
-        case 0x1:
-            regs[X] = regs[X] | regs[Y];
+        case FAULT_STACK_OVERFLOW:
+            out << "No place on stack for return address";
             break;
-        case 0x2:
-            regs[X] = regs[X] & regs[Y];
+        case FAULT_STACK_UNDERFLOW:
+            out << "Nowhere to return to on stack";
             break;
-        case 0x3:
-            regs[X] = regs[X] ^ regs[Y];
+        case FAULT_EXIT:
+            out << "Program exited";
             break;
-        case 0x4:
-            regs[X] += regs[Y];
-            break;
-        case 0x5:
-            regs[X] -= regs[Y];
-            break;
-        case 0x6:
-            regs[X] >>= 1;
-            break;
-        case 0x7:
-            regs[X] = regs[Y] - regs[X];
-            break;
-        case 0xE:
-            regs[X] <<= 1;
-            break;
-        default:
-            throw std::runtime_error("Invalid opcode 8XYN encountered!");
     }
+    out << " at 0x" << std::setw(3) << fault.pc;
+    return out.str();
 }
 
-void inline Chip8::handle_opcode_9(unsigned short opcode) {
-    // Opcode: 0x9XY0
-    // Only one possible opcode: `if (Vx != Vy)`
-    unsigned short X = (opcode & 0x0F00) >> 8;
-    unsigned short Y = (opcode & 0x00F0) >> 4;
+uint32_t Chip8::random_state() const {
+    return rng_state;
+}
 
-    if (regs[X] != regs[Y]) {
-        pc += 2;
+void Chip8::set_random_state(uint32_t state) {
+    // xorshift never leaves 0, so that one seed is remapped
+    rng_state = state != 0 ? state : DEFAULT_SEED;
+}
+
+void Chip8::seed_random(uint32_t seed) {
+    set_random_state(scramble_seed(seed));
+}
+
+void Chip8::save(Snapshot& snapshot) const {
+    snapshot.magic = SNAPSHOT_MAGIC;
+    snapshot.version = SNAPSHOT_VERSION;
+    snapshot.reserved = 0;
+    snapshot.size = sizeof(Snapshot);
+
+    snapshot.regs = regs;
+    snapshot.stack = stack;
+    snapshot.I = I;
+    snapshot.pc = pc;
+    snapshot.sp = sp;
+    snapshot.delay_timer = delay_timer;
+    snapshot.sound_timer = sound_timer;
+    snapshot.sounding = sounding;
+    snapshot.pitch = pitch;
+    snapshot.rng_state = rng_state;
+    snapshot.quirks = quirk_flags;
+    snapshot.fault = last_fault;
+    snapshot.keys = keys;
+    snapshot.rpl_flags = rpl_flags;
+    snapshot.audio_pattern = audio_pattern;
+    snapshot.gfx = gfx;
+
+    // Keep the snapshot's memory past what is copied zero
+    if (snapshot.memory_used > memory_used) {
+        std::fill(snapshot.memory.begin() + static_cast<long>(memory_used),
+                  snapshot.memory.begin() + static_cast<long>(snapshot.memory_used), 0);
     }
+    std::memcpy(snapshot.memory.data(), memory.data(), memory_used);
+    snapshot.memory_used = static_cast<uint32_t>(memory_used);
 }
 
-void inline Chip8::handle_opcode_A(unsigned short opcode) {
-    // Opcode: ANNN
-    // Only one possible opcode: `I = NNN`.
-    I = opcode & 0x0FFF;
+void Chip8::restore(const Snapshot& snapshot) {
+    // Compare a word at a time and only decode again what changed; most
+    // restores go back a frame or two and change little memory, if any
+    unsigned long used = std::max<unsigned long>(memory_used, snapshot.memory_used);
+    for (unsigned long addr = 0; addr < used; addr += sizeof(uint64_t)) {
+        uint64_t current;
+        uint64_t saved;
+        std::memcpy(&current, &memory[addr], sizeof(uint64_t));
+        std::memcpy(&saved, &snapshot.memory[addr], sizeof(uint64_t));
+        if (current != saved) {
+            std::memcpy(&memory[addr], &saved, sizeof(uint64_t));
+            for (unsigned long i = 0; i < sizeof(uint64_t); i++) {
+                invalidate(static_cast<unsigned short>(addr + i));
+            }
+        }
+    }
+    memory_used = snapshot.memory_used;
+
+    regs = snapshot.regs;
+    stack = snapshot.stack;
+    I = snapshot.I;
+    pc = snapshot.pc;
+    sp = snapshot.sp;
+    delay_timer = snapshot.delay_timer;
+    sound_timer = snapshot.sound_timer;
+    sounding = snapshot.sounding;
+    pitch = snapshot.pitch;
+    rng_state = snapshot.rng_state;
+    set_quirks(snapshot.quirks);
+    last_fault = snapshot.fault;
+    keys = snapshot.keys;
+    rpl_flags = snapshot.rpl_flags;
+    audio_pattern = snapshot.audio_pattern;
+    gfx = snapshot.gfx;
+    waiting = false;
 }
 
-void inline Chip8::handle_opcode_B(unsigned short opcode) {
-    // Opcode: BNNN
-    // Only one possible opcode: `PC = V0 + NNN`.
-    pc = regs[0] + (opcode & 0x0FFF);
+unsigned char Chip8::next_random() {
+    // xorshift32, each instance has its own state so that runs are
+    // reproducible and instances can run on different threads
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return static_cast<unsigned char>(rng_state >> 24);
 }
 
-void Chip8::handle_opcode_C(unsigned short opcode) {
-    // Opcode: CXNN
-    // Only one possible opcode: `Vx = rand() & NN`.
-    unsigned short X = (opcode & 0x0F00) >> 8;
-    unsigned short NN = opcode & 0x00FF;
+void Chip8::clear_display() {
+    gfx.clear();
+}
 
-    regs[X] = static_cast<unsigned char>((rand() % 256) & NN);
+void Chip8::skip_next() {
+    // F000 NNNN is the only instruction that is four bytes long
+    bool long_load = memory[pc] == 0xF0 && memory[(pc + 1) & ADDRESS_MASK] == 0x00;
+    pc = static_cast<unsigned short>(pc + (long_load ? 4 : 2));
 }
 
-void Chip8::handle_opcode_D(unsigned short opcode) {
+void Chip8::draw_sprite(unsigned char X, unsigned char Y, unsigned char N, bool clip) {
     // Opcode: DXYN
-    // Only one possible opcode: `draw(Vx, Vy, N)`.
-    unsigned short X = (opcode & 0x0F00) >> 8;
-    unsigned short Y = (opcode & 0x00F0) >> 4;
-    unsigned short N = opcode & 0x000F;
-
-    unsigned short start_col = regs[X];
-    unsigned short start_row = regs[Y];
-
-    regs[15] = 0;
-    for (unsigned short i = 0; i < N; i++) {
-        unsigned short mem_value = memory[I + i];
-        unsigned short row = start_row + i;
-
-        for (unsigned short j = 0; j < 8; j++) {
-            unsigned short col = start_col + j;
-            unsigned short pixel = (mem_value & (0x80 >> j)) >> (7 - j);
-            unsigned short gfx_index = (col % 64) + (row % 32) * 64;
-            unsigned short gfx_value = gfx[gfx_index];
-            unsigned short xored = gfx_value ^ pixel;
-
-            regs[15] |= gfx_value && pixel;
-            gfx[gfx_index] = static_cast<unsigned char>(xored);
+    // Draws an 8xN sprite from memory at I to (Vx, Vy), or a 16x16 sprite
+    // of two bytes per row for DXY0. Every selected plane gets its own
+    // sprite, stored one after the other. VF is set if any lit pixel was
+    // cleared.
+    // Sprites wrap around the screen edges. With clip only the starting
+    // position wraps; the parts past the right and bottom edges are not
+    // drawn.
+    unsigned int col = regs[X];
+    unsigned int row = regs[Y];
+    bool collision = false;
+
+    // Plain CHIP-8 drawing, by far the most common
+    if (N != 0 && !clip && !gfx.hires() && gfx.selected_planes() == 1) {
+        Display::LoresPlane& plane = gfx.lores_plane(0);
+        for (unsigned short i = 0; i < N; i++) {
+            collision |= plane.draw_row(col, row + i, memory[(I + i) & ADDRESS_MASK]);
         }
+        regs[15] = collision;
+        return;
     }
-}
 
-void Chip8::handle_opcode_E(unsigned short opcode) {
-    // Opcode: EX9E or EXA1
-    unsigned short X = (opcode & 0x0F00) >> 8;
-    if ((opcode & 0x00FF) == 0x009E) {
-        if (keys[regs[X]]) {
-            pc += 2;
+    if (clip) {
+        col %= gfx.width();
+        row %= gfx.height();
+    }
+
+    unsigned int bytes_per_row = N == 0 ? 2 : 1;
+    unsigned int height = N == 0 ? 16 : N;
+    unsigned short addr = I;
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (!(gfx.selected_planes() & (1 << plane))) {
+            continue;
         }
-    } else {
-        if (!keys[regs[X]]) {
-            pc += 2;
+        for (unsigned int i = 0; i < height; i++) {
+            for (unsigned int byte = 0; byte < bytes_per_row; byte++) {
+                collision |= gfx.draw_row(plane, col + 8 * byte, row + i, memory[addr & ADDRESS_MASK], clip);
+                addr++;
+            }
         }
     }
+    regs[15] = collision;
 }
 
-void Chip8::handle_opcode_F(unsigned short opcode) {
-    // Opcode: FXNN
-    unsigned short X = (opcode & 0x0F00) >> 8;
-    unsigned short NN = opcode & 0x00FF;
+bool Chip8::wait_for_key(unsigned char X) {
+    // Opcode: FX0A
+    // Wait for key press, then store in Vx
+    // BLOCKING OPERATION
+    for (unsigned long i = 0; i < keys.size(); i++) {
+        if (keys[i] != 0) {
+            regs[X] = static_cast<unsigned char>(i);
+            return true;
+        }
+    }
 
-    switch (NN) {
-        case 0x07:
-            regs[X] = delay_timer;
-            break;
-        case 0x0A: {
-            // Wait for key press, then store in Vx
-            // BLOCKING OPERATION
+    // Rerun instruction until key is pressed
+    pc -= 2;
+    return false;
+}
 
-            bool key_pressed = false;
+void Chip8::store_bcd(unsigned char X) {
+    // Opcode: FX33
+    // Stores the BCD representation of Vx at I
+    unsigned char value = regs[X];
 
-            for (unsigned long i = 0; i < keys.size(); i++) {
-                if (keys[i] != 0) {
-                    regs[X] = static_cast<unsigned char>(i);
-                    key_pressed = true;
-                    break;
-                }
-            }
+    unsigned char ones = value % 10;
+    value = value / 10;
+    unsigned char tens = value % 10;
+    unsigned char hundreds = value / 10;
 
-            // Rerun instruction until key is pressed
-            if (!key_pressed)
-                pc -= 2;
+    const unsigned char digits[3] = {hundreds, tens, ones};
+    for (unsigned short i = 0; i < 3; i++) {
+        unsigned short addr = static_cast<unsigned short>((I + i) & ADDRESS_MASK);
+        memory[addr] = digits[i];
+        invalidate(addr);
+    }
+}
 
-            break;
-        }
-        case 0x15:
-            delay_timer = regs[X];
-            break;
-        case 0x18:
-            sound_timer = regs[X];
-            break;
-        case 0x1E:
-            I += regs[X];
-            break;
-        case 0x29:
-            // Sets I to location of sprite for char in Vx
-            // Chars 0-F are represented by a 4x5 font.
-            printf("%x %x\n", X, regs[X]);
-            I = regs[X] * 5;
-            break;
-        case 0x33: {
-            // Stores the BCD representation of Vx at I
-            unsigned char value = regs[X];
+void Chip8::store_registers(unsigned char X) {
+    // Opcode: FX55
+    // Stores V0 to Vx in memory starting at address I.
+    // I is left unmodified.
+    for (unsigned short i = 0; i <= X; i++) {
+        unsigned short addr = static_cast<unsigned short>((I + i) & ADDRESS_MASK);
+        memory[addr] = regs[i];
+        invalidate(addr);
+    }
+}
 
-            unsigned char ones = value % 10;
-            value = value / 10;
-            unsigned char tens = value % 10;
-            unsigned char hundreds = value / 10;
+void Chip8::load_registers(unsigned char X) {
+    // Opcode: FX65
+    // Fills V0 to Vx with values in memory starting at address I.
+    // I is left unmodified.
+    for (unsigned short i = 0; i <= X; i++) {
+        regs[i] = memory[(I + i) & ADDRESS_MASK];
+    }
+}
 
-            memory[I] = hundreds;
-            memory[I + 1] = tens;
-            memory[I + 2] = ones;
+void Chip8::store_register_range(unsigned char X, unsigned char Y) {
+    // Opcode: 5XY2
+    // Stores Vx to Vy in memory starting at address I, in that order even
+    // if x is greater than y. I is left unmodified.
+    int step = X <= Y ? 1 : -1;
+    unsigned int count = static_cast<unsigned int>(X <= Y ? Y - X : X - Y) + 1;
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned short addr = static_cast<unsigned short>((I + i) & ADDRESS_MASK);
+        memory[addr] = regs[static_cast<unsigned int>(X + step * static_cast<int>(i))];
+        invalidate(addr);
+    }
+}
 
-            break;
-        }
-        case 0x55:
-            // Stores V0 to Vx in memory starting at address I.
-            // I is left unmodified.
-            for (unsigned long i = 0; i <= X; i++) {
-                memory[I + i] = regs[i];
-            }
-            break;
-        case 0x65:
-            // Fills V0 to Vx with values in memory starting at address I.
-            // I is left unmodified.
-            for (unsigned long i = 0; i <= X; i++) {
-                regs[i] = memory[I + i];
-            }
-            break;
-        default:
-            throw std::runtime_error("Invalid opcode FXNN encountered!");
+void Chip8::load_register_range(unsigned char X, unsigned char Y) {
+    // Opcode: 5XY3
+    // Fills Vx to Vy with values in memory starting at address I.
+    // I is left unmodified.
+    int step = X <= Y ? 1 : -1;
+    unsigned int count = static_cast<unsigned int>(X <= Y ? Y - X : X - Y) + 1;
+    for (unsigned int i = 0; i < count; i++) {
+        regs[static_cast<unsigned int>(X + step * static_cast<int>(i))] = memory[(I + i) & ADDRESS_MASK];
     }
 }
 
-void Chip8::call_subroutine(unsigned short addr) {
-    if (sp == 16) {
-        throw std::runtime_error("No place on stack for return address!");
+void Chip8::load_audio_pattern() {
+    // Opcode: F002
+    // Loads the 128 bit sound pattern from memory at I.
+    for (unsigned short i = 0; i < audio_pattern.size(); i++) {
+        audio_pattern[i] = memory[(I + i) & ADDRESS_MASK];
     }
+}
 
+// The stack is checked by run() before calling or returning
+void Chip8::call_subroutine(unsigned short addr) {
     stack[sp++] = pc;
     pc = addr;
+#if CHIP8_PROFILE
+    profile.call(addr);
+#endif
 }
 
 void Chip8::return_from_subroutine() {
-    if (sp == 0) {
-        throw std::runtime_error("Nowhere to return to on stack!");
-    }
-
     pc = stack[--sp];
+#if CHIP8_PROFILE
+    profile.ret();
+#endif
 }
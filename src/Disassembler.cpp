@@ -0,0 +1,164 @@
+#include <cstdio>
+
+#include "Disassembler.h"
+
+std::string disassemble(unsigned short opcode) {
+    unsigned int X = (opcode & 0x0F00) >> 8;
+    unsigned int Y = (opcode & 0x00F0) >> 4;
+    unsigned int N = opcode & 0x000F;
+    unsigned int NN = opcode & 0x00FF;
+    unsigned int NNN = opcode & 0x0FFF;
+
+    char text[32];
+
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            if ((opcode & 0xFFF0) == 0x00C0) {
+                snprintf(text, sizeof(text), "SCD %u", N);
+                break;
+            } else if ((opcode & 0xFFF0) == 0x00D0) {
+                snprintf(text, sizeof(text), "SCU %u", N);
+                break;
+            }
+            switch (opcode) {
+                case 0x00E0: return "CLS";
+                case 0x00EE: return "RET";
+                case 0x00FB: return "SCR";
+                case 0x00FC: return "SCL";
+                case 0x00FD: return "EXIT";
+                case 0x00FE: return "LOW";
+                case 0x00FF: return "HIGH";
+                default: break;
+            }
+            snprintf(text, sizeof(text), "SYS 0x%03X", NNN);
+            break;
+        case 0x1000:
+            snprintf(text, sizeof(text), "JP 0x%03X", NNN);
+            break;
+        case 0x2000:
+            snprintf(text, sizeof(text), "CALL 0x%03X", NNN);
+            break;
+        case 0x3000:
+            snprintf(text, sizeof(text), "SE V%X, 0x%02X", X, NN);
+            break;
+        case 0x4000:
+            snprintf(text, sizeof(text), "SNE V%X, 0x%02X", X, NN);
+            break;
+        case 0x5000:
+            if (N == 0x2) {
+                snprintf(text, sizeof(text), "SAVE V%X - V%X", X, Y);
+            } else if (N == 0x3) {
+                snprintf(text, sizeof(text), "LOAD V%X - V%X", X, Y);
+            } else {
+                snprintf(text, sizeof(text), "SE V%X, V%X", X, Y);
+            }
+            break;
+        case 0x6000:
+            snprintf(text, sizeof(text), "LD V%X, 0x%02X", X, NN);
+            break;
+        case 0x7000:
+            snprintf(text, sizeof(text), "ADD V%X, 0x%02X", X, NN);
+            break;
+        case 0x8000: {
+            const char* names[16] = {
+                "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr
+            };
+            if (names[N] == nullptr) {
+                snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+            } else {
+                snprintf(text, sizeof(text), "%s V%X, V%X", names[N], X, Y);
+            }
+            break;
+        }
+        case 0x9000:
+            snprintf(text, sizeof(text), "SNE V%X, V%X", X, Y);
+            break;
+        case 0xA000:
+            snprintf(text, sizeof(text), "LD I, 0x%03X", NNN);
+            break;
+        case 0xB000:
+            snprintf(text, sizeof(text), "JP V0, 0x%03X", NNN);
+            break;
+        case 0xC000:
+            snprintf(text, sizeof(text), "RND V%X, 0x%02X", X, NN);
+            break;
+        case 0xD000:
+            snprintf(text, sizeof(text), "DRW V%X, V%X, %u", X, Y, N);
+            break;
+        case 0xE000:
+            if (NN == 0x9E) {
+                snprintf(text, sizeof(text), "SKP V%X", X);
+            } else if (NN == 0xA1) {
+                snprintf(text, sizeof(text), "SKNP V%X", X);
+            } else {
+                snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+            }
+            break;
+        default:
+            switch (NN) {
+                case 0x00:
+                    // The address follows in the next word, which the
+                    // caller disassembles on its own
+                    if (X == 0) {
+                        return "LD I, LONG";
+                    }
+                    snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+                    break;
+                case 0x01:
+                    snprintf(text, sizeof(text), "PLANE %u", X);
+                    break;
+                case 0x02:
+                    if (X == 0) {
+                        return "AUDIO";
+                    }
+                    snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+                    break;
+                case 0x07:
+                    snprintf(text, sizeof(text), "LD V%X, DT", X);
+                    break;
+                case 0x0A:
+                    snprintf(text, sizeof(text), "LD V%X, K", X);
+                    break;
+                case 0x15:
+                    snprintf(text, sizeof(text), "LD DT, V%X", X);
+                    break;
+                case 0x18:
+                    snprintf(text, sizeof(text), "LD ST, V%X", X);
+                    break;
+                case 0x1E:
+                    snprintf(text, sizeof(text), "ADD I, V%X", X);
+                    break;
+                case 0x29:
+                    snprintf(text, sizeof(text), "LD F, V%X", X);
+                    break;
+                case 0x30:
+                    snprintf(text, sizeof(text), "LD HF, V%X", X);
+                    break;
+                case 0x33:
+                    snprintf(text, sizeof(text), "LD B, V%X", X);
+                    break;
+                case 0x3A:
+                    snprintf(text, sizeof(text), "PITCH V%X", X);
+                    break;
+                case 0x55:
+                    snprintf(text, sizeof(text), "LD [I], V%X", X);
+                    break;
+                case 0x65:
+                    snprintf(text, sizeof(text), "LD V%X, [I]", X);
+                    break;
+                case 0x75:
+                    snprintf(text, sizeof(text), "LD R, V%X", X);
+                    break;
+                case 0x85:
+                    snprintf(text, sizeof(text), "LD V%X, R", X);
+                    break;
+                default:
+                    snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+                    break;
+            }
+            break;
+    }
+
+    return text;
+}
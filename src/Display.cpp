@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <cstring>
+
+#include "Display.h"
+
+void Display::reset() {
+    hires_mode = false;
+    selected = 1;
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        lores_planes[plane].clear();
+        hires_planes[plane].clear();
+    }
+    mark_all_dirty();
+}
+
+void Display::set_hires(bool enabled) {
+    hires_mode = enabled;
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (hires_mode) {
+            hires_planes[plane].clear();
+        } else {
+            lores_planes[plane].clear();
+        }
+    }
+    // The whole window changes size, not just the rows that were lit
+    mark_all_dirty();
+}
+
+void Display::clear() {
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (!(selected & (1 << plane))) {
+            continue;
+        }
+        if (hires_mode) {
+            hires_planes[plane].clear();
+        } else {
+            lores_planes[plane].clear();
+        }
+    }
+}
+
+void Display::scroll_down(unsigned int n) {
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (!(selected & (1 << plane))) {
+            continue;
+        }
+        if (hires_mode) {
+            hires_planes[plane].scroll_down(n);
+        } else {
+            lores_planes[plane].scroll_down(n);
+        }
+    }
+}
+
+void Display::scroll_up(unsigned int n) {
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (!(selected & (1 << plane))) {
+            continue;
+        }
+        if (hires_mode) {
+            hires_planes[plane].scroll_up(n);
+        } else {
+            lores_planes[plane].scroll_up(n);
+        }
+    }
+}
+
+void Display::scroll_left(unsigned int n) {
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (!(selected & (1 << plane))) {
+            continue;
+        }
+        if (hires_mode) {
+            hires_planes[plane].scroll_left(n);
+        } else {
+            lores_planes[plane].scroll_left(n);
+        }
+    }
+}
+
+void Display::scroll_right(unsigned int n) {
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (!(selected & (1 << plane))) {
+            continue;
+        }
+        if (hires_mode) {
+            hires_planes[plane].scroll_right(n);
+        } else {
+            lores_planes[plane].scroll_right(n);
+        }
+    }
+}
+
+unsigned int Display::pixel(unsigned int x, unsigned int y) const {
+    unsigned int color = 0;
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        bool lit = hires_mode ? hires_planes[plane].pixel(x, y) : lores_planes[plane].pixel(x, y);
+        color |= static_cast<unsigned int>(lit) << plane;
+    }
+    return color;
+}
+
+bool Display::dirty() const {
+    return first_dirty_row() <= last_dirty_row();
+}
+
+unsigned int Display::first_dirty_row() const {
+    unsigned int first = height();
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        first = std::min(first, hires_mode ? hires_planes[plane].first_dirty_row()
+                                           : lores_planes[plane].first_dirty_row());
+    }
+    return first;
+}
+
+unsigned int Display::last_dirty_row() const {
+    unsigned int last = 0;
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        last = std::max(last, hires_mode ? hires_planes[plane].last_dirty_row()
+                                         : lores_planes[plane].last_dirty_row());
+    }
+    return last;
+}
+
+void Display::mark_clean() {
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        lores_planes[plane].mark_clean();
+        hires_planes[plane].mark_clean();
+    }
+}
+
+void Display::mark_all_dirty() {
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        lores_planes[plane].mark_all_dirty();
+        hires_planes[plane].mark_all_dirty();
+    }
+}
+
+// Combines the rows of both planes of one resolution into colors.
+template <typename Plane>
+static void expand_planes(const std::array<Plane, PLANE_COUNT>& planes, uint32_t* out,
+                          unsigned int first, unsigned int last, const std::array<uint32_t, 4>& palette) {
+    for (unsigned int i = first * Plane::WORDS_PER_ROW; i < (last + 1) * Plane::WORDS_PER_ROW; i++) {
+        uint64_t low = planes[0].rows()[i];
+        uint64_t high = planes[1].rows()[i];
+        for (unsigned int bit = 0; bit < 64; bit++) {
+            unsigned int shift = 63 - bit;
+            *out++ = palette[((low >> shift) & 1) | (((high >> shift) & 1) << 1)];
+        }
+    }
+}
+
+void Display::expand_rows_to_rgba(uint32_t* out, unsigned int first, unsigned int last,
+                                  const std::array<uint32_t, 4>& palette) const {
+    if (hires_mode) {
+        expand_planes(hires_planes, out, first, last, palette);
+    } else {
+        expand_planes(lores_planes, out, first, last, palette);
+    }
+}
+
+// Each bit of a byte, most significant first, as a byte of 0 or 1; and
+// each bit of a nibble as two such bytes. Built a byte at a time so that
+// they are right on any host.
+struct SpreadTables {
+    std::array<uint64_t, 256> bytes;
+    std::array<uint64_t, 16> doubled_nibbles;
+
+    SpreadTables() : bytes(), doubled_nibbles() {
+        for (unsigned int value = 0; value < 256; value++) {
+            unsigned char spread[8];
+            for (unsigned int bit = 0; bit < 8; bit++) {
+                spread[bit] = (value >> (7 - bit)) & 1;
+            }
+            std::memcpy(&bytes[value], spread, sizeof(spread));
+        }
+        for (unsigned int value = 0; value < 16; value++) {
+            unsigned char spread[8];
+            for (unsigned int bit = 0; bit < 8; bit++) {
+                spread[bit] = (value >> (3 - bit / 2)) & 1;
+            }
+            std::memcpy(&doubled_nibbles[value], spread, sizeof(spread));
+        }
+    }
+};
+
+static const SpreadTables spread_tables;
+
+void Display::expand_to_hires_colors(unsigned char* out) const {
+    if (hires_mode) {
+        for (unsigned int i = 0; i < hires_planes[0].rows().size(); i++) {
+            uint64_t low = hires_planes[0].rows()[i];
+            uint64_t high = hires_planes[1].rows()[i];
+            for (unsigned int byte = 0; byte < 8; byte++) {
+                unsigned int shift = 56 - 8 * byte;
+                uint64_t colors = spread_tables.bytes[(low >> shift) & 0xFF]
+                    | spread_tables.bytes[(high >> shift) & 0xFF] << 1;
+                std::memcpy(out, &colors, sizeof(colors));
+                out += sizeof(colors);
+            }
+        }
+        return;
+    }
+
+    // Every pixel twice, then the whole row again
+    const unsigned int width = HiresPlane::WIDTH;
+    for (unsigned int y = 0; y < LoresPlane::HEIGHT; y++) {
+        uint64_t low = lores_planes[0].rows()[y];
+        uint64_t high = lores_planes[1].rows()[y];
+        for (unsigned int nibble = 0; nibble < 16; nibble++) {
+            unsigned int shift = 60 - 4 * nibble;
+            uint64_t colors = spread_tables.doubled_nibbles[(low >> shift) & 0xF]
+                | spread_tables.doubled_nibbles[(high >> shift) & 0xF] << 1;
+            std::memcpy(out, &colors, sizeof(colors));
+            out += sizeof(colors);
+        }
+        std::memcpy(out, out - width, width);
+        out += width;
+    }
+}
+
+uint64_t Display::hash() const {
+    uint64_t h = hires_mode ? hires_planes[0].hash() : lores_planes[0].hash();
+
+    // The second plane only counts once something is drawn on it
+    bool second = hires_mode ? !hires_planes[1].empty() : !lores_planes[1].empty();
+    if (second) {
+        h ^= hires_mode ? hires_planes[1].hash() : lores_planes[1].hash();
+        h *= 0x100000001B3;
+    }
+    return h;
+}
+
+bool Display::valid() const {
+    // Any other byte in a bool is undefined behaviour once read as one
+    unsigned char mode;
+    std::memcpy(&mode, &hires_mode, sizeof(mode));
+    if (mode > 1 || (selected & ~((1u << PLANE_COUNT) - 1)) != 0) {
+        return false;
+    }
+
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (!lores_planes[plane].valid() || !hires_planes[plane].valid()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Display::operator==(const Display& other) const {
+    return hires_mode == other.hires_mode && selected == other.selected
+        && lores_planes == other.lores_planes && hires_planes == other.hires_planes;
+}
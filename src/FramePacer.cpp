@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <thread>
+
+#include "FramePacer.h"
+
+// How long before a deadline to stop sleeping and start spinning. Sleeps
+// overshoot by up to about this much.
+const std::chrono::microseconds SPIN_MARGIN(1000);
+// Longest wait for a present. A display that stops presenting, e.g. when
+// the window is hidden, only slows the machine down instead of stopping it.
+const std::chrono::milliseconds VSYNC_TIMEOUT(100);
+
+FrameTimes::FrameTimes() : samples(), count(0) {}
+
+void FrameTimes::add(std::chrono::nanoseconds time) {
+    samples[count % FRAME_TIME_WINDOW] = time.count();
+    count++;
+}
+
+std::chrono::nanoseconds FrameTimes::percentile(unsigned int p) const {
+    unsigned long size = std::min(count, FRAME_TIME_WINDOW);
+    if (size == 0) {
+        return std::chrono::nanoseconds(0);
+    }
+
+    std::array<int64_t, FRAME_TIME_WINDOW> sorted = samples;
+    unsigned long rank = std::min(size - 1, size * p / 100);
+    std::nth_element(sorted.begin(), sorted.begin() + static_cast<long>(rank), sorted.begin() + static_cast<long>(size));
+    return std::chrono::nanoseconds(sorted[rank]);
+}
+
+std::chrono::nanoseconds FrameTimes::max() const {
+    unsigned long size = std::min(count, FRAME_TIME_WINDOW);
+    return std::chrono::nanoseconds(size == 0 ? 0 : *std::max_element(samples.begin(), samples.begin() + static_cast<long>(size)));
+}
+
+FramePacer::FramePacer(std::chrono::nanoseconds frame_period)
+    : period(frame_period),
+      vsync_locked(false),
+      frame_start(std::chrono::steady_clock::now()),
+      deadline(frame_start),
+      frames(),
+      emulation(),
+      presents(0),
+      presents_seen(0) {}
+
+void FramePacer::lock_to_vsync(bool enabled) {
+    vsync_locked = enabled;
+}
+
+void FramePacer::wait() {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    emulation.add(now - frame_start);
+
+    if (vsync_locked) {
+        wait_for_vsync();
+    } else {
+        wait_for_deadline();
+    }
+
+    now = std::chrono::steady_clock::now();
+    frames.add(now - frame_start);
+    frame_start = now;
+}
+
+void FramePacer::wait_for_deadline() {
+    deadline += period;
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - deadline > period) {
+        deadline = now;
+        return;
+    }
+
+    if (deadline - now > SPIN_MARGIN) {
+        std::this_thread::sleep_until(deadline - SPIN_MARGIN);
+    }
+    while (std::chrono::steady_clock::now() < deadline) {
+        // Let other threads on this core run, the display's one especially
+        std::this_thread::yield();
+    }
+}
+
+void FramePacer::wait_for_vsync() {
+    std::unique_lock<std::mutex> lock(vsync_mutex);
+    vsync_signal.wait_for(lock, VSYNC_TIMEOUT, [this]() { return presents != presents_seen; });
+    presents_seen = presents;
+}
+
+void FramePacer::vsync() {
+    {
+        std::lock_guard<std::mutex> lock(vsync_mutex);
+        presents++;
+    }
+    vsync_signal.notify_one();
+}
+
+const FrameTimes& FramePacer::frame_times() const {
+    return frames;
+}
+
+const FrameTimes& FramePacer::emulation_times() const {
+    return emulation;
+}
@@ -0,0 +1,105 @@
+#include <fstream>
+#include <stdexcept>
+
+#include "InputMovie.h"
+
+void InputMovie::start(uint32_t seed, unsigned long instructions_per_frame, unsigned int quirks) {
+    header = MovieFileHeader();
+    header.magic = MOVIE_MAGIC;
+    header.version = MOVIE_VERSION;
+    header.event_size = sizeof(MovieEvent);
+    header.seed = seed;
+    header.instructions_per_frame = static_cast<uint32_t>(instructions_per_frame);
+    header.quirks = quirks;
+
+    events.clear();
+    last_keys = 0;
+    next = 0;
+}
+
+void InputMovie::record(unsigned long frame, const std::array<unsigned char, 16>& keys) {
+    uint16_t mask = 0;
+    for (unsigned int key = 0; key < keys.size(); key++) {
+        if (keys[key] != 0) {
+            mask = static_cast<uint16_t>(mask | (1 << key));
+        }
+    }
+
+    // Only changes are stored, most frames have none
+    if (mask != last_keys) {
+        events.push_back({static_cast<uint32_t>(frame), mask, 0});
+        last_keys = mask;
+    }
+}
+
+void InputMovie::finish(unsigned long frames, uint64_t final_hash) {
+    header.frames = static_cast<uint32_t>(frames);
+    header.final_hash = final_hash;
+    header.count = static_cast<uint32_t>(events.size());
+}
+
+void InputMovie::write(std::string path) const {
+    std::ofstream file(path, std::ios::out | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Unable to open movie file!");
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(events.data()),
+               static_cast<std::streamsize>(events.size() * sizeof(MovieEvent)));
+}
+
+void InputMovie::load(std::string path) {
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Unable to open movie file!");
+    }
+
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+            || header.magic != MOVIE_MAGIC
+            || header.version != MOVIE_VERSION
+            || header.event_size != sizeof(MovieEvent)) {
+        throw std::runtime_error("Not a movie file or unsupported version!");
+    }
+
+    events.resize(header.count);
+    if (!file.read(reinterpret_cast<char*>(events.data()),
+                   static_cast<std::streamsize>(events.size() * sizeof(MovieEvent)))) {
+        throw std::runtime_error("Movie file is truncated!");
+    }
+
+    last_keys = 0;
+    next = 0;
+}
+
+void InputMovie::apply(unsigned long frame, std::array<unsigned char, 16>& keys) {
+    while (next < events.size() && events[next].frame <= frame) {
+        last_keys = events[next].keys;
+        next++;
+    }
+
+    // The whole state is written so that no other input can leak in
+    for (unsigned int key = 0; key < keys.size(); key++) {
+        keys[key] = (last_keys >> key) & 1;
+    }
+}
+
+uint32_t InputMovie::seed() const {
+    return header.seed;
+}
+
+unsigned long InputMovie::instructions_per_frame() const {
+    return header.instructions_per_frame;
+}
+
+unsigned int InputMovie::quirks() const {
+    return header.quirks;
+}
+
+unsigned long InputMovie::frames() const {
+    return header.frames;
+}
+
+uint64_t InputMovie::final_hash() const {
+    return header.final_hash;
+}
@@ -0,0 +1,49 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "InputScript.h"
+
+void InputScript::load(std::string path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Unable to open input script!");
+    }
+
+    events.clear();
+    next = 0;
+
+    std::string line;
+    unsigned long line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        unsigned long frame;
+        unsigned int key;
+        std::string state;
+
+        if (!(fields >> frame >> std::hex >> key >> state) || key > 0xF
+                || (state != "down" && state != "up")) {
+            throw std::runtime_error("Malformed input script line " + std::to_string(line_number));
+        }
+
+        events.push_back({frame, static_cast<unsigned char>(key), state == "down"});
+    }
+
+    // Keep events in file order within a frame
+    std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+        return a.frame < b.frame;
+    });
+}
+
+void InputScript::apply(unsigned long frame, std::array<unsigned char, 16>& keys) {
+    while (next < events.size() && events[next].frame <= frame) {
+        keys[events[next].key] = events[next].pressed;
+        next++;
+    }
+}
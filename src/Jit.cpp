@@ -0,0 +1,998 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Jit.h"
+#include "Snapshot.h"
+
+#if CHIP8_JIT
+#include <sys/mman.h>
+#endif
+
+// Size of the executable buffer; all blocks are dropped when it fills up.
+const unsigned long CODE_BUFFER_SIZE = 1 << 20;
+// Longest block that is translated, in instructions.
+const unsigned short MAX_BLOCK_INSTRUCTIONS = 64;
+// Room made for a block's code up front, which most fit in.
+const unsigned long CODE_RESERVE = 1024;
+// Most cycles handed to one call into the translated code, which returns
+// the cycles left in the upper half of its result.
+const unsigned long MAX_CHAIN_CYCLES = 0xFFFFFFFF;
+
+// Host registers, by x86-64 encoding number
+const int RAX = 0;
+const int RCX = 1;
+const int RDX = 2;
+const int RSI = 6;
+const int RDI = 7;
+
+// Guest registers are cached in these caller-saved host registers:
+// rcx, rdx, r8, r9, r10, r11. rdi holds the Chip8 pointer, rsi the cycles
+// left and rax is scratch and the return value.
+const std::array<int, 6> HOST_POOL = {{1, 2, 8, 9, 10, 11}};
+
+// Slot of I in the register cache, after V0-VF.
+const unsigned int SLOT_I = 16;
+
+// Condition codes, for jcc and cmovcc
+const unsigned char ABOVE_OR_EQUAL = 0x3;
+const unsigned char EQUAL = 0x4;
+const unsigned char NOT_EQUAL = 0x5;
+const unsigned char BELOW_OR_EQUAL = 0x6;
+
+// Returns to Jit::run() from the translated code, with the next PC in eax,
+// one past the address of the 1NNN that led there (or 0) in edx and the
+// cycles left in rsi:
+//   shl rdx, 16; or rax, rdx; shl rsi, 32; or rax, rsi; ret
+const std::array<unsigned char, 15> LEAVE_CODE = {{
+    0x48, 0xC1, 0xE2, 0x10, 0x48, 0x09, 0xD0, 0x48, 0xC1, 0xE6, 0x20, 0x48, 0x09, 0xF0, 0xC3
+}};
+
+// Where the translated code finds the machine's state, relative to the
+// Chip8 pointer, and the JIT's own code and tables.
+struct Layout {
+    int regs;
+    int I;
+    int delay;
+    int sound;
+    int memory;
+    // The code behind LEAVE_CODE
+    unsigned long leave;
+    // Jit::links
+    unsigned long links;
+    // Jit::write() and Jit::step(), and the Jit they are called with
+    unsigned long write;
+    unsigned long step;
+    unsigned long jit;
+};
+
+// Emits the native code of one block.
+class Translator {
+    public:
+        Translator(unsigned int quirk_flags, const Layout& addresses)
+            : count(0),
+              ended(false),
+              quirks(quirk_flags),
+              layout(addresses),
+              budget_at(0) {
+            code.reserve(CODE_RESERVE);
+            host.fill(-1);
+            dirty.fill(false);
+        }
+
+        std::vector<unsigned char> code;
+        // Instructions translated so far
+        unsigned short count;
+        bool ended;
+
+        // Emits the start of the block at addr, which leaves unless there
+        // are cycles for all of it.
+        void enter(unsigned short addr);
+        // Emits code for the instruction at addr, followed by next_opcode.
+        // Returns false, emitting nothing, if it has to be left to the
+        // interpreter.
+        bool translate(unsigned short opcode, unsigned short addr, unsigned short next_opcode);
+        // Ends the block, continuing at addr.
+        void exit_to(unsigned short addr);
+        // Fills in the block's length once it is known.
+        void finish();
+    private:
+        unsigned int quirks;
+        Layout layout;
+        // Offset of the cycle count enter() compares against
+        unsigned long budget_at;
+
+        std::array<int, 17> host;
+        std::array<bool, 17> dirty;
+
+        bool instruction(unsigned short opcode, unsigned short addr, unsigned short next_opcode);
+        static bool steps(unsigned short opcode);
+
+        bool reserve(std::initializer_list<unsigned int> slots);
+        int use(unsigned int slot, bool load);
+        void write_back();
+        void spill();
+        void leave(unsigned int executed, unsigned int jump, bool linked);
+        void exit_jump(unsigned short addr, unsigned short target);
+        void exit_skip(unsigned char condition, unsigned short addr, unsigned short next_opcode);
+        void load_registers(unsigned int X, unsigned short addr);
+        void call(unsigned long function, unsigned int argument);
+        void call_write(unsigned short opcode, unsigned short addr);
+        unsigned long branch(unsigned char condition);
+        void land(unsigned long branch_at);
+
+        void emit(unsigned char byte) { code.push_back(byte); }
+        void emit32(unsigned int value);
+        void emit64(unsigned long value);
+        void rex(int r, int b, bool force);
+        void modrm(int mod, int reg, int rm) {
+            emit(static_cast<unsigned char>((mod << 6) | ((reg & 7) << 3) | (rm & 7)));
+        }
+
+        void mov_imm(int r, unsigned int imm);
+        void mov_imm64(int r, unsigned long imm);
+        void load_byte(int r, int disp);
+        void load_word(int r, int disp);
+        void store_byte(int r, int disp);
+        void store_word(int r, int disp);
+        void alu32(unsigned char op, int dst, int src);
+        void alu8(unsigned char op, int dst, int src);
+        void alu64_imm(int ext, int r, unsigned int imm);
+};
+
+void Translator::emit32(unsigned int value) {
+    for (int i = 0; i < 4; i++) {
+        emit(static_cast<unsigned char>(value >> (8 * i)));
+    }
+}
+
+void Translator::emit64(unsigned long value) {
+    emit32(static_cast<unsigned int>(value));
+    emit32(static_cast<unsigned int>(value >> 32));
+}
+
+void Translator::rex(int r, int b, bool force) {
+    // Byte registers 4-7 are only sil/dil/... with a REX prefix
+    unsigned char prefix = static_cast<unsigned char>(0x40 | ((r >> 3) << 2) | (b >> 3));
+    if (prefix != 0x40 || force) {
+        emit(prefix);
+    }
+}
+
+void Translator::mov_imm(int r, unsigned int imm) {
+    // mov r32, imm32
+    rex(0, r, false);
+    emit(static_cast<unsigned char>(0xB8 + (r & 7)));
+    emit32(imm);
+}
+
+void Translator::mov_imm64(int r, unsigned long imm) {
+    // mov r64, imm64
+    emit(static_cast<unsigned char>(0x48 | (r >> 3)));
+    emit(static_cast<unsigned char>(0xB8 + (r & 7)));
+    emit64(imm);
+}
+
+void Translator::load_byte(int r, int disp) {
+    // movzx r32, byte [rdi + disp32]
+    rex(r, 0, false);
+    emit(0x0F);
+    emit(0xB6);
+    modrm(2, r, RDI);
+    emit32(static_cast<unsigned int>(disp));
+}
+
+void Translator::load_word(int r, int disp) {
+    // movzx r32, word [rdi + disp32]
+    rex(r, 0, false);
+    emit(0x0F);
+    emit(0xB7);
+    modrm(2, r, RDI);
+    emit32(static_cast<unsigned int>(disp));
+}
+
+void Translator::store_byte(int r, int disp) {
+    // mov byte [rdi + disp32], r8
+    rex(r, 0, r >= 4);
+    emit(0x88);
+    modrm(2, r, RDI);
+    emit32(static_cast<unsigned int>(disp));
+}
+
+void Translator::store_word(int r, int disp) {
+    // mov word [rdi + disp32], r16
+    emit(0x66);
+    rex(r, 0, false);
+    emit(0x89);
+    modrm(2, r, RDI);
+    emit32(static_cast<unsigned int>(disp));
+}
+
+void Translator::alu32(unsigned char op, int dst, int src) {
+    // op r/m32, r32
+    rex(src, dst, false);
+    emit(op);
+    modrm(3, src, dst);
+}
+
+void Translator::alu8(unsigned char op, int dst, int src) {
+    // op r/m8, r8
+    rex(src, dst, true);
+    emit(op);
+    modrm(3, src, dst);
+}
+
+void Translator::alu64_imm(int ext, int r, unsigned int imm) {
+    // op r/m64, imm32, the operation (add, sub, cmp...) in the reg field
+    emit(static_cast<unsigned char>(0x48 | (r >> 3)));
+    emit(0x81);
+    modrm(3, ext, r);
+    emit32(imm);
+}
+
+unsigned long Translator::branch(unsigned char condition) {
+    // jcc rel8, landed by land()
+    emit(static_cast<unsigned char>(0x70 | condition));
+    emit(0);
+    return code.size();
+}
+
+void Translator::land(unsigned long branch_at) {
+    unsigned long distance = code.size() - branch_at;
+    if (distance > 127) {
+        throw std::logic_error("JIT branch out of range");
+    }
+    code[branch_at - 1] = static_cast<unsigned char>(distance);
+}
+
+bool Translator::reserve(std::initializer_list<unsigned int> slots) {
+    unsigned long allocated = 0;
+    unsigned long needed = 0;
+
+    for (int h : host) {
+        if (h >= 0) {
+            allocated++;
+        }
+    }
+    for (unsigned int slot : slots) {
+        if (host[slot] < 0) {
+            needed++;
+        }
+    }
+
+    // Slots may repeat (8XXN); counting them twice is only conservative
+    return allocated + needed <= HOST_POOL.size();
+}
+
+int Translator::use(unsigned int slot, bool load) {
+    if (host[slot] >= 0) {
+        return host[slot];
+    }
+
+    for (int h : HOST_POOL) {
+        bool taken = false;
+        for (int other : host) {
+            taken = taken || other == h;
+        }
+        if (taken) {
+            continue;
+        }
+
+        host[slot] = h;
+        if (load) {
+            if (slot == SLOT_I) {
+                load_word(h, layout.I);
+            } else {
+                load_byte(h, layout.regs + static_cast<int>(slot));
+            }
+        }
+        return h;
+    }
+
+    throw std::logic_error("JIT register pool exhausted");
+}
+
+void Translator::write_back() {
+    for (unsigned int slot = 0; slot < host.size(); slot++) {
+        if (!dirty[slot]) {
+            continue;
+        }
+
+        if (slot == SLOT_I) {
+            store_word(host[slot], layout.I);
+        } else {
+            store_byte(host[slot], layout.regs + static_cast<int>(slot));
+        }
+    }
+}
+
+void Translator::spill() {
+    // Memory accesses and calls work on the registers in the Chip8
+    write_back();
+    host.fill(-1);
+    dirty.fill(false);
+}
+
+void Translator::enter(unsigned short addr) {
+    // Leaving from here returns addr, with nothing run
+    mov_imm(RAX, addr);
+    alu64_imm(7, RSI, 0); // cmp, against the count filled in by finish()
+    budget_at = code.size() - 4;
+    unsigned long enough = branch(ABOVE_OR_EQUAL);
+    alu32(0x31, RDX, RDX); // xor
+    mov_imm64(RCX, layout.leave);
+    // jmp rcx
+    emit(0xFF);
+    modrm(3, 4, RCX);
+    land(enough);
+}
+
+void Translator::finish() {
+    for (unsigned long i = 0; i < 4; i++) {
+        code[budget_at + i] = static_cast<unsigned char>(count >> (8 * i));
+    }
+}
+
+void Translator::leave(unsigned int executed, unsigned int jump, bool linked) {
+    // The next PC is in eax; registers were written back by the caller
+    alu64_imm(5, RSI, executed); // sub
+    if (jump != 0) {
+        mov_imm(RDX, jump);
+    } else {
+        alu32(0x31, RDX, RDX); // xor
+    }
+
+    if (linked) {
+        mov_imm64(RCX, layout.links);
+        // jmp [rcx + rax * 8]
+        emit(0xFF);
+        modrm(0, 4, 4);
+        emit(0xC1);
+    } else {
+        mov_imm64(RCX, layout.leave);
+        // jmp rcx
+        emit(0xFF);
+        modrm(3, 4, RCX);
+    }
+}
+
+void Translator::exit_to(unsigned short addr) {
+    write_back();
+    mov_imm(RAX, addr & ADDRESS_MASK);
+    leave(count, 0, true);
+    ended = true;
+}
+
+void Translator::exit_jump(unsigned short addr, unsigned short target) {
+    // A jump to itself always waits, which only Jit::run() does
+    write_back();
+    mov_imm(RAX, target);
+    leave(count, addr + 1u, target != addr);
+    ended = true;
+}
+
+void Translator::exit_skip(unsigned char condition, unsigned short addr, unsigned short next_opcode) {
+    // Flags are set by the caller; the next instruction is at addr + 2,
+    // or past it when the skip is taken. F000 NNNN is four bytes long.
+    unsigned int skipped = next_opcode == 0xF000 ? 4 : 2;
+    write_back();
+    mov_imm(RAX, (addr + 2u) & ADDRESS_MASK);
+    mov_imm(RCX, (addr + 2u + skipped) & ADDRESS_MASK);
+    // cmovcc eax, ecx
+    emit(0x0F);
+    emit(static_cast<unsigned char>(0x40 | condition));
+    modrm(3, RAX, RCX);
+    leave(count, 0, true);
+    ended = true;
+}
+
+void Translator::load_registers(unsigned int X, unsigned short addr) {
+    // FX65
+    spill();
+    load_word(RAX, layout.I);
+
+    // Loads wrapping around the end of memory are left to the interpreter
+    // cmp eax, imm32
+    emit(0x81);
+    modrm(3, 7, RAX);
+    emit32(static_cast<unsigned int>(MEMORY_SIZE - 1 - X));
+    unsigned long in_range = branch(BELOW_OR_EQUAL);
+    mov_imm(RAX, addr);
+    leave(count - 1u, 0, false);
+    land(in_range);
+
+    for (unsigned int i = 0; i <= X; i++) {
+        // movzx ecx, byte [rdi + rax + disp32]
+        emit(0x0F);
+        emit(0xB6);
+        modrm(2, RCX, 4);
+        emit(0x07);
+        emit32(static_cast<unsigned int>(layout.memory) + i);
+        store_byte(RCX, layout.regs + static_cast<int>(i));
+    }
+
+    if (quirks & QUIRK_LOAD_STORE_INCREMENT) {
+        // add word [rdi + disp32], imm16
+        emit(0x66);
+        emit(0x81);
+        modrm(2, 0, RDI);
+        emit32(static_cast<unsigned int>(layout.I));
+        emit(static_cast<unsigned char>(X + 1));
+        emit(0);
+    }
+}
+
+void Translator::call(unsigned long function, unsigned int argument) {
+    // function(jit, argument), with the registers in the Chip8
+    spill();
+    // push rdi; push rsi; sub rsp, 8 keeps the stack aligned for the call
+    emit(0x57);
+    emit(0x56);
+    emit(0x48);
+    emit(0x83);
+    modrm(3, 5, 4);
+    emit(8);
+    mov_imm64(RDI, layout.jit);
+    mov_imm(RSI, argument);
+    mov_imm64(RAX, function);
+    // call rax
+    emit(0xFF);
+    modrm(3, 2, RAX);
+    // add rsp, 8; pop rsi; pop rdi
+    emit(0x48);
+    emit(0x83);
+    modrm(3, 0, 4);
+    emit(8);
+    emit(0x5E);
+    emit(0x5F);
+}
+
+void Translator::call_write(unsigned short opcode, unsigned short addr) {
+    // FX33, FX55 and 5XY2 are run by Jit::write(), which also drops the
+    // blocks they write into
+    call(layout.write, opcode);
+
+    // After a write into translated code, possibly this block, the rest is
+    // looked up again
+    alu32(0x85, RAX, RAX); // test
+    unsigned long untouched = branch(EQUAL);
+    mov_imm(RAX, (addr + 2u) & ADDRESS_MASK);
+    leave(count, 0, false);
+    land(untouched);
+}
+
+bool Translator::steps(unsigned short opcode) {
+    // Display, random number and XO-CHIP instructions that always go on to
+    // the next one are run by the interpreter without leaving the block
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            return (opcode & 0xFFE0) == 0x00C0 || opcode == 0x00E0
+                || (opcode >= 0x00FB && opcode != 0x00FD);
+        case 0x5000:
+            return (opcode & 0x000F) == 0x3;
+        case 0xC000:
+        case 0xD000:
+            return true;
+        case 0xF000: {
+            unsigned int NN = opcode & 0x00FF;
+            return NN == 0x01 || opcode == 0xF002 || NN == 0x30 || NN == 0x3A || NN == 0x75 || NN == 0x85;
+        }
+        default:
+            return false;
+    }
+}
+
+bool Translator::translate(unsigned short opcode, unsigned short addr, unsigned short next_opcode) {
+    // Exits emitted for the instruction count it as run
+    count++;
+    if (!instruction(opcode, addr, next_opcode)) {
+        count--;
+        return false;
+    }
+    return true;
+}
+
+bool Translator::instruction(unsigned short opcode, unsigned short addr, unsigned short next_opcode) {
+    if (steps(opcode)) {
+        call(layout.step, addr);
+        return true;
+    }
+
+    unsigned int X = (opcode & 0x0F00) >> 8;
+    unsigned int Y = (opcode & 0x00F0) >> 4;
+    unsigned int N = opcode & 0x000F;
+    unsigned int NN = opcode & 0x00FF;
+    unsigned int NNN = opcode & 0x0FFF;
+
+    switch (opcode & 0xF000) {
+        case 0x1000:
+            exit_jump(addr, static_cast<unsigned short>(NNN));
+            return true;
+        case 0x3000:
+        case 0x4000: {
+            if (!reserve({X})) {
+                return false;
+            }
+            int x = use(X, true);
+            // cmp r32, imm32
+            rex(0, x, false);
+            emit(0x81);
+            modrm(3, 7, x);
+            emit32(NN);
+            exit_skip((opcode & 0xF000) == 0x3000 ? EQUAL : NOT_EQUAL, addr, next_opcode);
+            return true;
+        }
+        case 0x5000:
+        case 0x9000: {
+            // 5XY2/5XY3 are XO-CHIP's register range stores and loads
+            bool range = (opcode & 0xF000) == 0x5000 && (N == 0x2 || N == 0x3);
+            if (range && N == 0x2) {
+                call_write(opcode, addr);
+                return true;
+            }
+            if (range || !reserve({X, Y})) {
+                return false;
+            }
+            int x = use(X, true);
+            int y = use(Y, true);
+            alu32(0x39, x, y); // cmp
+            exit_skip((opcode & 0xF000) == 0x5000 ? EQUAL : NOT_EQUAL, addr, next_opcode);
+            return true;
+        }
+        case 0x6000: {
+            if (!reserve({X})) {
+                return false;
+            }
+            mov_imm(use(X, false), NN);
+            dirty[X] = true;
+            return true;
+        }
+        case 0x7000: {
+            if (!reserve({X})) {
+                return false;
+            }
+            int x = use(X, true);
+            // add r8, imm8
+            rex(0, x, true);
+            emit(0x80);
+            modrm(3, 0, x);
+            emit(static_cast<unsigned char>(NN));
+            dirty[X] = true;
+            return true;
+        }
+        case 0x8000: {
+            if ((N > 0x7 && N != 0xE) || !reserve({X, Y})) {
+                return false;
+            }
+            // Load both first so that X == Y still reads the register
+            int x;
+            int y = use(Y, true);
+            switch (N) {
+                case 0x0:
+                    x = use(X, false);
+                    alu32(0x89, x, y); // mov
+                    break;
+                case 0x1:
+                    alu32(0x09, use(X, true), y); // or
+                    break;
+                case 0x2:
+                    alu32(0x21, use(X, true), y); // and
+                    break;
+                case 0x3:
+                    alu32(0x31, use(X, true), y); // xor
+                    break;
+                case 0x4:
+                    alu8(0x00, use(X, true), y); // add
+                    break;
+                case 0x5:
+                    alu8(0x28, use(X, true), y); // sub
+                    break;
+                case 0x6:
+                    if (quirks & QUIRK_SHIFT_VY) {
+                        x = use(X, false);
+                        alu32(0x89, x, y); // mov
+                    } else {
+                        x = use(X, true);
+                    }
+                    // shr r8, 1
+                    rex(0, x, true);
+                    emit(0xD0);
+                    modrm(3, 5, x);
+                    break;
+                case 0x7:
+                    // Vx = Vy - Vx, computed in eax
+                    x = use(X, true);
+                    alu32(0x89, RAX, y);
+                    alu8(0x28, RAX, x);
+                    alu32(0x89, x, RAX);
+                    break;
+                default:
+                    if (quirks & QUIRK_SHIFT_VY) {
+                        x = use(X, false);
+                        alu32(0x89, x, y); // mov
+                    } else {
+                        x = use(X, true);
+                    }
+                    // shl r8, 1
+                    rex(0, x, true);
+                    emit(0xD0);
+                    modrm(3, 4, x);
+                    break;
+            }
+            dirty[X] = true;
+            return true;
+        }
+        case 0xA000: {
+            if (!reserve({SLOT_I})) {
+                return false;
+            }
+            mov_imm(use(SLOT_I, false), NNN);
+            dirty[SLOT_I] = true;
+            return true;
+        }
+        case 0xF000: {
+            switch (NN) {
+                case 0x07:
+                    if (!reserve({X})) {
+                        return false;
+                    }
+                    load_byte(use(X, false), layout.delay);
+                    dirty[X] = true;
+                    return true;
+                case 0x15:
+                case 0x18:
+                    if (!reserve({X})) {
+                        return false;
+                    }
+                    store_byte(use(X, true), NN == 0x15 ? layout.delay : layout.sound);
+                    return true;
+                case 0x1E: {
+                    if (!reserve({X, SLOT_I})) {
+                        return false;
+                    }
+                    int x = use(X, true);
+                    int i = use(SLOT_I, true);
+                    alu32(0x01, i, x); // add
+                    // movzx r32, r16 keeps I at 16 bits
+                    rex(i, i, false);
+                    emit(0x0F);
+                    emit(0xB7);
+                    modrm(3, i, i);
+                    dirty[SLOT_I] = true;
+                    return true;
+                }
+                case 0x29: {
+                    if (!reserve({X, SLOT_I})) {
+                        return false;
+                    }
+                    int x = use(X, true);
+                    int i = use(SLOT_I, false);
+                    // imul r32, r32, 5
+                    rex(i, x, false);
+                    emit(0x6B);
+                    modrm(3, i, x);
+                    emit(5);
+                    dirty[SLOT_I] = true;
+                    return true;
+                }
+                case 0x33:
+                case 0x55:
+                    call_write(opcode, addr);
+                    return true;
+                case 0x65:
+                    load_registers(X, addr);
+                    return true;
+                default:
+                    return false;
+            }
+        }
+        default:
+            return false;
+    }
+}
+
+Jit::Jit(Chip8& machine)
+    : chip8(machine), blocks(), links(), code_pages(), code_buffer(nullptr), code_size(0),
+      translated_quirks(machine.quirks()) {
+#if CHIP8_JIT
+    void* buffer = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer != MAP_FAILED) {
+        code_buffer = static_cast<unsigned char*>(buffer);
+        // Blocks leave through the code at the start of the buffer
+        std::memcpy(code_buffer, LEAVE_CODE.data(), LEAVE_CODE.size());
+    }
+#endif
+    flush();
+}
+
+Jit::~Jit() {
+#if CHIP8_JIT
+    if (code_buffer != nullptr) {
+        munmap(code_buffer, CODE_BUFFER_SIZE);
+    }
+#endif
+}
+
+bool Jit::available() {
+    return CHIP8_JIT;
+}
+
+void Jit::enable_check() {
+    reference.reset(new Chip8(chip8));
+}
+
+void Jit::flush() {
+    blocks.fill(Block());
+    links.fill(code_buffer);
+    code_pages.reset();
+    code_size = LEAVE_CODE.size();
+}
+
+void Jit::mark_code(unsigned long start, unsigned long end) {
+    // Blocks may end past the end of memory, on the first page
+    for (unsigned long page = start / CODE_PAGE_SIZE; page <= (end - 1) / CODE_PAGE_SIZE; page++) {
+        code_pages.set(page % code_pages.size());
+    }
+}
+
+bool Jit::invalidate(unsigned long start, unsigned long end) {
+    // Most writes are to data, away from anything translated
+    bool touched = false;
+    for (unsigned long page = start / CODE_PAGE_SIZE; page <= (end - 1) / CODE_PAGE_SIZE; page++) {
+        touched = touched || code_pages.test(page);
+    }
+    if (!touched) {
+        return false;
+    }
+
+    // A block starting up to a full block before start may cover it, and
+    // the opcode after it if it ends in a skip
+    const unsigned long reach = 2 * MAX_BLOCK_INSTRUCTIONS + 2;
+    unsigned long first = start > reach ? start - reach : 0;
+
+    for (unsigned long addr = first; addr < end && addr < blocks.size(); addr++) {
+        // Every block marks the page it starts on
+        if (!code_pages.test(addr / CODE_PAGE_SIZE)) {
+            addr |= CODE_PAGE_SIZE - 1;
+            continue;
+        }
+
+        // Whether an instruction is left to the interpreter only depends on
+        // its own two bytes
+        Block& block = blocks[addr];
+        if ((block.code != nullptr && block.end > start) || (block.untranslatable && addr + 2 > start)) {
+            block = Block();
+            links[addr] = code_buffer;
+        }
+    }
+    return true;
+}
+
+bool Jit::written(unsigned long start, unsigned long length) {
+    // Writes past the end of memory wrap around to the start
+    bool touched = invalidate(start, std::min(start + length, MEMORY_SIZE));
+    if (start + length > MEMORY_SIZE) {
+        touched = invalidate(0, start + length - MEMORY_SIZE) || touched;
+    }
+    return touched;
+}
+
+unsigned long Jit::written_by(unsigned short opcode) {
+    if ((opcode & 0xF0FF) == 0xF033) {
+        return 3;
+    }
+    if ((opcode & 0xF0FF) == 0xF055) {
+        return ((opcode & 0x0F00) >> 8) + 1u;
+    }
+    if ((opcode & 0xF00F) == 0x5002) {
+        unsigned long x = (opcode & 0x0F00) >> 8;
+        unsigned long y = (opcode & 0x00F0) >> 4;
+        return (x > y ? x - y : y - x) + 1;
+    }
+    return 0;
+}
+
+unsigned int Jit::write(Jit* jit, unsigned int opcode) {
+    Chip8& chip8 = jit->chip8;
+    unsigned char X = static_cast<unsigned char>((opcode & 0x0F00) >> 8);
+    unsigned char Y = static_cast<unsigned char>((opcode & 0x00F0) >> 4);
+    unsigned long start = chip8.I & ADDRESS_MASK;
+
+    if ((opcode & 0xF0FF) == 0xF033) {
+        chip8.store_bcd(X);
+    } else if ((opcode & 0xF0FF) == 0xF055) {
+        chip8.store_registers(X);
+        if (chip8.quirks() & QUIRK_LOAD_STORE_INCREMENT) {
+            chip8.I = static_cast<unsigned short>(chip8.I + X + 1);
+        }
+    } else {
+        chip8.store_register_range(X, Y);
+    }
+
+    return jit->written(start, written_by(static_cast<unsigned short>(opcode)));
+}
+
+unsigned int Jit::step(Jit* jit, unsigned int addr) {
+    jit->chip8.pc = static_cast<unsigned short>(addr);
+    jit->chip8.run(1);
+    return 0;
+}
+
+Jit::Block& Jit::translate(unsigned short addr) {
+    Layout layout;
+    layout.regs = static_cast<int>(reinterpret_cast<unsigned char*>(&chip8.regs) - reinterpret_cast<unsigned char*>(&chip8));
+    layout.I = static_cast<int>(reinterpret_cast<unsigned char*>(&chip8.I) - reinterpret_cast<unsigned char*>(&chip8));
+    layout.delay = static_cast<int>(&chip8.delay_timer - reinterpret_cast<unsigned char*>(&chip8));
+    layout.sound = static_cast<int>(&chip8.sound_timer - reinterpret_cast<unsigned char*>(&chip8));
+    layout.memory = static_cast<int>(chip8.memory.data() - reinterpret_cast<unsigned char*>(&chip8));
+    layout.leave = reinterpret_cast<unsigned long>(code_buffer);
+    layout.links = reinterpret_cast<unsigned long>(links.data());
+    layout.write = reinterpret_cast<unsigned long>(&Jit::write);
+    layout.step = reinterpret_cast<unsigned long>(&Jit::step);
+    layout.jit = reinterpret_cast<unsigned long>(this);
+    Translator translator(chip8.quirks(), layout);
+    translator.enter(addr);
+
+    // Blocks stop at the end of memory rather than wrap
+    unsigned long pc = addr;
+
+    while (translator.count < MAX_BLOCK_INSTRUCTIONS && pc + 1 < chip8.memory.size()) {
+        unsigned short opcode = static_cast<unsigned short>((chip8.memory[pc] << 8) | chip8.memory[pc + 1]);
+        unsigned short next_opcode = static_cast<unsigned short>((chip8.memory[(pc + 2) & ADDRESS_MASK] << 8)
+                                                                 | chip8.memory[(pc + 3) & ADDRESS_MASK]);
+        if (!translator.translate(opcode, static_cast<unsigned short>(pc), next_opcode)) {
+            break;
+        }
+
+        pc += 2;
+        if (translator.ended) {
+            break;
+        }
+    }
+
+    Block& block = blocks[addr];
+    if (translator.count == 0 || code_buffer == nullptr) {
+        block.untranslatable = true;
+        mark_code(addr, addr + 2u);
+        return block;
+    }
+    if (!translator.ended) {
+        translator.exit_to(static_cast<unsigned short>(pc));
+    }
+    translator.finish();
+
+    if (code_size + translator.code.size() > CODE_BUFFER_SIZE) {
+        flush();
+    }
+
+    std::memcpy(code_buffer + code_size, translator.code.data(), translator.code.size());
+    block.code = reinterpret_cast<unsigned long (*)(Chip8*, unsigned long)>(code_buffer + code_size);
+    block.count = translator.count;
+    // A skip at the end of the block read the opcode after it
+    block.end = static_cast<unsigned int>(translator.ended ? pc + 2 : pc);
+    mark_code(addr, block.end);
+    // Jumps from elsewhere to an FX07 may wait, which only run() does, so
+    // such blocks are only entered from there
+    if (!chip8.waits_after_jump(static_cast<unsigned short>(addr + 1), addr)) {
+        links[addr] = code_buffer + code_size;
+    }
+    code_size += translator.code.size();
+
+    return block;
+}
+
+unsigned long Jit::run(unsigned long cycles) {
+    if (code_buffer == nullptr) {
+        return chip8.run(cycles);
+    }
+
+    // Blocks are translated for one set of quirks
+    if (chip8.quirks() != translated_quirks) {
+        flush();
+        translated_quirks = chip8.quirks();
+    }
+
+    unsigned long remaining = cycles;
+    bool waiting = false;
+    while (remaining > 0 && !chip8.faulted()) {
+        // Blocks can exit past the end of memory, where execution wraps
+        unsigned short pc = chip8.pc & ADDRESS_MASK;
+        chip8.pc = pc;
+
+        Block* block = &blocks[pc];
+        if (block->code == nullptr && !block->untranslatable) {
+            block = &translate(pc);
+        }
+
+        if (block->code != nullptr && block->count <= remaining) {
+            if (reference) {
+                *reference = chip8;
+            }
+
+            // Blocks go on into the blocks after them while there are
+            // cycles left, except when checked one at a time
+            unsigned long budget = reference ? block->count : std::min(remaining, MAX_CHAIN_CYCLES);
+            unsigned long result = block->code(&chip8, budget);
+            chip8.pc = static_cast<unsigned short>(result & ADDRESS_MASK);
+            unsigned long executed = budget - (result >> 32);
+            unsigned long jump = (result >> 16) & 0xFFFF;
+            remaining -= executed;
+
+            // Skip the same waits as the interpreter
+            unsigned long idle = 0;
+            if (jump != 0 && chip8.waits_after_jump(static_cast<unsigned short>(jump - 1), chip8.pc)) {
+                idle = chip8.idle_cycles(remaining);
+                remaining -= idle;
+                waiting = waiting || idle != 0;
+            }
+
+            if (reference && executed != 0) {
+                reference->run(executed + idle);
+                if (!same_state(chip8, *reference) || reference->idle() != (idle != 0)) {
+                    throw std::runtime_error("JIT and interpreter disagree after block at " + std::to_string(pc));
+                }
+            }
+            // A block that left before its first instruction leaves it to
+            // the interpreter
+            if (executed != 0) {
+                continue;
+            }
+        }
+
+        // Left to the interpreter; note what FX33/FX55/5XY2 are about to
+        // write
+        unsigned short opcode = static_cast<unsigned short>((chip8.memory[pc] << 8) | chip8.memory[(pc + 1) & ADDRESS_MASK]);
+        unsigned long length = written_by(opcode);
+        unsigned long write_start = chip8.I & ADDRESS_MASK;
+
+        if (chip8.run(1) == 0) {
+            break;
+        }
+        remaining--;
+        if (chip8.idle()) {
+            // FX0A spends the rest of the run
+            waiting = true;
+            remaining = 0;
+        }
+
+        if (length != 0) {
+            written(write_start, length);
+        }
+    }
+
+    chip8.waiting = waiting;
+    return cycles - remaining;
+}
+
+void Jit::restore(const Snapshot& snapshot) {
+    // Invalidate each run of differing words once
+    unsigned long used = std::max<unsigned long>(chip8.memory_used, snapshot.memory_used);
+    unsigned long start = 0;
+    bool changed = false;
+    unsigned long addr = 0;
+    for (; addr < used; addr += sizeof(uint64_t)) {
+        bool differs = std::memcmp(&chip8.memory[addr], &snapshot.memory[addr], sizeof(uint64_t)) != 0;
+        if (differs && !changed) {
+            start = addr;
+        } else if (!differs && changed) {
+            invalidate(start, addr);
+        }
+        changed = differs;
+    }
+    if (changed) {
+        invalidate(start, addr);
+    }
+
+    chip8.restore(snapshot);
+}
+
+bool Jit::same_state(const Chip8& a, const Chip8& b) {
+    return a.memory == b.memory && a.regs == b.regs && a.I == b.I && a.pc == b.pc
+        && a.stack == b.stack && a.sp == b.sp && a.delay_timer == b.delay_timer
+        && a.sound_timer == b.sound_timer && a.rng_state == b.rng_state
+        && a.rpl_flags == b.rpl_flags && a.audio_pattern == b.audio_pattern && a.pitch == b.pitch
+        && a.gfx == b.gfx && a.keys == b.keys;
+}
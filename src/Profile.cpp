@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "Profile.h"
+
+// Names of the instruction kinds in the report, in OpKind order.
+static const char* const OP_KIND_NAMES[] = {
+    "UNDECODED", "SYS", "CLS", "RET", "JP", "CALL", "SE VX,NN", "SNE VX,NN",
+    "SE VX,VY", "LD VX,NN", "ADD VX,NN", "LD VX,VY", "OR", "AND", "XOR", "ADD VX,VY",
+    "SUB", "SHR", "SUBN", "SHL", "SNE VX,VY", "LD I", "JP V0", "RND",
+    "DRW", "SKP", "SKNP", "LD VX,DT", "LD VX,K", "LD DT,VX", "LD ST,VX", "ADD I,VX",
+    "LD F,VX", "LD B,VX", "LD [I],VX", "LD VX,[I]",
+    "SCD", "SCR", "SCL", "EXIT", "LOW", "HIGH", "LD HF,VX", "LD R,VX", "LD VX,R",
+    "SCU", "SAVE VX-VY", "LOAD VX-VY", "LD I,NNNN", "PLANE", "AUDIO", "PITCH",
+    "INVALID 8XYN", "INVALID FXNN"
+};
+static_assert(sizeof(OP_KIND_NAMES) / sizeof(OP_KIND_NAMES[0]) == OP_COUNT, "one name per OpKind");
+
+// Number of addresses listed in the report.
+const unsigned long REPORT_HOT_ADDRESSES = 20;
+
+void Profiler::clear() {
+    kind_counts.fill(0);
+    kind_ticks.fill(0);
+    pc_counts.fill(0);
+    pc_ticks.fill(0);
+
+    nodes.clear();
+    nodes.push_back({0, 0, {}, 0, 0});
+    node = 0;
+
+    running = false;
+    current_pc = 0;
+    current_node = 0;
+    started = 0;
+
+    total_ticks = 0;
+    total_time = std::chrono::steady_clock::duration::zero();
+    resumed_ticks = 0;
+}
+
+void Profiler::pause(OpKind previous_kind) {
+    if (!running) {
+        return;
+    }
+
+    uint64_t now = ticks();
+    uint64_t elapsed = now - started;
+    kind_counts[previous_kind]++;
+    kind_ticks[previous_kind] += elapsed;
+    pc_ticks[current_pc] += elapsed;
+    nodes[current_node].instructions++;
+    nodes[current_node].ticks += elapsed;
+
+    total_ticks += now - resumed_ticks;
+    total_time += std::chrono::steady_clock::now() - resumed_time;
+    running = false;
+}
+
+void Profiler::call(unsigned short addr) {
+    for (unsigned int child : nodes[node].children) {
+        if (nodes[child].addr == addr) {
+            node = child;
+            return;
+        }
+    }
+
+    unsigned int child = static_cast<unsigned int>(nodes.size());
+    nodes.push_back({addr, node, {}, 0, 0});
+    nodes[node].children.push_back(child);
+    node = child;
+}
+
+void Profiler::ret() {
+    node = nodes[node].parent;
+}
+
+double Profiler::nanoseconds(uint64_t count) const {
+    if (total_ticks == 0) {
+        return 0.0;
+    }
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(total_time).count());
+    return static_cast<double>(count) * ns / static_cast<double>(total_ticks);
+}
+
+std::string Profiler::path(unsigned int index) const {
+    if (index == 0) {
+        return "main";
+    }
+
+    std::ostringstream name;
+    name << "sub_" << std::hex << std::uppercase << std::setw(3) << std::setfill('0') << nodes[index].addr;
+    return path(nodes[index].parent) + ";" + name.str();
+}
+
+void Profiler::write(std::string path) const {
+    std::ofstream report(path);
+    std::ofstream folded(path + ".folded");
+    if (!report.is_open() || !folded.is_open()) {
+        throw std::runtime_error("Unable to open profile file!");
+    }
+
+    write_report(report);
+    write_folded(folded);
+}
+
+void Profiler::write_report(std::ostream& out) const {
+    std::ios_base::fmtflags flags = out.flags();
+
+    uint64_t instructions = 0;
+    uint64_t all_ticks = 0;
+    for (unsigned long i = 0; i < kind_counts.size(); i++) {
+        instructions += kind_counts[i];
+        all_ticks += kind_ticks[i];
+    }
+    double all_ns = nanoseconds(all_ticks);
+
+    out << std::fixed << std::setprecision(1);
+    out << "Instructions: " << instructions << "\n"
+        << "Host time: " << all_ns / 1e6 << " ms\n\n";
+
+    // Instruction kinds, most time first
+    std::vector<unsigned long> kinds;
+    for (unsigned long i = 0; i < kind_counts.size(); i++) {
+        if (kind_counts[i] != 0) {
+            kinds.push_back(i);
+        }
+    }
+    std::sort(kinds.begin(), kinds.end(), [this](unsigned long a, unsigned long b) {
+        return kind_ticks[a] > kind_ticks[b];
+    });
+
+    out << std::left << std::setw(14) << "Kind" << std::right
+        << std::setw(14) << "Count" << std::setw(8) << "%"
+        << std::setw(12) << "Time (us)" << std::setw(8) << "%"
+        << std::setw(10) << "ns/instr" << "\n";
+    for (unsigned long kind : kinds) {
+        double ns = nanoseconds(kind_ticks[kind]);
+        out << std::left << std::setw(14) << OP_KIND_NAMES[kind] << std::right
+            << std::setw(14) << kind_counts[kind]
+            << std::setw(8) << 100.0 * static_cast<double>(kind_counts[kind]) / static_cast<double>(instructions)
+            << std::setw(12) << ns / 1e3
+            << std::setw(8) << (all_ns > 0.0 ? 100.0 * ns / all_ns : 0.0)
+            << std::setw(10) << ns / static_cast<double>(kind_counts[kind]) << "\n";
+    }
+
+    // Hottest addresses by time
+    std::vector<unsigned short> addresses;
+    for (unsigned long addr = 0; addr < pc_counts.size(); addr++) {
+        if (pc_counts[addr] != 0) {
+            addresses.push_back(static_cast<unsigned short>(addr));
+        }
+    }
+    std::sort(addresses.begin(), addresses.end(), [this](unsigned short a, unsigned short b) {
+        return pc_ticks[a] > pc_ticks[b];
+    });
+    if (addresses.size() > REPORT_HOT_ADDRESSES) {
+        addresses.resize(REPORT_HOT_ADDRESSES);
+    }
+
+    out << "\n" << std::left << std::setw(14) << "Address" << std::right
+        << std::setw(14) << "Count" << std::setw(8) << "%"
+        << std::setw(12) << "Time (us)" << std::setw(8) << "%" << "\n";
+    for (unsigned short addr : addresses) {
+        double ns = nanoseconds(pc_ticks[addr]);
+        std::ostringstream name;
+        name << std::hex << std::uppercase << std::setw(3) << std::setfill('0') << addr;
+        out << std::left << std::setw(14) << name.str() << std::right
+            << std::setw(14) << pc_counts[addr]
+            << std::setw(8) << 100.0 * static_cast<double>(pc_counts[addr]) / static_cast<double>(instructions)
+            << std::setw(12) << ns / 1e3
+            << std::setw(8) << (all_ns > 0.0 ? 100.0 * ns / all_ns : 0.0) << "\n";
+    }
+
+    // Call tree, depth first with self counts
+    out << "\nCall tree (self instructions, self time):\n";
+    std::vector<std::pair<unsigned int, unsigned int>> pending = {{0, 0}};
+    while (!pending.empty()) {
+        unsigned int index = pending.back().first;
+        unsigned int depth = pending.back().second;
+        pending.pop_back();
+
+        const CallNode& call_node = nodes[index];
+        std::string name = path(index);
+        name = name.substr(name.rfind(';') + 1);
+        out << std::string(2 * depth + 2, ' ') << name << "  "
+            << call_node.instructions << "  " << nanoseconds(call_node.ticks) / 1e3 << " us\n";
+
+        for (auto child = call_node.children.rbegin(); child != call_node.children.rend(); ++child) {
+            pending.push_back({*child, depth + 1});
+        }
+    }
+
+    out.flags(flags);
+}
+
+void Profiler::write_folded(std::ostream& out) const {
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        if (nodes[i].instructions != 0) {
+            out << path(i) << " " << nodes[i].instructions << "\n";
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#include <sstream>
+#include <stdexcept>
+
+#include "Quirks.h"
+
+unsigned int parse_quirks(const std::string& spec) {
+    unsigned int quirks = 0;
+
+    std::istringstream names(spec);
+    std::string name;
+    while (std::getline(names, name, ',')) {
+        if (name == "default") {
+            continue;
+        } else if (name == "cosmac") {
+            quirks |= QUIRKS_COSMAC;
+        } else if (name == "schip") {
+            quirks |= QUIRKS_SCHIP;
+        } else if (name == "xochip") {
+            quirks |= QUIRKS_XOCHIP;
+        } else if (name == "shift-vy") {
+            quirks |= QUIRK_SHIFT_VY;
+        } else if (name == "load-store-increment") {
+            quirks |= QUIRK_LOAD_STORE_INCREMENT;
+        } else if (name == "jump-vx") {
+            quirks |= QUIRK_JUMP_VX;
+        } else if (name == "clip") {
+            quirks |= QUIRK_CLIP_SPRITES;
+        } else {
+            throw std::runtime_error("Unknown quirk " + name);
+        }
+    }
+
+    return quirks;
+}
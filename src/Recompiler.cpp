@@ -0,0 +1,523 @@
+#include <cstdio>
+#include <stdexcept>
+
+#include "Chip8.h"
+#include "Disassembler.h"
+#include "Recompiler.h"
+
+// Longest block that is translated, in instructions.
+const unsigned short MAX_BLOCK_INSTRUCTIONS = 64;
+
+static std::string hex(unsigned long value, int digits) {
+    char text[16];
+    snprintf(text, sizeof(text), "0x%0*lX", digits, value);
+    return text;
+}
+
+// Indents every line of code by four spaces.
+static std::string indented(const std::string& code) {
+    std::string out;
+    bool line_start = true;
+    for (char c : code) {
+        if (line_start && c != '\n') {
+            out += "    ";
+        }
+        out += c;
+        line_start = c == '\n';
+    }
+    return out;
+}
+
+// Whether the interpreter knows an FXNN instruction, rather than faulting.
+static bool known_f(unsigned short opcode) {
+    switch (opcode & 0x00FF) {
+        case 0x00:
+        case 0x02:
+            return (opcode & 0x0F00) == 0;
+        case 0x01: case 0x07: case 0x0A: case 0x15: case 0x18: case 0x1E: case 0x29: case 0x30:
+        case 0x33: case 0x3A: case 0x55: case 0x65: case 0x75: case 0x85:
+            return true;
+        default:
+            return false;
+    }
+}
+
+Recompiler::Recompiler(const std::vector<unsigned char>& program, unsigned int quirks)
+    : rom(program),
+      quirk_flags(quirks & (QUIRK_COMBINATIONS - 1)),
+      reachable_count(0) {
+    if (rom.empty()) {
+        throw std::runtime_error("Program is empty!");
+    }
+    if (rom.size() > MAX_PROGRAM_SIZE) {
+        throw std::runtime_error("Program is too large!");
+    }
+    recover();
+}
+
+const std::vector<RecoveredBlock>& Recompiler::blocks() const {
+    return recovered;
+}
+
+unsigned long Recompiler::reachable_instructions() const {
+    return reachable_count;
+}
+
+unsigned long Recompiler::translated_instructions() const {
+    unsigned long count = 0;
+    for (const RecoveredBlock& block : recovered) {
+        count += block.count;
+    }
+    return count;
+}
+
+// Whether length bytes from addr are all part of the program.
+bool Recompiler::contains(unsigned long addr, unsigned long length) const {
+    return addr >= PROGRAM_START && addr + length <= PROGRAM_START + rom.size();
+}
+
+unsigned short Recompiler::opcode_at(unsigned long addr) const {
+    unsigned long offset = addr - PROGRAM_START;
+    return static_cast<unsigned short>((rom[offset] << 8) | rom[offset + 1]);
+}
+
+// How far a skip at addr jumps over the instruction after it.
+unsigned short Recompiler::skip_length(unsigned long addr) const {
+    // F000 NNNN is the only instruction that is four bytes long
+    return opcode_at(addr + 2) == 0xF000 ? 6 : 4;
+}
+
+bool Recompiler::translatable(unsigned long addr) const {
+    unsigned short opcode = opcode_at(addr);
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            // Scrolling, EXIT and the resolution switches are interpreted
+            return (opcode & 0xFFE0) != 0x00C0 && (opcode < 0x00FB || opcode > 0x00FF);
+        case 0x3000:
+        case 0x4000:
+        case 0x9000:
+        case 0xE000:
+            // The skip looks at the instruction it may skip
+            return contains(addr + 2, 2);
+        case 0x5000:
+            return (opcode & 0x000F) != 0x2 && (opcode & 0x000F) != 0x3 && contains(addr + 2, 2);
+        case 0x8000:
+            switch (opcode & 0x000F) {
+                case 0x0: case 0x1: case 0x2: case 0x3: case 0x4: case 0x5: case 0x6: case 0x7: case 0xE:
+                    return true;
+                default:
+                    return false;
+            }
+        case 0xB000:
+            return false;
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x07: case 0x15: case 0x18: case 0x1E: case 0x29: case 0x30: case 0x33: case 0x55: case 0x65:
+                    return true;
+                default:
+                    return false;
+            }
+        default:
+            return true;
+    }
+}
+
+// Whether a translated instruction is the last of its block: it moves the
+// PC somewhere else, or writes memory that may hold the code after it.
+bool Recompiler::ends_block(unsigned short opcode) {
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            return opcode == 0x00EE;
+        case 0x1000:
+        case 0x2000:
+        case 0x3000:
+        case 0x4000:
+        case 0x5000:
+        case 0x9000:
+        case 0xE000:
+            return true;
+        case 0xF000:
+            return (opcode & 0x00FF) == 0x33 || (opcode & 0x00FF) == 0x55;
+        default:
+            return false;
+    }
+}
+
+void Recompiler::recover() {
+    std::vector<bool> reachable(MEMORY_SIZE, false);
+    std::vector<unsigned long> pending(1, PROGRAM_START);
+
+    while (!pending.empty()) {
+        unsigned long addr = pending.back();
+        pending.pop_back();
+        if (!contains(addr, 2) || reachable[addr]) {
+            continue;
+        }
+        reachable[addr] = true;
+        reachable_count++;
+
+        unsigned short opcode = opcode_at(addr);
+        unsigned long next = addr + 2;
+        unsigned char N = opcode & 0x000F;
+        bool skips = false;
+
+        switch (opcode & 0xF000) {
+            case 0x0000:
+                if (opcode != 0x00EE && opcode != 0x00FD) {
+                    pending.push_back(next);
+                }
+                break;
+            case 0x1000:
+                pending.push_back(opcode & 0x0FFF);
+                break;
+            case 0x2000:
+                pending.push_back(opcode & 0x0FFF);
+                pending.push_back(next);
+                break;
+            case 0x5000:
+                skips = N != 0x2 && N != 0x3;
+                pending.push_back(next);
+                break;
+            case 0x3000:
+            case 0x4000:
+            case 0x9000:
+            case 0xE000:
+                skips = true;
+                pending.push_back(next);
+                break;
+            case 0x8000:
+                // Unknown ALU operations fault
+                if (N <= 0x7 || N == 0xE) {
+                    pending.push_back(next);
+                }
+                break;
+            case 0xB000:
+                // The target is computed, nothing to follow
+                break;
+            case 0xF000:
+                if (opcode == 0xF000) {
+                    pending.push_back(addr + 4);
+                } else if (known_f(opcode)) {
+                    pending.push_back(next);
+                }
+                break;
+            default:
+                pending.push_back(next);
+                break;
+        }
+        if (skips && contains(next, 2)) {
+            pending.push_back(addr + skip_length(addr));
+        }
+    }
+
+    // One block from each reachable instruction that no earlier block
+    // covers, as long as the instructions after it are translated
+    std::vector<bool> covered(MEMORY_SIZE, false);
+    for (unsigned long start = PROGRAM_START; start < PROGRAM_START + rom.size(); start++) {
+        if (!reachable[start] || covered[start] || !translatable(start)) {
+            continue;
+        }
+
+        RecoveredBlock block;
+        block.start = static_cast<unsigned short>(start);
+        block.count = 0;
+        unsigned long addr = start;
+        while (true) {
+            covered[addr] = true;
+            block.count++;
+
+            unsigned short opcode = opcode_at(addr);
+            if (ends_block(opcode)) {
+                bool skip = (opcode & 0xF000) != 0x1000 && (opcode & 0xF000) != 0x2000
+                    && (opcode & 0xF000) != 0xF000 && opcode != 0x00EE;
+                // A skip reads the opcode after it
+                block.end = static_cast<unsigned int>(addr + (skip ? 4 : 2));
+                break;
+            }
+
+            addr += 2;
+            if (block.count == MAX_BLOCK_INSTRUCTIONS || !contains(addr, 2) || covered[addr] || !translatable(addr)) {
+                block.end = static_cast<unsigned int>(addr);
+                break;
+            }
+        }
+        recovered.push_back(block);
+    }
+    counts.assign(MEMORY_SIZE, 0);
+    for (const RecoveredBlock& block : recovered) {
+        for (unsigned short i = 0; i < block.count; i++) {
+            counts[block.start + 2ul * i] = static_cast<unsigned short>(block.count - i);
+        }
+    }
+}
+
+void Recompiler::write(std::ostream& out, const std::string& name) const {
+    out << "// " << name << " translated by chip8-aot for quirks " << hex(quirk_flags, 1) << ", do not edit.\n"
+        << "// " << recovered.size() << " blocks, " << translated_instructions() << " of the "
+        << reachable_instructions() << " instructions found are translated.\n\n"
+        << "#include \"AotRuntime.h\"\n\n";
+
+    out << "static const unsigned char rom[] = {";
+    for (unsigned long i = 0; i < rom.size(); i++) {
+        out << (i % 16 == 0 ? "\n    " : " ") << hex(rom[i], 2) << ",";
+    }
+    out << "\n};\n\n";
+
+    write_run(out);
+
+    std::string table = "nullptr";
+    if (!recovered.empty()) {
+        table = "blocks";
+        out << "static const AotBlock blocks[] = {\n";
+        for (const RecoveredBlock& block : recovered) {
+            out << "    {" << hex(block.start, 4) << ", " << hex(block.end, 4) << ", " << block.count << "},\n";
+        }
+        out << "};\n\n";
+    }
+
+    std::string quoted;
+    for (char c : name) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    out << "const AotProgram aot_program = {\n"
+        << "    \"" << quoted << "\", rom, sizeof(rom), " << hex(quirk_flags, 1) << ",\n"
+        << "    " << table << ", " << recovered.size() << ", run_program\n"
+        << "};\n";
+}
+
+// Writes run_program(), all blocks in one function: blocks go straight on
+// to the blocks they lead to, and only come back to the runtime for what
+// they cannot do themselves.
+void Recompiler::write_run(std::ostream& out) const {
+    if (recovered.empty()) {
+        out << "static unsigned long run_program(Chip8&, const unsigned char*, unsigned long) {\n"
+            << "    return 0;\n"
+            << "}\n\n";
+        return;
+    }
+
+    // Returns go back through the dispatch
+    bool returns = false;
+    for (const RecoveredBlock& block : recovered) {
+        for (unsigned short i = 0; i < block.count; i++) {
+            returns = returns || opcode_at(block.start + 2ul * i) == 0x00EE;
+        }
+    }
+
+    bool uses_V = false;
+    bool uses_I = false;
+    std::string body;
+    for (const RecoveredBlock& block : recovered) {
+        body += "\n    // " + hex(block.start, 4) + "-" + hex(block.end - 1, 4) + "\n";
+        for (unsigned short i = 0; i < block.count; i++) {
+            unsigned long addr = block.start + 2ul * i;
+            unsigned short opcode = opcode_at(addr);
+            body += "at_" + hex(addr, 4).substr(2) + ":  // " + hex(opcode, 4).substr(2) + "  " + disassemble(opcode) + "\n";
+
+            std::string code = translate(addr, block, i);
+            if (i + 1 == block.count && !ends_block(opcode)) {
+                // Runs on into the next block, or stops before an instruction
+                // the interpreter has to run
+                code += link((addr + 2) & ADDRESS_MASK);
+            }
+            body += indented(code);
+
+            uses_V = uses_V || code.find("V[") != std::string::npos;
+            uses_I = uses_I || code.compare(0, 2, "I ") == 0 || code.find("\nI ") != std::string::npos;
+        }
+    }
+
+    std::string dispatch;
+    for (const RecoveredBlock& block : recovered) {
+        for (unsigned short i = 0; i < block.count; i++) {
+            unsigned long addr = block.start + 2ul * i;
+            std::string count = std::to_string(block.count - i);
+            dispatch += "case " + hex(addr, 4) + ":\n";
+            dispatch += "    if (executed + " + count + " > budget) {\n"
+                        "        return executed;\n"
+                        "    }\n"
+                        "    executed += " + count + ";\n"
+                        "    goto at_" + hex(addr, 4).substr(2) + ";\n";
+        }
+    }
+    dispatch += "default:\n"
+                "    return executed;\n";
+
+    out << "// Runs from the PC for up to budget instructions, while the blocks it\n"
+        << "// reaches are valid, and returns how many ran.\n"
+        << "static unsigned long run_program(Chip8& chip8, const unsigned char* valid, unsigned long budget) {\n";
+    if (uses_V) {
+        out << "    unsigned char* V = AotRuntime::registers(chip8);\n";
+    }
+    if (uses_I) {
+        out << "    unsigned short& I = AotRuntime::index(chip8);\n";
+    }
+    out << "    unsigned long executed = 0;\n";
+    out << "\n";
+    if (returns) {
+        out << "dispatch:\n";
+    }
+    out << "    if (!valid[AotRuntime::pc(chip8)]) {\n"
+        << "        return executed;\n"
+        << "    }\n"
+        << "    switch (AotRuntime::pc(chip8)) {\n"
+        << indented(indented(dispatch))
+        << "    }\n"
+        << body
+        << "}\n\n";
+}
+
+// Goes on to target: straight into its block while that is valid and the
+// budget covers it, otherwise back to the runtime.
+std::string Recompiler::link(unsigned long target) const {
+    return enter(target, "return AotRuntime::leave(chip8, " + hex(target, 4) + ", executed);\n");
+}
+
+// The 1NNN at from: as link(), except that the interpreter may skip a wait
+// after jumping to itself or to an FX07, see Chip8::waits_after_jump().
+// Those jumps always go back to the runtime, as do the others whenever
+// they cannot go straight on, where memory may no longer hold the ROM.
+std::string Recompiler::jump(unsigned long from, unsigned long target) const {
+    std::string leave = "return AotRuntime::jump(chip8, " + hex(from, 4) + ", " + hex(target, 4)
+        + ", executed, budget);\n";
+    if (target == from || (contains(target, 2) && (opcode_at(target) & 0xF0FF) == 0xF007)) {
+        return leave;
+    }
+    return enter(target, leave);
+}
+
+std::string Recompiler::enter(unsigned long target, const std::string& leave) const {
+    if (counts[target] == 0) {
+        return leave;
+    }
+    std::string address = hex(target, 4);
+    std::string count = std::to_string(counts[target]);
+    return "if (valid[" + address + "] && executed + " + count + " <= budget) {\n"
+        "    executed += " + count + ";\n"
+        "    goto at_" + address.substr(2) + ";\n"
+        "}\n" + leave;
+}
+
+// The statements of the index-th instruction of block, at addr.
+// Instructions that end the block leave it, or link to the next one.
+std::string Recompiler::translate(unsigned long addr, const RecoveredBlock& block, unsigned int index) const {
+    unsigned short opcode = opcode_at(addr);
+    std::string X = hex((opcode & 0x0F00) >> 8, 1);
+    std::string Y = hex((opcode & 0x00F0) >> 4, 1);
+    std::string N = std::to_string(opcode & 0x000F);
+    std::string NN = hex(opcode & 0x00FF, 2);
+    std::string NNN = hex(opcode & 0x0FFF, 4);
+    std::string VX = "V[" + X + "]";
+    std::string VY = "V[" + Y + "]";
+    unsigned long next = (addr + 2) & ADDRESS_MASK;
+
+    // Stops on an instruction that would fault, for the interpreter to
+    // raise it; the block's count included the instructions from there on
+    std::string fault = "    executed -= " + std::to_string(block.count - index) + ";\n"
+        "    return AotRuntime::leave(chip8, " + hex(addr, 4) + ", executed);\n";
+
+    std::string condition;
+    std::string code;
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            if (opcode == 0x00E0) {
+                code = "AotRuntime::clear_display(chip8);\n";
+            } else if (opcode == 0x00EE) {
+                // Wherever the stack leads
+                code = "if (!AotRuntime::ret(chip8)) {\n" + fault + "}\n"
+                    "goto dispatch;\n";
+            }
+            // SYS does nothing
+            break;
+        case 0x1000:
+            code = jump(addr, opcode & 0x0FFF);
+            break;
+        case 0x2000:
+            code = "if (!AotRuntime::call(chip8, " + hex(next, 4) + ", " + NNN + ")) {\n" + fault + "}\n"
+                + link(opcode & 0x0FFF);
+            break;
+        case 0x3000:
+            condition = VX + " == " + NN;
+            break;
+        case 0x4000:
+            condition = VX + " != " + NN;
+            break;
+        case 0x5000:
+            condition = VX + " == " + VY;
+            break;
+        case 0x6000:
+            code = VX + " = " + NN + ";\n";
+            break;
+        case 0x7000:
+            code = VX + " = static_cast<unsigned char>(" + VX + " + " + NN + ");\n";
+            break;
+        case 0x8000: {
+            std::string shifted = (quirk_flags & QUIRK_SHIFT_VY) ? VY : VX;
+            switch (opcode & 0x000F) {
+                case 0x0: code = VX + " = " + VY + ";\n"; break;
+                case 0x1: code = VX + " |= " + VY + ";\n"; break;
+                case 0x2: code = VX + " &= " + VY + ";\n"; break;
+                case 0x3: code = VX + " ^= " + VY + ";\n"; break;
+                case 0x4: code = VX + " = static_cast<unsigned char>(" + VX + " + " + VY + ");\n"; break;
+                case 0x5: code = VX + " = static_cast<unsigned char>(" + VX + " - " + VY + ");\n"; break;
+                case 0x6: code = VX + " = static_cast<unsigned char>(" + shifted + " >> 1);\n"; break;
+                case 0x7: code = VX + " = static_cast<unsigned char>(" + VY + " - " + VX + ");\n"; break;
+                default: code = VX + " = static_cast<unsigned char>(" + shifted + " << 1);\n"; break;
+            }
+            break;
+        }
+        case 0x9000:
+            condition = VX + " != " + VY;
+            break;
+        case 0xA000:
+            code = "I = " + hex(opcode & 0x0FFF, 3) + ";\n";
+            break;
+        case 0xC000:
+            code = VX + " = static_cast<unsigned char>(AotRuntime::random(chip8) & " + NN + ");\n";
+            break;
+        case 0xD000:
+            code = "AotRuntime::draw_sprite(chip8, " + X + ", " + Y + ", " + N + ", "
+                + ((quirk_flags & QUIRK_CLIP_SPRITES) ? "true" : "false") + ");\n";
+            break;
+        case 0xE000:
+            condition = ((opcode & 0x00FF) == 0x9E ? "" : "!") + std::string("AotRuntime::key(chip8, ") + VX + ")";
+            break;
+        default: {
+            std::string increment;
+            if (quirk_flags & QUIRK_LOAD_STORE_INCREMENT) {
+                increment = "I = static_cast<unsigned short>(I + " + std::to_string(((opcode & 0x0F00) >> 8) + 1) + ");\n";
+            }
+            // Stores may have written over translated code, which the
+            // runtime checks before going on
+            std::string stored = "return AotRuntime::leave(chip8, " + hex(next, 4) + ", executed);\n";
+            switch (opcode & 0x00FF) {
+                case 0x07: code = VX + " = AotRuntime::delay_timer(chip8);\n"; break;
+                case 0x15: code = "AotRuntime::delay_timer(chip8) = " + VX + ";\n"; break;
+                case 0x18: code = "AotRuntime::sound_timer(chip8) = " + VX + ";\n"; break;
+                case 0x1E: code = "I = static_cast<unsigned short>(I + " + VX + ");\n"; break;
+                case 0x29: code = "I = static_cast<unsigned short>(" + VX + " * 5);\n"; break;
+                case 0x30: code = "I = static_cast<unsigned short>(BIG_FONT_ADDRESS + (" + VX + " & 0xF) * 10);\n"; break;
+                case 0x33: code = "AotRuntime::store_bcd(chip8, " + X + ");\n" + stored; break;
+                case 0x55: code = "AotRuntime::store_registers(chip8, " + X + ");\n" + increment + stored; break;
+                default: code = "AotRuntime::load_registers(chip8, " + X + ");\n" + increment; break;
+            }
+            break;
+        }
+    }
+
+    if (!condition.empty()) {
+        unsigned long skipped = (addr + skip_length(addr)) & ADDRESS_MASK;
+        // 5XX0 always skips and 9XX0 never does
+        if (condition == VX + " == " + VX) {
+            code = link(skipped);
+        } else if (condition == VX + " != " + VX) {
+            code = link(next);
+        } else {
+            code = "if (" + condition + ") {\n" + indented(link(skipped)) + "}\n" + link(next);
+        }
+    }
+    return code;
+}
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "Rewind.h"
+
+// Encoded entries are a series of runs: the number of unchanged bytes and
+// the number of changed ones as LEB128 varints, then the changed bytes
+// XORed with the base.
+
+// Bytes of a snapshot that may be non-zero.
+static unsigned long span(const Snapshot& snapshot) {
+    return offsetof(Snapshot, memory) + snapshot.memory_used;
+}
+
+static void put_varint(std::vector<unsigned char>& out, unsigned long value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+static unsigned long get_varint(const unsigned char*& in) {
+    unsigned long value = 0;
+    unsigned int shift = 0;
+    while (*in & 0x80) {
+        value |= static_cast<unsigned long>(*in++ & 0x7F) << shift;
+        shift += 7;
+    }
+    value |= static_cast<unsigned long>(*in++) << shift;
+    return value;
+}
+
+// Encodes the first length bytes of state XORed with base.
+static void encode(const unsigned char* state, const unsigned char* base, unsigned long length,
+                   std::vector<unsigned char>& out) {
+    out.clear();
+
+    unsigned long i = 0;
+    while (i < length) {
+        // Unchanged bytes, a word at a time where possible
+        unsigned long same = i;
+        while (same + sizeof(uint64_t) <= length && std::memcmp(state + same, base + same, sizeof(uint64_t)) == 0) {
+            same += sizeof(uint64_t);
+        }
+        while (same < length && state[same] == base[same]) {
+            same++;
+        }
+
+        unsigned long changed = same;
+        while (changed < length && state[changed] != base[changed]) {
+            changed++;
+        }
+
+        put_varint(out, same - i);
+        put_varint(out, changed - same);
+        for (unsigned long j = same; j < changed; j++) {
+            out.push_back(state[j] ^ base[j]);
+        }
+        i = changed;
+    }
+}
+
+Rewind::Rewind(unsigned long budget_bytes)
+    : ring(budget_bytes),
+      entries(),
+      used(0),
+      since_keyframe(0),
+      base(new Snapshot()),
+      current(new Snapshot()),
+      encoded() {
+    // Large enough for any keyframe, so pushing never allocates
+    encoded.reserve(2 * sizeof(Snapshot));
+}
+
+void Rewind::push(const Chip8& chip8) {
+    chip8.save(*current);
+
+    if (entries.empty() || since_keyframe + 1 >= REWIND_KEYFRAME_INTERVAL) {
+        push_keyframe();
+        return;
+    }
+
+    unsigned long length = std::max(span(*current), span(*base));
+    encode(reinterpret_cast<const unsigned char*>(current.get()), reinterpret_cast<const unsigned char*>(base.get()),
+           length, encoded);
+    if (store(since_keyframe + 1)) {
+        since_keyframe++;
+        return;
+    }
+
+    // Not even this second's history fits, start over from this frame
+    clear();
+    push_keyframe();
+}
+
+void Rewind::push_keyframe() {
+    // Keyframes are XORed with zero bytes
+    static const std::vector<unsigned char> zero(sizeof(Snapshot), 0);
+
+    encode(reinterpret_cast<const unsigned char*>(current.get()), zero.data(), span(*current), encoded);
+    if (!store(0)) {
+        // A budget too small for a single keyframe holds no history
+        clear();
+        return;
+    }
+
+    // Everything past either span is zero
+    std::memcpy(base.get(), current.get(), std::max(span(*current), span(*base)));
+    since_keyframe = 0;
+}
+
+bool Rewind::store(unsigned int position) {
+    unsigned long offset = 0;
+    while (!allocate(encoded.size(), offset)) {
+        // A delta cannot outlive its keyframe
+        if (entries.empty() || (position != 0 && entries.front().offset == entries.back().keyframe_offset)) {
+            return false;
+        }
+        drop_oldest_second();
+    }
+
+    std::copy(encoded.begin(), encoded.end(), ring.begin() + static_cast<long>(offset));
+
+    Entry entry;
+    entry.offset = offset;
+    entry.size = encoded.size();
+    entry.position = position;
+    if (position == 0) {
+        entry.keyframe_offset = offset;
+        entry.keyframe_size = encoded.size();
+    } else {
+        entry.keyframe_offset = entries.back().keyframe_offset;
+        entry.keyframe_size = entries.back().keyframe_size;
+    }
+    entries.push_back(entry);
+    used += entry.size;
+    return true;
+}
+
+bool Rewind::allocate(unsigned long size, unsigned long& offset) const {
+    if (entries.empty()) {
+        offset = 0;
+        return size <= ring.size();
+    }
+
+    // Entries are kept in ring order: from the oldest one, up to the end of
+    // the ring and then on from its start
+    unsigned long head = entries.front().offset;
+    unsigned long tail = entries.back().offset + entries.back().size;
+    if (entries.back().offset >= head) {
+        if (ring.size() - tail >= size) {
+            offset = tail;
+            return true;
+        }
+        if (head >= size) {
+            offset = 0;
+            return true;
+        }
+        return false;
+    }
+
+    if (head - tail >= size) {
+        offset = tail;
+        return true;
+    }
+    return false;
+}
+
+void Rewind::drop_oldest_second() {
+    do {
+        used -= entries.front().size;
+        entries.pop_front();
+    } while (!entries.empty() && entries.front().position != 0);
+}
+
+void Rewind::apply(unsigned long offset, unsigned long size, Snapshot& target) const {
+    unsigned char* out = reinterpret_cast<unsigned char*>(&target);
+    const unsigned char* in = ring.data() + offset;
+    const unsigned char* end = in + size;
+
+    unsigned long position = 0;
+    while (in < end) {
+        position += get_varint(in);
+        unsigned long changed = get_varint(in);
+        for (unsigned long i = 0; i < changed; i++) {
+            out[position++] ^= *in++;
+        }
+    }
+}
+
+bool Rewind::step_back(Snapshot& state) {
+    if (entries.size() < 2) {
+        return false;
+    }
+
+    bool crossed_keyframe = entries.back().position == 0;
+    used -= entries.back().size;
+    entries.pop_back();
+
+    const Entry& entry = entries.back();
+    if (crossed_keyframe) {
+        std::memset(reinterpret_cast<unsigned char*>(base.get()), 0, span(*base));
+        apply(entry.keyframe_offset, entry.keyframe_size, *base);
+    }
+    since_keyframe = entry.position;
+
+    std::memcpy(&state, base.get(), std::max(span(state), span(*base)));
+    if (entry.position != 0) {
+        apply(entry.offset, entry.size, state);
+    }
+    return true;
+}
+
+void Rewind::clear() {
+    entries.clear();
+    used = 0;
+    since_keyframe = 0;
+}
+
+unsigned long Rewind::frames() const {
+    return entries.empty() ? 0 : entries.size() - 1;
+}
+
+unsigned long Rewind::bytes_used() const {
+    return used;
+}
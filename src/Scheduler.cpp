@@ -0,0 +1,80 @@
+#include "Scheduler.h"
+
+// How many instructions to run between clock reads when unbounded.
+const unsigned long UNBOUNDED_BATCH = 256;
+
+Scheduler::Scheduler(Chip8& machine, unsigned long instructions_per_frame)
+    : chip8(machine),
+      jit(nullptr),
+      ipf(instructions_per_frame),
+      instructions(0),
+      frames(0),
+      window_start(std::chrono::steady_clock::now()),
+      window_instructions(0),
+      measured_ips(0.0) {}
+
+void Scheduler::use_jit(Jit* translator) {
+    jit = translator;
+}
+
+unsigned long Scheduler::run_cycles(unsigned long cycles) {
+    return jit != nullptr ? jit->run(cycles) : chip8.run(cycles);
+}
+
+void Scheduler::run_frame() {
+    unsigned long executed = run_instructions();
+    chip8.tick_timers();
+
+    instructions += executed;
+    frames++;
+    update_measurement(executed);
+}
+
+void Scheduler::run_frame_ahead() {
+    run_instructions();
+    chip8.tick_timers();
+}
+
+unsigned long Scheduler::run_instructions() {
+    return ipf == 0 ? run_unbounded() : run_cycles(ipf);
+}
+
+unsigned long Scheduler::run_unbounded() {
+    auto deadline = std::chrono::steady_clock::now() + UNBOUNDED_FRAME_BUDGET;
+    unsigned long executed = 0;
+
+    // A waiting program has nothing more to do until the next frame
+    do {
+        executed += run_cycles(UNBOUNDED_BATCH);
+    } while (!chip8.idle() && std::chrono::steady_clock::now() < deadline);
+
+    return executed;
+}
+
+void Scheduler::update_measurement(unsigned long executed) {
+    window_instructions += executed;
+
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - window_start;
+    if (elapsed.count() >= 1.0) {
+        measured_ips = static_cast<double>(window_instructions) / elapsed.count();
+        window_instructions = 0;
+        window_start = now;
+    }
+}
+
+unsigned long Scheduler::instructions_per_frame() const {
+    return ipf;
+}
+
+unsigned long long Scheduler::total_instructions() const {
+    return instructions;
+}
+
+unsigned long long Scheduler::total_frames() const {
+    return frames;
+}
+
+double Scheduler::instructions_per_second() const {
+    return measured_ips;
+}
@@ -0,0 +1,105 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "Snapshot.h"
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CHIP8_MMAP 1
+#else
+#define CHIP8_MMAP 0
+#endif
+
+static bool valid_header(const Snapshot& snapshot) {
+    return snapshot.magic == SNAPSHOT_MAGIC
+        && snapshot.version == SNAPSHOT_VERSION
+        && snapshot.size == sizeof(Snapshot);
+}
+
+// A file with the right header may still be corrupt or made by hand.
+// restore() copies memory_used bytes of memory, and the stack is indexed
+// by sp; the PC and I are always masked into memory. Bools must be 0 or 1,
+// the random number generator never leaves 0 and the display checks its
+// own mode, planes and dirty rows.
+static bool valid_state(const Snapshot& snapshot) {
+    unsigned char sounding;
+    std::memcpy(&sounding, &snapshot.sounding, sizeof(sounding));
+
+    return snapshot.memory_used <= MEMORY_SIZE && snapshot.sp <= snapshot.stack.size()
+        && sounding <= 1 && snapshot.rng_state != 0 && snapshot.fault.kind <= FAULT_EXIT
+        && snapshot.gfx.valid();
+}
+
+void write_snapshot(const Snapshot& snapshot, std::string path) {
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Unable to open snapshot file!");
+    }
+
+    file.write(reinterpret_cast<const char*>(&snapshot), sizeof(Snapshot));
+    if (!file) {
+        throw std::runtime_error("Unable to write snapshot file!");
+    }
+}
+
+SnapshotFile::SnapshotFile(std::string path) : mapped(nullptr) {
+#if CHIP8_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Unable to open snapshot file!");
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<unsigned long>(info.st_size) != sizeof(Snapshot)) {
+        close(fd);
+        throw std::runtime_error("Not a snapshot file or unsupported version!");
+    }
+
+    void* data = mmap(nullptr, sizeof(Snapshot), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the file is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Unable to map snapshot file!");
+    }
+    mapped = static_cast<const Snapshot*>(data);
+#else
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Unable to open snapshot file!");
+    }
+
+    copy.resize(1);
+    file.read(reinterpret_cast<char*>(copy.data()), sizeof(Snapshot));
+    if (file.gcount() != static_cast<std::streamsize>(sizeof(Snapshot)) || file.peek() != EOF) {
+        throw std::runtime_error("Not a snapshot file or unsupported version!");
+    }
+    mapped = copy.data();
+#endif
+
+    const char* error = nullptr;
+    if (!valid_header(*mapped)) {
+        error = "Not a snapshot file or unsupported version!";
+    } else if (!valid_state(*mapped)) {
+        error = "Corrupt snapshot file!";
+    }
+    if (error != nullptr) {
+#if CHIP8_MMAP
+        munmap(const_cast<Snapshot*>(mapped), sizeof(Snapshot));
+#endif
+        throw std::runtime_error(error);
+    }
+}
+
+SnapshotFile::~SnapshotFile() {
+#if CHIP8_MMAP
+    munmap(const_cast<Snapshot*>(mapped), sizeof(Snapshot));
+#endif
+}
+
+const Snapshot& SnapshotFile::snapshot() const {
+    return *mapped;
+}
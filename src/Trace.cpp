@@ -0,0 +1,21 @@
+#include <fstream>
+#include <stdexcept>
+
+#include "Trace.h"
+
+void TraceBuffer::write(std::string path) const {
+    std::ofstream file(path, std::ios::out | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Unable to open trace file!");
+    }
+
+    TraceFileHeader header = {TRACE_MAGIC, TRACE_VERSION, sizeof(TraceEntry), static_cast<uint32_t>(size)};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // The oldest entry is at head once the buffer has wrapped around
+    unsigned long start = size < TRACE_CAPACITY ? 0 : head;
+    for (unsigned long i = 0; i < size; i++) {
+        const TraceEntry& entry = entries[(start + i) % TRACE_CAPACITY];
+        file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    }
+}
@@ -0,0 +1,116 @@
+#include "WorkStealingPool.h"
+
+WorkStealingPool::WorkStealingPool(unsigned int threads)
+    : next_queue(0), pending(0), stopping(false) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    for (unsigned int i = 0; i < threads; i++) {
+        queues.emplace_back(new Queue());
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.emplace_back(&WorkStealingPool::work, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void WorkStealingPool::submit(std::function<void()> task) {
+    Queue& queue = *queues[next_queue];
+    next_queue = static_cast<unsigned int>((next_queue + 1) % queues.size());
+
+    pending++;
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    // Taking the lock orders the push before a worker's emptiness check
+    { std::lock_guard<std::mutex> lock(idle_mutex); }
+    work_available.notify_one();
+}
+
+void WorkStealingPool::wait() {
+    std::unique_lock<std::mutex> lock(idle_mutex);
+    all_done.wait(lock, [this] { return pending == 0; });
+}
+
+unsigned int WorkStealingPool::size() const {
+    return static_cast<unsigned int>(workers.size());
+}
+
+bool WorkStealingPool::take(unsigned int index, std::function<void()>& task) {
+    // Newest task from our own queue first
+    {
+        Queue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Then the oldest task of any other queue
+    for (unsigned long i = 1; i < queues.size(); i++) {
+        Queue& victim = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkStealingPool::work(unsigned int index) {
+    std::function<void()> task;
+
+    for (;;) {
+        if (take(index, task)) {
+            task();
+            task = nullptr;
+
+            if (--pending == 0) {
+                std::lock_guard<std::mutex> lock(idle_mutex);
+                all_done.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(idle_mutex);
+        if (stopping) {
+            return;
+        }
+        // Queues are only refilled while holding idle_mutex briefly, so a
+        // task pushed after take() failed is seen by this check.
+        work_available.wait(lock, [this] {
+            if (stopping) {
+                return true;
+            }
+            for (const std::unique_ptr<Queue>& queue : queues) {
+                std::lock_guard<std::mutex> queue_lock(queue->mutex);
+                if (!queue->tasks.empty()) {
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+}
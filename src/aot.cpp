@@ -0,0 +1,78 @@
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Quirks.h"
+#include "Recompiler.h"
+
+// Translates a Chip8 program into a C++ translation unit. Built with
+// src/AotRuntime.cpp, src/aot_main.cpp and the core, the unit is a native
+// runner for that program; `make game.aot` does all of it for game.ch8.
+
+void print_usage();
+
+void print_usage() {
+    std::cout << "Usage: ./chip8-aot [options] path\n"
+              << "  -o path      write the translation unit to path (default: path.cpp)\n"
+              << "  --quirks Q   quirks to translate for, as for ./headless (default: default)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = nullptr;
+    std::string output;
+    std::string quirks = "default";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "-o" && has_value) {
+            output = argv[++i];
+        } else if (arg == "--quirks" && has_value) {
+            quirks = argv[++i];
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (path == nullptr) {
+        print_usage();
+        return 0;
+    }
+    if (output.empty()) {
+        output = std::string(path) + ".cpp";
+    }
+
+    try {
+        std::ifstream file(path, std::ios::in | std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Unable to open program file!");
+        }
+        std::vector<unsigned char> program((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        Recompiler recompiler(program, parse_quirks(quirks));
+
+        std::ofstream out(output, std::ios::out | std::ios::trunc);
+        if (!out.is_open()) {
+            throw std::runtime_error("Unable to open output file!");
+        }
+        std::string name = path;
+        recompiler.write(out, name.substr(name.find_last_of('/') + 1));
+        if (!out) {
+            throw std::runtime_error("Unable to write output file!");
+        }
+
+        std::cout << "Blocks: " << recompiler.blocks().size() << "\n"
+                  << "Instructions found: " << recompiler.reachable_instructions() << "\n"
+                  << "Instructions translated: " << recompiler.translated_instructions() << "\n"
+                  << "Wrote " << output << std::endl;
+    } catch (std::exception const& e) {
+        std::cout << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
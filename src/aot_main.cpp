@@ -0,0 +1,143 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "AotRuntime.h"
+#include "Chip8.h"
+#include "InputScript.h"
+
+// Runs the program chip8-aot translated, linked in as aot_program, without
+// a display, and dumps the final machine state like ./headless does.
+
+const unsigned long DEFAULT_INSTRUCTIONS_PER_FRAME = 10;
+const unsigned long DEFAULT_FRAMES = 600;
+
+void print_usage(const char* command);
+void dump_graphics(const Chip8& chip8);
+
+void print_usage(const char* command) {
+    std::cout << "Usage: " << command << " [options]\n"
+              << "  --frames N   run N frames (default " << DEFAULT_FRAMES << ")\n"
+              << "  --cycles N   run N instructions instead of a number of frames\n"
+              << "  --ipf N      instructions per frame (default " << DEFAULT_INSTRUCTIONS_PER_FRAME << ")\n"
+              << "  --keys path  apply a scripted key input file\n"
+              << "  --seed N     seed of the CXNN random number generator\n"
+              << "  --check      check every translated block against the interpreter\n"
+              << "  --interpret  run on the interpreter only, for comparison" << std::endl;
+}
+
+void dump_graphics(const Chip8& chip8) {
+    // One character per color; plain CHIP-8 only uses the first two
+    const char colors[] = ".#+@";
+    for (unsigned int row = 0; row < chip8.gfx.height(); row++) {
+        for (unsigned int col = 0; col < chip8.gfx.width(); col++) {
+            std::cout << colors[chip8.gfx.pixel(col, row)];
+        }
+        std::cout << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    unsigned long instructions_per_frame = DEFAULT_INSTRUCTIONS_PER_FRAME;
+    unsigned long frames = DEFAULT_FRAMES;
+    unsigned long cycles = 0;
+    const char* keys_path = nullptr;
+    bool check = false;
+    bool interpret = false;
+    uint32_t seed = DEFAULT_SEED;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--frames" && has_value) {
+            frames = std::stoul(argv[++i]);
+        } else if (arg == "--cycles" && has_value) {
+            cycles = std::stoul(argv[++i]);
+        } else if (arg == "--ipf" && has_value) {
+            instructions_per_frame = std::stoul(argv[++i]);
+        } else if (arg == "--keys" && has_value) {
+            keys_path = argv[++i];
+        } else if (arg == "--seed" && has_value) {
+            seed = static_cast<uint32_t>(std::stoul(argv[++i], nullptr, 0));
+        } else if (arg == "--check") {
+            check = true;
+        } else if (arg == "--interpret") {
+            interpret = true;
+        } else {
+            print_usage(argv[0]);
+            return 0;
+        }
+    }
+
+    if (instructions_per_frame == 0) {
+        print_usage(argv[0]);
+        return 0;
+    }
+
+    // A cycle budget is turned into whole frames plus a partial last frame
+    if (cycles != 0) {
+        frames = cycles / instructions_per_frame;
+    }
+    unsigned long remainder = cycles % instructions_per_frame;
+
+    Chip8 chip8;
+    InputScript script;
+
+    try {
+        chip8.initialize(seed);
+        chip8.set_quirks(aot_program.quirks);
+        chip8.load_program(aot_program.rom, aot_program.size);
+        if (keys_path != nullptr) {
+            script.load(keys_path);
+        }
+    } catch (std::exception const& e) {
+        std::cout << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    AotRuntime runtime(chip8, aot_program);
+    if (check) {
+        runtime.enable_check();
+    }
+    unsigned long long executed = 0;
+    unsigned long long frame_count = 0;
+    int status = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+        for (unsigned long frame = 0; frame < frames && !chip8.faulted(); frame++) {
+            script.apply(frame, chip8.keys);
+            executed += interpret ? chip8.run(instructions_per_frame) : runtime.run(instructions_per_frame);
+            chip8.tick_timers();
+            frame_count++;
+        }
+
+        script.apply(frames, chip8.keys);
+        executed += interpret ? chip8.run(remainder) : runtime.run(remainder);
+    } catch (std::exception const& e) {
+        std::cout << "Exception: " << e.what() << std::endl;
+        status = 1;
+    }
+    if (chip8.faulted()) {
+        // 00FD is how SUPER-CHIP programs end normally
+        if (chip8.fault().kind == FAULT_EXIT) {
+            std::cout << describe_fault(chip8.fault()) << std::endl;
+        } else {
+            std::cout << "Fault: " << describe_fault(chip8.fault()) << std::endl;
+            status = 1;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    dump_graphics(chip8);
+    chip8.dump_state(std::cout);
+    std::cout << "Frames: " << frame_count << "\n"
+              << "Cycles: " << executed << "\n"
+              << "Time: " << elapsed.count() << " s\n"
+              << "Instructions/s: " << static_cast<double>(executed) / elapsed.count() << "\n"
+              << "Translated: " << runtime.translated_instructions() << " of " << runtime.total_instructions()
+              << " instructions" << std::endl;
+
+    return status;
+}
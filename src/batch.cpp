@@ -0,0 +1,326 @@
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Chip8.h"
+#include "InputScript.h"
+#include "Jit.h"
+#include "Scheduler.h"
+#include "WorkStealingPool.h"
+
+// Runs many Chip8 programs headlessly in parallel, one machine per job, and
+// reports the final display hash of each run.
+//
+// The manifest lists one job per line:
+//     <rom> <keys> <cycles> <expected hash>
+// keys and the expected hash may be '-' for none. Blank lines and lines
+// starting with '#' are ignored.
+
+const unsigned long DEFAULT_INSTRUCTIONS_PER_FRAME = 10;
+
+struct Job {
+    std::string rom;
+    std::string keys;
+    unsigned long cycles;
+    bool has_expected;
+    uint64_t expected;
+};
+
+struct Result {
+    std::string status;
+    std::string error;
+    uint64_t hash;
+    unsigned long long executed;
+    double seconds;
+};
+
+void print_usage();
+std::vector<Job> load_manifest(const std::string& path);
+void run_job(const Job& job, const std::vector<unsigned char>& program, unsigned long ipf, bool use_jit,
+             uint32_t seed, unsigned int quirks, Result& result);
+std::string hex(uint64_t value);
+std::string json_escape(const std::string& text);
+void write_json(std::ostream& out, const std::vector<Job>& jobs, const std::vector<Result>& results);
+void write_csv(std::ostream& out, const std::vector<Job>& jobs, const std::vector<Result>& results);
+
+void print_usage() {
+    std::cout << "Usage: ./chip8-batch [options] manifest\n"
+              << "  --threads N      worker threads (default: one per hardware thread)\n"
+              << "  --ipf N          instructions per frame (default " << DEFAULT_INSTRUCTIONS_PER_FRAME << ")\n"
+              << "  --core=jit       run on the x86-64 JIT (--core=interp is the default)\n"
+              << "  --seed N         seed of the CXNN random number generator for every job\n"
+              << "  --quirks Q       quirks for every job, see ./headless\n"
+              << "  --format F       json (default) or csv\n"
+              << "  --output path    write the report to a file instead of stdout" << std::endl;
+}
+
+std::vector<Job> load_manifest(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Could not open batch manifest " + path);
+    }
+
+    std::vector<Job> jobs;
+    std::string line;
+    unsigned long number = 0;
+    while (std::getline(file, line)) {
+        number++;
+        std::istringstream fields(line);
+        std::string rom;
+        if (!(fields >> rom) || rom[0] == '#') {
+            continue;
+        }
+
+        std::string keys, cycles, expected;
+        if (!(fields >> keys >> cycles >> expected)) {
+            throw std::runtime_error("Malformed batch manifest line " + std::to_string(number));
+        }
+
+        Job job;
+        job.rom = rom;
+        job.keys = keys == "-" ? "" : keys;
+        job.cycles = std::stoul(cycles);
+        job.has_expected = expected != "-";
+        job.expected = job.has_expected ? std::stoull(expected, nullptr, 16) : 0;
+        jobs.push_back(job);
+    }
+
+    return jobs;
+}
+
+void run_job(const Job& job, const std::vector<unsigned char>& program, unsigned long ipf, bool use_jit,
+             uint32_t seed, unsigned int quirks, Result& result) {
+    auto start = std::chrono::steady_clock::now();
+
+    try {
+        // Machines are large, keep them off the worker's stack
+        std::unique_ptr<Chip8> chip8(new Chip8());
+        chip8->initialize(seed);
+        chip8->set_quirks(quirks);
+        chip8->load_program(program.data(), program.size());
+
+        InputScript script;
+        if (!job.keys.empty()) {
+            script.load(job.keys);
+        }
+
+        // So is the JIT's block table
+        std::unique_ptr<Jit> jit(new Jit(*chip8));
+        Scheduler scheduler(*chip8, ipf);
+        if (use_jit) {
+            scheduler.use_jit(jit.get());
+        }
+
+        unsigned long frames = job.cycles / ipf;
+        for (unsigned long frame = 0; frame < frames; frame++) {
+            script.apply(frame, chip8->keys);
+            scheduler.run_frame();
+            if (chip8->faulted()) {
+                break;
+            }
+        }
+        script.apply(frames, chip8->keys);
+        result.executed = scheduler.total_instructions() + scheduler.run_cycles(job.cycles % ipf);
+
+        result.hash = chip8->gfx.hash();
+        // 00FD ends a program normally, its display is still checked
+        if (chip8->faulted() && chip8->fault().kind != FAULT_EXIT) {
+            result.status = "error";
+            result.error = describe_fault(chip8->fault());
+        } else if (!job.has_expected) {
+            result.status = "done";
+        } else {
+            result.status = result.hash == job.expected ? "pass" : "fail";
+        }
+    } catch (std::exception const& e) {
+        result.status = "error";
+        result.error = e.what();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.seconds = elapsed.count();
+}
+
+std::string hex(uint64_t value) {
+    std::ostringstream out;
+    out << std::hex << std::setw(16) << std::setfill('0') << value;
+    return out.str();
+}
+
+std::string json_escape(const std::string& text) {
+    const char digits[] = "0123456789abcdef";
+    std::string escaped;
+    for (char c : text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else if (c == '\t') {
+            escaped += "\\t";
+        } else if (byte < 0x20) {
+            // Other control characters are not allowed in JSON strings
+            escaped += "\\u00";
+            escaped += digits[byte >> 4];
+            escaped += digits[byte & 0xF];
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+void write_json(std::ostream& out, const std::vector<Job>& jobs, const std::vector<Result>& results) {
+    out << "[\n";
+    for (unsigned long i = 0; i < jobs.size(); i++) {
+        const Result& result = results[i];
+        out << "  {\"rom\": \"" << json_escape(jobs[i].rom) << "\""
+            << ", \"status\": \"" << result.status << "\""
+            << ", \"hash\": \"" << hex(result.hash) << "\""
+            << ", \"cycles\": " << result.executed
+            << ", \"seconds\": " << result.seconds
+            << ", \"ips\": " << static_cast<double>(result.executed) / result.seconds;
+        if (!result.error.empty()) {
+            out << ", \"error\": \"" << json_escape(result.error) << "\"";
+        }
+        out << "}" << (i + 1 < jobs.size() ? "," : "") << "\n";
+    }
+    out << "]" << std::endl;
+}
+
+void write_csv(std::ostream& out, const std::vector<Job>& jobs, const std::vector<Result>& results) {
+    out << "rom,status,hash,cycles,seconds,ips,error\n";
+    for (unsigned long i = 0; i < jobs.size(); i++) {
+        const Result& result = results[i];
+        out << jobs[i].rom << "," << result.status << "," << hex(result.hash) << ","
+            << result.executed << "," << result.seconds << ","
+            << static_cast<double>(result.executed) / result.seconds << ","
+            << result.error << "\n";
+    }
+    out.flush();
+}
+
+int main(int argc, char* argv[]) {
+    unsigned long instructions_per_frame = DEFAULT_INSTRUCTIONS_PER_FRAME;
+    unsigned int threads = 0;
+    bool use_jit = false;
+    uint32_t seed = DEFAULT_SEED;
+    std::string quirks_spec = "default";
+    unsigned int quirks = 0;
+    std::string format = "json";
+    const char* manifest_path = nullptr;
+    const char* output_path = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--threads" && has_value) {
+            threads = static_cast<unsigned int>(std::stoul(argv[++i]));
+        } else if (arg == "--ipf" && has_value) {
+            instructions_per_frame = std::stoul(argv[++i]);
+        } else if (arg == "--quirks" && has_value) {
+            quirks_spec = argv[++i];
+        } else if (arg == "--seed" && has_value) {
+            seed = static_cast<uint32_t>(std::stoul(argv[++i], nullptr, 0));
+        } else if (arg == "--format" && has_value) {
+            format = argv[++i];
+        } else if (arg == "--output" && has_value) {
+            output_path = argv[++i];
+        } else if (arg == "--core=jit") {
+            use_jit = true;
+        } else if (arg == "--core=interp") {
+            use_jit = false;
+        } else {
+            manifest_path = argv[i];
+        }
+    }
+
+    if (manifest_path == nullptr || instructions_per_frame == 0 || (format != "json" && format != "csv")) {
+        print_usage();
+        return 0;
+    }
+
+    std::vector<Job> jobs;
+    // Each ROM is read once and shared read-only by every job using it
+    std::map<std::string, std::vector<unsigned char>> programs;
+
+    try {
+        quirks = parse_quirks(quirks_spec);
+        jobs = load_manifest(manifest_path);
+        for (const Job& job : jobs) {
+            if (programs.count(job.rom) != 0) {
+                continue;
+            }
+            std::ifstream file(job.rom, std::ios::binary);
+            if (!file) {
+                throw std::runtime_error("Could not open program " + job.rom);
+            }
+            programs[job.rom].assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+    } catch (std::exception const& e) {
+        std::cout << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (use_jit && !Jit::available()) {
+        std::cerr << "The JIT is not available on this host, using the interpreter" << std::endl;
+    }
+
+    // Every job writes only its own slot, so results need no locking
+    std::vector<Result> results(jobs.size());
+    auto start = std::chrono::steady_clock::now();
+    unsigned int workers;
+    {
+        WorkStealingPool pool(threads);
+        workers = pool.size();
+        for (unsigned long i = 0; i < jobs.size(); i++) {
+            const Job& job = jobs[i];
+            const std::vector<unsigned char>& program = programs[job.rom];
+            Result& result = results[i];
+            pool.submit([&job, &program, &result, instructions_per_frame, use_jit, seed, quirks] {
+                run_job(job, program, instructions_per_frame, use_jit, seed, quirks, result);
+            });
+        }
+        pool.wait();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::ofstream output_file;
+    if (output_path != nullptr) {
+        output_file.open(output_path);
+        if (!output_file) {
+            std::cout << "Exception: Could not open " << output_path << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = output_path != nullptr ? output_file : std::cout;
+    if (format == "json") {
+        write_json(out, jobs, results);
+    } else {
+        write_csv(out, jobs, results);
+    }
+
+    unsigned long long executed = 0;
+    unsigned long failed = 0;
+    for (const Result& result : results) {
+        executed += result.executed;
+        if (result.status == "fail" || result.status == "error") {
+            failed++;
+        }
+    }
+    std::cerr << "Jobs: " << jobs.size() << " (" << failed << " failed)\n"
+              << "Threads: " << workers << "\n"
+              << "Time: " << elapsed.count() << " s\n"
+              << "Instructions/s: " << static_cast<double>(executed) / elapsed.count() << std::endl;
+
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,266 @@
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "Chip8.h"
+#include "InputMovie.h"
+#include "InputScript.h"
+#include "Jit.h"
+#include "Scheduler.h"
+#include "Snapshot.h"
+
+// Runs a Chip8 program without a display, as fast as the host allows,
+// and dumps the final machine state.
+
+const unsigned long DEFAULT_INSTRUCTIONS_PER_FRAME = 10;
+const unsigned long DEFAULT_FRAMES = 600;
+
+void print_usage();
+void dump_graphics(const Chip8& chip8);
+
+void print_usage() {
+    std::cout << "Usage: ./headless [options] [path]\n"
+              << "  --frames N   run N frames (default " << DEFAULT_FRAMES << ")\n"
+              << "  --cycles N   run N instructions instead of a number of frames\n"
+              << "  --ipf N      instructions per frame (default " << DEFAULT_INSTRUCTIONS_PER_FRAME << ")\n"
+              << "  --keys path  apply a scripted key input file\n"
+              << "  --seed N     seed of the CXNN random number generator\n"
+              << "  --quirks Q   comma separated quirks or presets: cosmac, schip, xochip, shift-vy,\n"
+              << "               load-store-increment, jump-vx, clip\n"
+              << "  --record path  record the key input of every frame to a movie file\n"
+              << "  --replay path  replay a movie with its seed and speed, and check its final display hash\n"
+              << "  --load-state path  start from a saved machine state instead of the program's start\n"
+              << "  --save-state path  save the final machine state\n"
+              << "  --core=jit   run on the x86-64 JIT (--core=interp is the default)\n"
+              << "  --check      check every JIT block against the interpreter\n"
+              << "  --trace path write the instruction trace (needs a TRACE=n build)\n"
+              << "  --profile path write the profile report and path.folded stacks (needs a PROFILE=1 build)" << std::endl;
+}
+
+void dump_graphics(const Chip8& chip8) {
+    // One character per color; plain CHIP-8 only uses the first two
+    const char colors[] = ".#+@";
+    for (unsigned int row = 0; row < chip8.gfx.height(); row++) {
+        for (unsigned int col = 0; col < chip8.gfx.width(); col++) {
+            std::cout << colors[chip8.gfx.pixel(col, row)];
+        }
+        std::cout << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    unsigned long instructions_per_frame = DEFAULT_INSTRUCTIONS_PER_FRAME;
+    unsigned long frames = DEFAULT_FRAMES;
+    unsigned long cycles = 0;
+    const char* path = nullptr;
+    const char* keys_path = nullptr;
+    const char* trace_path = nullptr;
+    const char* profile_path = nullptr;
+    const char* record_path = nullptr;
+    const char* replay_path = nullptr;
+    const char* load_state_path = nullptr;
+    const char* save_state_path = nullptr;
+    bool use_jit = false;
+    bool check = false;
+    uint32_t seed = DEFAULT_SEED;
+    std::string quirks = "default";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--frames" && has_value) {
+            frames = std::stoul(argv[++i]);
+        } else if (arg == "--cycles" && has_value) {
+            cycles = std::stoul(argv[++i]);
+        } else if (arg == "--ipf" && has_value) {
+            instructions_per_frame = std::stoul(argv[++i]);
+        } else if (arg == "--keys" && has_value) {
+            keys_path = argv[++i];
+        } else if (arg == "--trace" && has_value) {
+            trace_path = argv[++i];
+        } else if (arg == "--profile" && has_value) {
+            profile_path = argv[++i];
+        } else if (arg == "--record" && has_value) {
+            record_path = argv[++i];
+        } else if (arg == "--replay" && has_value) {
+            replay_path = argv[++i];
+        } else if (arg == "--load-state" && has_value) {
+            load_state_path = argv[++i];
+        } else if (arg == "--save-state" && has_value) {
+            save_state_path = argv[++i];
+        } else if (arg == "--quirks" && has_value) {
+            quirks = argv[++i];
+        } else if (arg == "--seed" && has_value) {
+            seed = static_cast<uint32_t>(std::stoul(argv[++i], nullptr, 0));
+        } else if (arg == "--core=jit") {
+            use_jit = true;
+        } else if (arg == "--core=interp") {
+            use_jit = false;
+        } else if (arg == "--check") {
+            check = true;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    InputMovie movie;
+    if (replay_path != nullptr) {
+        // A movie only reproduces its session with the settings it was made with
+        try {
+            movie.load(replay_path);
+        } catch (std::exception const& e) {
+            std::cout << "Exception: " << e.what() << std::endl;
+            return 1;
+        }
+        seed = movie.seed();
+        instructions_per_frame = movie.instructions_per_frame();
+        frames = movie.frames();
+        cycles = 0;
+    }
+
+    if (path == nullptr || instructions_per_frame == 0) {
+        print_usage();
+        return 0;
+    }
+
+    // A cycle budget is turned into whole frames plus a partial last frame
+    if (cycles != 0) {
+        frames = cycles / instructions_per_frame;
+    }
+    unsigned long remainder = cycles % instructions_per_frame;
+
+    // The machine and the JIT's block table are large, keep them off the
+    // stack
+    std::unique_ptr<Chip8> machine = std::make_unique<Chip8>();
+    Chip8& chip8 = *machine;
+    InputScript script;
+
+    try {
+        chip8.initialize(seed);
+        chip8.set_quirks(replay_path != nullptr ? movie.quirks() : parse_quirks(quirks));
+        chip8.load_program(path);
+        if (load_state_path != nullptr) {
+            SnapshotFile state(load_state_path);
+            chip8.restore(state.snapshot());
+        }
+        if (keys_path != nullptr) {
+            script.load(keys_path);
+        }
+    } catch (std::exception const& e) {
+        std::cout << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<Jit> jit = std::make_unique<Jit>(chip8);
+    Scheduler scheduler(chip8, instructions_per_frame);
+    if (use_jit) {
+        if (!Jit::available()) {
+            std::cout << "The JIT is not available on this host, using the interpreter" << std::endl;
+        }
+        if (check) {
+            jit->enable_check();
+        }
+        scheduler.use_jit(jit.get());
+    }
+    unsigned long long executed = 0;
+    int status = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+        if (record_path != nullptr) {
+            movie.start(seed, instructions_per_frame, chip8.quirks());
+        }
+        for (unsigned long frame = 0; frame < frames; frame++) {
+            if (replay_path != nullptr) {
+                movie.apply(frame, chip8.keys);
+            } else {
+                script.apply(frame, chip8.keys);
+            }
+            if (record_path != nullptr) {
+                movie.record(frame, chip8.keys);
+            }
+            scheduler.run_frame();
+            if (chip8.faulted()) {
+                break;
+            }
+        }
+        executed = scheduler.total_instructions();
+        // Movies only cover whole frames
+        if (record_path != nullptr) {
+            movie.finish(frames, chip8.gfx.hash());
+        }
+
+        script.apply(frames, chip8.keys);
+        executed += scheduler.run_cycles(remainder);
+    } catch (std::exception const& e) {
+        std::cout << "Exception: " << e.what() << std::endl;
+        status = 1;
+    }
+    if (chip8.faulted()) {
+        // 00FD is how SUPER-CHIP programs end normally
+        if (chip8.fault().kind == FAULT_EXIT) {
+            std::cout << describe_fault(chip8.fault()) << std::endl;
+        } else {
+            std::cout << "Fault: " << describe_fault(chip8.fault()) << std::endl;
+            status = 1;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    dump_graphics(chip8);
+    chip8.dump_state(std::cout);
+    std::cout << "Frames: " << scheduler.total_frames() << "\n"
+              << "Cycles: " << executed << "\n"
+              << "Time: " << elapsed.count() << " s\n"
+              << "Instructions/s: " << static_cast<double>(executed) / elapsed.count() << std::endl;
+
+    if (replay_path != nullptr && status == 0) {
+        if (chip8.gfx.hash() == movie.final_hash()) {
+            std::cout << "Replay: display hash matches" << std::endl;
+        } else {
+            std::cout << "Replay: display hash " << std::hex << chip8.gfx.hash()
+                      << " does not match the recorded " << movie.final_hash() << std::dec << std::endl;
+            status = 1;
+        }
+    }
+
+    if (record_path != nullptr && status == 0) {
+        try {
+            movie.write(record_path);
+        } catch (std::exception const& e) {
+            std::cout << "Exception: " << e.what() << std::endl;
+            status = 1;
+        }
+    }
+
+    if (save_state_path != nullptr) {
+        try {
+            std::unique_ptr<Snapshot> state(new Snapshot());
+            chip8.save(*state);
+            write_snapshot(*state, save_state_path);
+        } catch (std::exception const& e) {
+            std::cout << "Exception: " << e.what() << std::endl;
+            status = 1;
+        }
+    }
+
+    if (trace_path != nullptr) {
+#if CHIP8_TRACE
+        chip8.trace.write(trace_path);
+#else
+        std::cout << "Tracing is compiled out, rebuild with TRACE=1 or TRACE=2" << std::endl;
+#endif
+    }
+
+    if (profile_path != nullptr) {
+#if CHIP8_PROFILE
+        chip8.profile.write(profile_path);
+#else
+        std::cout << "Profiling is compiled out, rebuild with PROFILE=1" << std::endl;
+#endif
+    }
+
+    return status;
+}
@@ -0,0 +1,91 @@
+#include <new>
+
+#include "Chip8.h"
+#include "Quirks.h"
+#include "Snapshot.h"
+#include "libchip8.h"
+
+static_assert(CHIP8_QUIRK_SHIFT_VY == QUIRK_SHIFT_VY, "C quirks must match Quirks.h");
+static_assert(CHIP8_QUIRK_LOAD_STORE_INCREMENT == QUIRK_LOAD_STORE_INCREMENT, "C quirks must match Quirks.h");
+static_assert(CHIP8_QUIRK_JUMP_VX == QUIRK_JUMP_VX, "C quirks must match Quirks.h");
+static_assert(CHIP8_QUIRK_CLIP_SPRITES == QUIRK_CLIP_SPRITES, "C quirks must match Quirks.h");
+static_assert(CHIP8_FRAME_WIDTH == Display::HiresPlane::WIDTH && CHIP8_FRAME_HEIGHT == Display::HiresPlane::HEIGHT,
+              "frames are hi-res images");
+
+struct chip8_machine {
+    Chip8 chip8;
+    // Just after the program was loaded, what a reset goes back to
+    Snapshot loaded;
+    unsigned long instructions_per_frame;
+};
+
+chip8_machine* chip8_create(void) {
+    chip8_machine* machine = new (std::nothrow) chip8_machine();
+    if (machine == nullptr) {
+        return nullptr;
+    }
+    machine->chip8.initialize();
+    machine->chip8.save(machine->loaded);
+    machine->instructions_per_frame = CHIP8_DEFAULT_INSTRUCTIONS_PER_FRAME;
+    return machine;
+}
+
+void chip8_destroy(chip8_machine* machine) {
+    delete machine;
+}
+
+int chip8_load_rom(chip8_machine* machine, const uint8_t* rom, size_t size, uint32_t seed) {
+    if (size > MAX_PROGRAM_SIZE) {
+        return CHIP8_ERROR_TOO_LARGE;
+    }
+    machine->chip8.initialize(seed);
+    machine->chip8.load_program(rom, size);
+    machine->chip8.save(machine->loaded);
+    return CHIP8_OK;
+}
+
+void chip8_reset(chip8_machine* machine, uint32_t seed) {
+    // Restoring only copies what differs, unlike initializing again
+    machine->chip8.restore(machine->loaded);
+    machine->chip8.seed_random(seed);
+}
+
+void chip8_set_quirks(chip8_machine* machine, uint32_t quirks) {
+    machine->chip8.set_quirks(quirks);
+    machine->loaded.quirks = machine->chip8.quirks();
+}
+
+void chip8_set_instructions_per_frame(chip8_machine* machine, uint32_t instructions) {
+    machine->instructions_per_frame = instructions != 0 ? instructions : 1;
+}
+
+size_t chip8_step_frames(chip8_machine* const machines[], size_t n, const uint16_t inputs[], uint8_t* frames) {
+    size_t faulted = 0;
+    for (size_t i = 0; i < n; i++) {
+        Chip8& chip8 = machines[i]->chip8;
+        if (inputs != nullptr) {
+            for (unsigned int key = 0; key < chip8.keys.size(); key++) {
+                chip8.keys[key] = static_cast<unsigned char>((inputs[i] >> key) & 1);
+            }
+        }
+
+        chip8.run(machines[i]->instructions_per_frame);
+        chip8.tick_timers();
+
+        if (frames != nullptr) {
+            chip8.gfx.expand_to_hires_colors(frames + i * CHIP8_FRAME_BYTES);
+        }
+        if (chip8.faulted()) {
+            faulted++;
+        }
+    }
+    return faulted;
+}
+
+int chip8_faulted(const chip8_machine* machine) {
+    return machine->chip8.faulted();
+}
+
+int chip8_sound_playing(const chip8_machine* machine) {
+    return machine->chip8.sound_playing();
+}
@@ -1,13 +1,31 @@
 #include <stdio.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
 #include <iostream>
-#include <cmath>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <SDL2/SDL.h>
 
+#include "Audio.h"
 #include "Chip8.h"
-
-// Chip8 graphics are 64 x 32
+#include "FramePacer.h"
+#include "InputMovie.h"
+#include "Jit.h"
+#include "Rewind.h"
+#include "Scheduler.h"
+#include "TripleBuffer.h"
+
+// Chip8 graphics are 64 x 32, or 128 x 64 in hi-res mode
 const int DISPLAY_WIDTH = 64;
 const int DISPLAY_HEIGHT = 32;
+const int HIRES_WIDTH = 128;
+const int HIRES_HEIGHT = 64;
 // Use a multiplier to get larger window
 const int DISPLAY_MULTIPLIER = 10;
 
@@ -15,148 +33,337 @@ const int DISPLAY_MULTIPLIER = 10;
 const int SCREEN_WIDTH = DISPLAY_WIDTH * DISPLAY_MULTIPLIER;
 const int SCREEN_HEIGHT = DISPLAY_HEIGHT * DISPLAY_MULTIPLIER;
 
-void draw_graphics(SDL_Renderer* renderer, Chip8& chip8);
-bool handle_input(Chip8& chip8);
+// 10 instructions per frame is roughly the 600 Hz most games expect.
+const unsigned long DEFAULT_INSTRUCTIONS_PER_FRAME = 10;
+
+// Colors of dark pixels, pixels lit in the first, the second and both
+// planes, in ARGB8888
+const std::array<uint32_t, 4> PALETTE = {{0xFF000000, 0xFFFFFFFF, 0xFFAA4400, 0xFFFFAA00}};
+
+// Longest the SDL thread sleeps waiting for events, so the title keeps
+// updating while nothing happens
+const int IDLE_WAIT_MS = 250;
+
+// Audio output format: mono 16-bit samples, in buffers of about 12 ms
+const int AUDIO_SAMPLE_RATE = 44100;
+const Uint16 AUDIO_BUFFER_SAMPLES = 512;
+
+// Rewind history kept by default, in megabytes. Most programs take a few
+// hundred bytes a frame, so this is many minutes.
+const unsigned long DEFAULT_REWIND_MB = 16;
+
+// A finished frame, handed from the emulation thread to the SDL thread.
+struct Frame {
+    Display display;
+    // Counts published frames. A gap means the SDL thread skipped some, and
+    // with them the rows they marked dirty.
+    unsigned long sequence;
+};
+
+// State shared by the emulation thread and the SDL thread. The machine,
+// scheduler, movie and rewind history belong to the emulation thread while
+// it runs; the SDL thread only touches the atomics and its end of the frame
+// buffer.
+struct Emulation {
+    Emulation(Chip8& machine, Jit& translator, Scheduler& frame_scheduler, AudioStream& sound,
+              InputMovie& input_movie)
+        : chip8(machine), jit(translator), scheduler(frame_scheduler), audio(sound), movie(input_movie),
+          record(false), replay(false), print_stats(false), run_ahead(0), rewind(), pacer(FRAME_DURATION), frames(), keys(0),
+          rewinding(false), running(true), instructions_per_second(0), wake_event(static_cast<Uint32>(-1)),
+          wake_pending(false) {}
+
+    Chip8& chip8;
+    Jit& jit;
+    Scheduler& scheduler;
+    AudioStream& audio;
+    InputMovie& movie;
+    bool record;
+    bool replay;
+    bool print_stats;
+    // Frames shown ahead of the machine, 0 for none
+    unsigned long run_ahead;
+    // Empty when rewinding is disabled
+    std::unique_ptr<Rewind> rewind;
+    FramePacer pacer;
+
+    TripleBuffer<Frame> frames;
+    // Bit n is set while key n is held
+    std::atomic<uint16_t> keys;
+    // Set while the rewind key is held
+    std::atomic<bool> rewinding;
+    // Cleared by either thread to stop both
+    std::atomic<bool> running;
+    std::atomic<unsigned long> instructions_per_second;
+
+    // SDL event the emulation thread pushes to wake the SDL thread for a
+    // new frame or to stop, at most one at a time
+    Uint32 wake_event;
+    std::atomic<bool> wake_pending;
+};
+
+void run_emulation(Emulation& emulation);
+bool run_frame(Emulation& emulation);
+void publish_frame(Emulation& emulation, unsigned long sequence);
+void print_frame_stats(const FramePacer& pacer);
+void upload_frame(const std::array<SDL_Texture*, 2>& textures, const Display& display, bool everything);
+void present_frame(SDL_Renderer* renderer, const std::array<SDL_Texture*, 2>& textures, const Display& display);
+void audio_callback(void* userdata, Uint8* stream, int length);
+int keypad_key(SDL_Keycode sym);
+void wake_display(Emulation& emulation);
+bool handle_input(Emulation& emulation, bool& redraw, bool block);
+
+// Emulation thread. Runs frames at the pacer's rate and publishes the display after
+// each one that drew something, until either thread clears running.
+void run_emulation(Emulation& emulation) {
+    Chip8& chip8 = emulation.chip8;
+    unsigned long published = 0;
+    unsigned long paced = 0;
+    // The frame stepped back to, or the one run ahead from
+    std::unique_ptr<Snapshot> state(new Snapshot());
+    if (emulation.rewind) {
+        emulation.rewind->push(chip8);
+    }
 
-void draw_graphics(SDL_Renderer* renderer, Chip8& chip8) {
-    // Clear screen to black
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
-    // Set drawing color to white
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    while (emulation.running.load(std::memory_order_relaxed)) {
+        // While rewinding, each frame steps back one instead of running.
+        // At the start of the history the machine stays where it is.
+        bool rewinding = emulation.rewind && emulation.rewinding.load(std::memory_order_relaxed);
+        if (rewinding) {
+            if (emulation.rewind->step_back(*state)) {
+                emulation.jit.restore(*state);
+                chip8.gfx.mark_all_dirty();
+                emulation.audio.publish(chip8);
+            }
+        } else if (!run_frame(emulation)) {
+            break;
+        }
 
-    SDL_Rect r;
-    for (unsigned long i = 0; i < chip8.gfx.size(); i++) {
-        if (chip8.gfx[i] == 0) {
-            continue;
+        if (emulation.run_ahead != 0 && !rewinding) {
+            // Show the display as it will be run_ahead frames from now if
+            // the keys stay as they are, then roll back. A key press shows
+            // up that many frames sooner than the program itself reacts.
+            chip8.save(*state);
+            for (unsigned long i = 0; i < emulation.run_ahead && !chip8.faulted(); i++) {
+                emulation.scheduler.run_frame_ahead();
+            }
+            // Whatever drew since the last frame shown was rolled back
+            chip8.gfx.mark_all_dirty();
+            publish_frame(emulation, ++published);
+            emulation.jit.restore(*state);
+        } else if (chip8.gfx.dirty()) {
+            publish_frame(emulation, ++published);
+            chip8.gfx.mark_clean();
+        }
+        emulation.instructions_per_second.store(
+            static_cast<unsigned long>(emulation.scheduler.instructions_per_second()), std::memory_order_relaxed);
+
+        if (emulation.print_stats && ++paced % 60 == 0) {
+            print_frame_stats(emulation.pacer);
+        }
+
+        emulation.pacer.wait();
+    }
+
+    emulation.running.store(false, std::memory_order_relaxed);
+    wake_display(emulation);
+}
+
+// Emulation thread. Runs one frame with the keys held now and records it.
+// Returns false when the emulation should stop.
+bool run_frame(Emulation& emulation) {
+    Chip8& chip8 = emulation.chip8;
+
+    // Keys only change between frames, as movies record them
+    uint16_t held = emulation.keys.load(std::memory_order_relaxed);
+    for (unsigned int key = 0; key < chip8.keys.size(); key++) {
+        chip8.keys[key] = (held >> key) & 1;
+    }
+
+    unsigned long frame = emulation.scheduler.total_frames();
+    if (emulation.replay) {
+        if (frame == emulation.movie.frames()) {
+            std::cout << "Replay: display hash "
+                      << (chip8.gfx.hash() == emulation.movie.final_hash() ? "matches" : "does not match")
+                      << std::endl;
+            return false;
+        }
+        emulation.movie.apply(frame, chip8.keys);
+    }
+    if (emulation.record) {
+        emulation.movie.record(frame, chip8.keys);
+    }
+
+    // Only the JIT's --check mode throws here
+    try {
+        emulation.scheduler.run_frame();
+    } catch (std::exception const& e) {
+        std::cout << "Exception: " << e.what() << std::endl;
+        return false;
+    }
+    emulation.audio.publish(chip8);
+    if (chip8.faulted()) {
+        if (chip8.fault().kind != FAULT_EXIT) {
+            std::cout << "Fault: " << describe_fault(chip8.fault()) << std::endl;
         }
+        return false;
+    }
 
-        int row = static_cast<int>(i / 64);
-        int col = i % 64;
+    if (emulation.rewind) {
+        emulation.rewind->push(chip8);
+    }
+    return true;
+}
 
-        r.x = DISPLAY_MULTIPLIER * col;
-        r.y = DISPLAY_MULTIPLIER * row;
-        r.w = DISPLAY_MULTIPLIER;
-        r.h = DISPLAY_MULTIPLIER;
+// Emulation thread. Hands the machine's display to the SDL thread.
+void publish_frame(Emulation& emulation, unsigned long sequence) {
+    Frame& out = emulation.frames.write_slot();
+    out.display = emulation.chip8.gfx;
+    out.sequence = sequence;
+    emulation.frames.publish();
+    wake_display(emulation);
+}
 
-        SDL_RenderFillRect(renderer, &r);
+// Emulation thread. Nothing is pushed while the SDL thread has yet to see
+// the last wake up, so the event queue never fills with them.
+void wake_display(Emulation& emulation) {
+    if (emulation.wake_event == static_cast<Uint32>(-1) || emulation.wake_pending.exchange(true)) {
+        return;
     }
 
+    SDL_Event e = {};
+    e.type = emulation.wake_event;
+    if (SDL_PushEvent(&e) != 1) {
+        emulation.wake_pending.store(false);
+    }
+}
+
+// Frame and emulation time over the pacer's window, in milliseconds.
+void print_frame_stats(const FramePacer& pacer) {
+    const FrameTimes* times[2] = {&pacer.frame_times(), &pacer.emulation_times()};
+    const char* names[2] = {"Frame time", "emulation"};
+
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(3);
+    for (unsigned int i = 0; i < 2; i++) {
+        line << (i == 0 ? "" : ", ") << names[i]
+             << " p50 " << static_cast<double>(times[i]->percentile(50).count()) / 1e6
+             << " p99 " << static_cast<double>(times[i]->percentile(99).count()) / 1e6
+             << " max " << static_cast<double>(times[i]->max().count()) / 1e6;
+    }
+    std::cout << line.str() << " ms" << std::endl;
+}
+
+// SDL thread. Uploads the rows of display that changed since the frame
+// before it, or all of them.
+void upload_frame(const std::array<SDL_Texture*, 2>& textures, const Display& display, bool everything) {
+    // One texture per resolution
+    SDL_Texture* texture = textures[display.hires()];
+    int width = static_cast<int>(display.width());
+
+    // Only upload the rows that changed
+    unsigned int first = everything ? 0 : display.first_dirty_row();
+    unsigned int last = everything ? display.height() - 1 : display.last_dirty_row();
+    std::array<uint32_t, HIRES_WIDTH * HIRES_HEIGHT> pixels;
+    display.expand_rows_to_rgba(pixels.data(), first, last, PALETTE);
+
+    SDL_Rect rows;
+    rows.x = 0;
+    rows.y = static_cast<int>(first);
+    rows.w = width;
+    rows.h = static_cast<int>(last - first + 1);
+    SDL_UpdateTexture(texture, &rows, pixels.data(), width * static_cast<int>(sizeof(uint32_t)));
+}
+
+// SDL thread.
+void present_frame(SDL_Renderer* renderer, const std::array<SDL_Texture*, 2>& textures, const Display& display) {
+    // The renderer scales the texture up to the window
+    SDL_RenderCopy(renderer, textures[display.hires()], nullptr, nullptr);
     SDL_RenderPresent(renderer);
 }
 
-// Returns true if we are quitting, false otherwise.
-bool handle_input(Chip8& chip8) {
+// Runs on SDL's audio thread and must never block.
+void audio_callback(void* userdata, Uint8* stream, int length) {
+    AudioStream* audio = static_cast<AudioStream*>(userdata);
+    audio->render(reinterpret_cast<int16_t*>(stream), static_cast<unsigned long>(length) / sizeof(int16_t));
+}
+
+// Chip8 key for a keyboard key, or -1. The keypad's 4x4 grid
+// 1 2 3 C / 4 5 6 D / 7 8 9 E / A 0 B F sits on the left of the keyboard.
+int keypad_key(SDL_Keycode sym) {
+    switch (sym) {
+        case SDLK_1:
+            return 1;
+        case SDLK_2:
+            return 2;
+        case SDLK_3:
+            return 3;
+        case SDLK_4:
+            return 12;
+        case SDLK_q:
+            return 4;
+        case SDLK_w:
+            return 5;
+        case SDLK_e:
+            return 6;
+        case SDLK_r:
+            return 13;
+        case SDLK_a:
+            return 7;
+        case SDLK_s:
+            return 8;
+        case SDLK_d:
+            return 9;
+        case SDLK_f:
+            return 14;
+        case SDLK_z:
+            return 10;
+        case SDLK_x:
+            return 0;
+        case SDLK_c:
+            return 11;
+        case SDLK_v:
+            return 15;
+    }
+    return -1;
+}
+
+// SDL thread. Handles every pending event, first waiting up to
+// IDLE_WAIT_MS for one if block is set. Returns true if we are quitting,
+// false otherwise.
+bool handle_input(Emulation& emulation, bool& redraw, bool block) {
     SDL_Event e;
 
-    while (SDL_PollEvent(&e) != 0) {
+    int pending = block ? SDL_WaitEventTimeout(&e, IDLE_WAIT_MS) : SDL_PollEvent(&e);
+    for (; pending != 0; pending = SDL_PollEvent(&e)) {
         if (e.type == SDL_QUIT) {
             return true;
         }
 
-        if (e.type == SDL_KEYDOWN) {
-            switch (e.key.keysym.sym) {
-                case SDLK_1:
-                    chip8.keys[1] = 1;
-                    break;
-                case SDLK_2:
-                    chip8.keys[2] = 1;
-                    break;
-                case SDLK_3:
-                    chip8.keys[3] = 1;
-                    break;
-                case SDLK_4:
-                    chip8.keys[12] = 1;
-                    break;
-                case SDLK_q:
-                    chip8.keys[4] = 1;
-                    break;
-                case SDLK_w:
-                    chip8.keys[5] = 1;
-                    break;
-                case SDLK_e:
-                    chip8.keys[6] = 1;
-                    break;
-                case SDLK_r:
-                    chip8.keys[13] = 1;
-                    break;
-                case SDLK_a:
-                    chip8.keys[7] = 1;
-                    break;
-                case SDLK_s:
-                    chip8.keys[8] = 1;
-                    break;
-                case SDLK_d:
-                    chip8.keys[9] = 1;
-                    break;
-                case SDLK_f:
-                    chip8.keys[14] = 1;
-                    break;
-                case SDLK_z:
-                    chip8.keys[10] = 1;
-                    break;
-                case SDLK_x:
-                    chip8.keys[0] = 1;
-                    break;
-                case SDLK_c:
-                    chip8.keys[11] = 1;
-                    break;
-                case SDLK_v:
-                    chip8.keys[15] = 1;
-                    break;
-            }
+        if (e.type == emulation.wake_event) {
+            emulation.wake_pending.store(false, std::memory_order_relaxed);
+        }
+
+        // The window contents may have been lost, draw everything again
+        if (e.type == SDL_WINDOWEVENT) {
+            redraw = true;
+        }
+
+        // Held to step back through the history, a frame at a time
+        if ((e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) && e.key.keysym.sym == SDLK_BACKSPACE) {
+            emulation.rewinding.store(e.type == SDL_KEYDOWN, std::memory_order_relaxed);
+            continue;
         }
 
-        if (e.type == SDL_KEYUP) {
-            switch (e.key.keysym.sym) {
-                case SDLK_1:
-                    chip8.keys[1] = 0;
-                    break;
-                case SDLK_2:
-                    chip8.keys[2] = 0;
-                    break;
-                case SDLK_3:
-                    chip8.keys[3] = 0;
-                    break;
-                case SDLK_4:
-                    chip8.keys[12] = 0;
-                    break;
-                case SDLK_q:
-                    chip8.keys[4] = 0;
-                    break;
-                case SDLK_w:
-                    chip8.keys[5] = 0;
-                    break;
-                case SDLK_e:
-                    chip8.keys[6] = 0;
-                    break;
-                case SDLK_r:
-                    chip8.keys[13] = 0;
-                    break;
-                case SDLK_a:
-                    chip8.keys[7] = 0;
-                    break;
-                case SDLK_s:
-                    chip8.keys[8] = 0;
-                    break;
-                case SDLK_d:
-                    chip8.keys[9] = 0;
-                    break;
-                case SDLK_f:
-                    chip8.keys[14] = 0;
-                    break;
-                case SDLK_z:
-                    chip8.keys[10] = 0;
-                    break;
-                case SDLK_x:
-                    chip8.keys[0] = 0;
-                    break;
-                case SDLK_c:
-                    chip8.keys[11] = 0;
-                    break;
-                case SDLK_v:
-                    chip8.keys[15] = 0;
-                    break;
+        if (e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) {
+            int key = keypad_key(e.key.keysym.sym);
+            if (key < 0) {
+                continue;
+            }
+            uint16_t bit = static_cast<uint16_t>(1 << key);
+            if (e.type == SDL_KEYDOWN) {
+                emulation.keys.fetch_or(bit, std::memory_order_relaxed);
+            } else {
+                emulation.keys.fetch_and(static_cast<uint16_t>(~bit), std::memory_order_relaxed);
             }
         }
     }
@@ -172,8 +379,86 @@ bool handle_input(Chip8& chip8) {
 // 0xF00 - 0xFFF : display refresh
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cout << "Usage: ./main [path]" << std::endl;
+    unsigned long instructions_per_frame = DEFAULT_INSTRUCTIONS_PER_FRAME;
+    const char* path = nullptr;
+    const char* trace_path = nullptr;
+    const char* profile_path = nullptr;
+    const char* record_path = nullptr;
+    const char* replay_path = nullptr;
+    bool use_jit = false;
+    bool check = false;
+    bool vsync = false;
+    bool stats = false;
+    unsigned long rewind_mb = DEFAULT_REWIND_MB;
+    unsigned long run_ahead = 0;
+    uint32_t seed = DEFAULT_SEED;
+    unsigned int quirks = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--ipf" && i + 1 < argc) {
+            std::string value = argv[++i];
+            // "unbounded" (or 0) runs as many instructions as fit in a frame.
+            instructions_per_frame = value == "unbounded" ? 0 : std::stoul(value);
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (arg == "--profile" && i + 1 < argc) {
+            profile_path = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (arg == "--quirks" && i + 1 < argc) {
+            try {
+                quirks = parse_quirks(argv[++i]);
+            } catch (std::exception const& e) {
+                std::cout << "Exception: " << e.what() << std::endl;
+                return 1;
+            }
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = static_cast<uint32_t>(std::stoul(argv[++i], nullptr, 0));
+        } else if (arg == "--core=jit") {
+            use_jit = true;
+        } else if (arg == "--core=interp") {
+            use_jit = false;
+        } else if (arg == "--check") {
+            check = true;
+        } else if (arg == "--vsync") {
+            vsync = true;
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (arg == "--rewind" && i + 1 < argc) {
+            // Megabytes of history, 0 disables rewinding
+            rewind_mb = std::stoul(argv[++i]);
+        } else if (arg == "--run-ahead" && i + 1 < argc) {
+            run_ahead = std::stoul(argv[++i]);
+        } else {
+            path = argv[i];
+        }
+    }
+
+    InputMovie movie;
+    if (replay_path != nullptr) {
+        // The movie's own settings are needed to reproduce it
+        try {
+            movie.load(replay_path);
+        } catch (std::exception const& e) {
+            std::cout << "Exception: " << e.what() << std::endl;
+            return 1;
+        }
+        seed = movie.seed();
+        instructions_per_frame = movie.instructions_per_frame();
+        quirks = movie.quirks();
+    }
+
+    // Unbounded frames take as long as they are allowed to, there is no
+    // time left to run more of them
+    // Run-ahead frames are rolled back, so they have no place in a trace or profile
+    if (path == nullptr || (instructions_per_frame == 0 && (record_path != nullptr || run_ahead != 0))
+        || (run_ahead != 0 && (trace_path != nullptr || profile_path != nullptr))) {
+        std::cout << "Usage: ./main [--ipf instructions per frame|unbounded] [--core=jit|interp] [--check] [--vsync] [--stats] [--rewind MB] [--run-ahead N] [--seed N] [--quirks list] "
+                  << "[--record movie|--replay movie] [--trace path] [--profile path] [path]" << std::endl;
         return 0;
     }
 
@@ -181,7 +466,7 @@ int main(int argc, char* argv[]) {
     SDL_Surface* screen_surface = nullptr;
     SDL_Renderer* renderer = nullptr;
 
-    if (SDL_Init( SDL_INIT_VIDEO) < 0) {
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0) {
         std::cout << "SDL could not initialize! SDL_Error: " << SDL_GetError() << std::endl;
         SDL_DestroyWindow(window);
         SDL_Quit();
@@ -209,39 +494,160 @@ int main(int argc, char* argv[]) {
     // Get window surface
     screen_surface = SDL_GetWindowSurface(window);
 
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    // Presenting waits for vsync, which only holds up this thread
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (renderer == nullptr) {
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+    }
+
+    // The display is uploaded to the texture of its resolution and scaled
+    // when rendered
+    std::array<SDL_Texture*, 2> textures = {{
+        SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                          DISPLAY_WIDTH, DISPLAY_HEIGHT),
+        SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                          HIRES_WIDTH, HIRES_HEIGHT)
+    }};
+
+    if (renderer == nullptr || textures[0] == nullptr || textures[1] == nullptr) {
+        std::cout << "Renderer could not be created! SDL_Error: " << SDL_GetError() << std::endl;
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return -1;
+    }
+
+    // The machine and the JIT's block table are large, keep them off the
+    // stack
+    std::unique_ptr<Chip8> machine = std::make_unique<Chip8>();
+    Chip8& chip8 = *machine;
+    chip8.initialize(seed);
+    chip8.set_quirks(quirks);
+    chip8.load_program(path);
+
+    // Without an audio device the emulator still runs, silently
+    AudioStream audio(AUDIO_SAMPLE_RATE);
+    SDL_AudioSpec wanted = {};
+    wanted.freq = AUDIO_SAMPLE_RATE;
+    wanted.format = AUDIO_S16SYS;
+    wanted.channels = 1;
+    wanted.samples = AUDIO_BUFFER_SAMPLES;
+    wanted.callback = audio_callback;
+    wanted.userdata = &audio;
+    SDL_AudioDeviceID audio_device = SDL_OpenAudioDevice(nullptr, 0, &wanted, nullptr, 0);
+    if (audio_device == 0) {
+        std::cout << "Audio could not be opened! SDL_Error: " << SDL_GetError() << std::endl;
+    } else {
+        SDL_PauseAudioDevice(audio_device, 0);
+    }
 
-    Chip8 chip8;
-    chip8.initialize();
-    chip8.load_program(argv[1]);
+    std::unique_ptr<Jit> jit = std::make_unique<Jit>(chip8);
+    Scheduler scheduler(chip8, instructions_per_frame);
+    if (use_jit) {
+        if (check) {
+            jit->enable_check();
+        }
+        scheduler.use_jit(jit.get());
+    }
 
-    bool quit = false;
-    while (!quit) {
-        unsigned long start = SDL_GetPerformanceCounter();
+    if (record_path != nullptr) {
+        movie.start(seed, instructions_per_frame, quirks);
+    }
 
-        try {
-            chip8.emulate_cycle();
-        } catch (std::exception const& e) {
-            std::cout << "Exception: " << e.what() << std::endl;
+    // The machine runs on its own thread so that rendering, and waiting for
+    // vsync in particular, never costs it cycles
+    Emulation emulation(chip8, *jit, scheduler, audio, movie);
+    emulation.record = record_path != nullptr;
+    emulation.replay = replay_path != nullptr;
+    emulation.print_stats = stats;
+    emulation.run_ahead = run_ahead;
+    // A movie must run straight through, so it cannot be rewound
+    if (rewind_mb != 0 && !emulation.record && !emulation.replay) {
+        emulation.rewind.reset(new Rewind(rewind_mb << 20));
+    }
+    emulation.wake_event = SDL_RegisterEvents(1);
+    if (vsync) {
+        SDL_RendererInfo info;
+        if (SDL_GetRendererInfo(renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC) != 0) {
+            emulation.pacer.lock_to_vsync(true);
+        } else {
+            std::cout << "Vsync is not available, pacing frames by the clock" << std::endl;
+            vsync = false;
+        }
+    }
+    std::thread emulation_thread(run_emulation, std::ref(emulation));
+
+    unsigned long shown = 0;
+    bool redraw = false;
+    std::chrono::steady_clock::time_point last_report = std::chrono::steady_clock::now();
+    while (emulation.running.load(std::memory_order_relaxed)) {
+        // Without vsync there is nothing to do until an event arrives, key
+        // presses and the emulation thread's wake ups included
+        if (handle_input(emulation, redraw, !vsync)) {
+            emulation.running.store(false, std::memory_order_relaxed);
             break;
         }
 
-        // for (unsigned long i = 0; i < chip8.gfx.size(); i++) {
-        //     if (i % 32 == 0)
-        //         printf("\n");
-        //     printf("%02x", chip8.gfx[i]);
-        // }
+        // Keep showing the last frame if nothing was drawn since. Locked
+        // to vsync, every refresh is presented to start the next frame.
+        bool fresh = emulation.frames.update();
+        const Frame& frame = emulation.frames.read_slot();
+        if (fresh || redraw) {
+            upload_frame(textures, frame.display, redraw || frame.sequence != shown + 1);
+            shown = frame.sequence;
+            redraw = false;
+            present_frame(renderer, textures, frame.display);
+        } else if (vsync) {
+            present_frame(renderer, textures, frame.display);
+        }
+        if (vsync) {
+            emulation.pacer.vsync();
+        }
+
+        // Report the achieved clock speed about once a second
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now - last_report >= std::chrono::seconds(1)) {
+            last_report = now;
+            std::string title = "Chip8 Emulator - "
+                + std::to_string(emulation.instructions_per_second.load(std::memory_order_relaxed))
+                + " instructions/s";
+            if (audio_device != 0) {
+                title += " - audio latency " + std::to_string(audio.latency_ns() / 1000000) + " ms";
+            }
+            SDL_SetWindowTitle(window, title.c_str());
+        }
+    }
+    emulation_thread.join();
 
-        draw_graphics(renderer, chip8);
+    if (record_path != nullptr) {
+        movie.finish(scheduler.total_frames(), chip8.gfx.hash());
+        movie.write(record_path);
+    }
 
-        quit = handle_input(chip8);
+    if (trace_path != nullptr) {
+#if CHIP8_TRACE
+        chip8.trace.write(trace_path);
+#else
+        std::cout << "Tracing is compiled out, rebuild with TRACE=1 or TRACE=2" << std::endl;
+#endif
+    }
+
+    if (profile_path != nullptr) {
+#if CHIP8_PROFILE
+        chip8.profile.write(profile_path);
+#else
+        std::cout << "Profiling is compiled out, rebuild with PROFILE=1" << std::endl;
+#endif
+    }
 
-        unsigned long end = SDL_GetPerformanceCounter();
-        float elapsed_ms = static_cast<float>(end - start) / static_cast<float>(SDL_GetPerformanceFrequency()) * 1000.0f;
-        // Cap to 60 FPS
-        SDL_Delay(static_cast<unsigned int>(floor(16.666f - elapsed_ms)));
+    if (audio_device != 0) {
+        SDL_CloseAudioDevice(audio_device);
+        std::cout << "Audio latency: worst " << static_cast<double>(audio.worst_latency_ns()) / 1e6
+                  << " ms, " << audio.dropped() << " updates dropped" << std::endl;
     }
 
+    SDL_DestroyTexture(textures[0]);
+    SDL_DestroyTexture(textures[1]);
+    SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
 
@@ -0,0 +1,58 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "Disassembler.h"
+#include "Trace.h"
+
+// Turns a binary trace file written by a traced build into readable
+// disassembly, one executed instruction per line.
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: ./chip8-trace [trace file]" << std::endl;
+        return 0;
+    }
+
+    std::ifstream file(argv[1], std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        std::cout << "Unable to open trace file!" << std::endl;
+        return 1;
+    }
+
+    TraceFileHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || header.magic != TRACE_MAGIC) {
+        std::cout << "Not a trace file!" << std::endl;
+        return 1;
+    }
+    if (header.version != TRACE_VERSION || header.entry_size != sizeof(TraceEntry)) {
+        std::cout << "Unsupported trace file version!" << std::endl;
+        return 1;
+    }
+
+    char line[128];
+    for (uint32_t i = 0; i < header.count; i++) {
+        TraceEntry entry;
+        if (!file.read(reinterpret_cast<char*>(&entry), sizeof(entry))) {
+            std::cout << "Trace file is truncated!" << std::endl;
+            return 1;
+        }
+
+        snprintf(line, sizeof(line), "%03X: %04X  %-18s", entry.pc, entry.opcode,
+                 disassemble(entry.opcode).c_str());
+        std::cout << line;
+
+        if (entry.level >= 2) {
+            snprintf(line, sizeof(line), " I=%03X SP=%X", entry.I, entry.sp);
+            std::cout << line;
+            for (unsigned long r = 0; r < entry.regs.size(); r++) {
+                snprintf(line, sizeof(line), " %02X", entry.regs[r]);
+                std::cout << line;
+            }
+        }
+        std::cout << "\n";
+    }
+
+    return 0;
+}